@@ -0,0 +1,434 @@
+/*
+ * kernels.c
+ * Copyright (C) 2000-2003 Michel Lespinasse <walken@zoy.org>
+ * Copyright (C) 1999-2000 Aaron Holtzman <aholtzma@ess.engr.uvic.ca>
+ *
+ * This file is part of mpeg2dec, a free MPEG-2 video stream decoder.
+ * See http://libmpeg2.sourceforge.net/ for updates.
+ *
+ * mpeg2dec is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpeg2dec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpeg2dec; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/time.h>
+
+#include "mpeg2.h"
+#include "mpeg2convert.h"
+#include "attributes.h"
+#include "mpeg2_internal.h"
+
+extern void (* mpeg2_idct_copy) (int shape, int16_t * block,
+				 uint8_t * dest, int stride);
+extern void (* mpeg2_idct_add) (int shape, int16_t * block,
+				uint8_t * dest, int stride);
+extern void (* mpeg2_cpu_state_restore) (cpu_state_t * state);
+extern mpeg2_mc_t mpeg2_mc;
+
+#define RUNS 5
+#define RUN_USEC 10000
+
+#define MC_STRIDE 768
+#define MC_LINES 64
+
+#define WIDTH 720
+#define HEIGHT 576
+
+typedef struct {
+    void (* body) (void * arg, int n);
+    void * arg;
+    double ns;
+    double cycles;
+} timing_t;
+
+static uint8_t mc_ref[MC_STRIDE * MC_LINES] ATTR_ALIGN(16);
+static uint8_t mc_dest[MC_STRIDE * MC_LINES] ATTR_ALIGN(16);
+static int16_t idct_block[64] ATTR_ALIGN(16);
+static uint8_t scan_norm[64], scan_alt[64];
+static uint32_t accel;
+
+static double usec (void)
+{
+    struct timeval tv;
+
+    gettimeofday (&tv, NULL);
+    return tv.tv_sec * 1000000.0 + tv.tv_usec;
+}
+
+#ifdef ARCH_X86
+static uint64_t rdtsc (void)
+{
+    uint32_t lo, hi;
+
+    __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t) hi << 32) | lo;
+}
+#endif
+
+static void cpu_state_restore (void)
+{
+    cpu_state_t state;
+
+    if (mpeg2_cpu_state_restore)
+	mpeg2_cpu_state_restore (&state);
+}
+
+/*
+ * Double the iteration count until a run takes RUN_USEC, then keep the
+ * best of RUNS runs of that length. Results are per call of body.
+ */
+static void measure (timing_t * t)
+{
+    double start, elapsed;
+    int n, run;
+
+    n = 16;
+    while (1) {
+	start = usec ();
+	t->body (t->arg, n);
+	cpu_state_restore ();
+	elapsed = usec () - start;
+	if (elapsed >= RUN_USEC || n >= (1 << 28))
+	    break;
+	n <<= 1;
+    }
+
+    t->ns = t->cycles = -1;
+    for (run = 0; run < RUNS; run++) {
+	double ns, cycles = -1;
+#ifdef ARCH_X86
+	uint64_t tsc;
+
+	tsc = rdtsc ();
+#endif
+	start = usec ();
+	t->body (t->arg, n);
+	cpu_state_restore ();
+	ns = (usec () - start) * 1000.0 / n;
+#ifdef ARCH_X86
+	cycles = (double) (rdtsc () - tsc) / n;
+#endif
+	if (t->ns < 0 || ns < t->ns)
+	    t->ns = ns;
+	if (t->cycles < 0 || cycles < t->cycles)
+	    t->cycles = cycles;
+    }
+}
+
+static void print_timing (const char * sep, const timing_t * t,
+			  unsigned int bytes)
+{
+    printf ("\"ns\": %.2f, ", t->ns);
+    if (t->cycles >= 0)
+	printf ("\"cycles\": %.1f, ", t->cycles);
+    else
+	printf ("\"cycles\": null, ");
+    printf ("\"gbps\": %.3f}%s\n", bytes / t->ns, sep);
+}
+
+typedef struct {
+    mpeg2_mc_fct * fct;
+    int height;
+} mc_arg_t;
+
+static void mc_body (void * _arg, int n)
+{
+    mc_arg_t * arg = (mc_arg_t *) _arg;
+    mpeg2_mc_fct * fct = arg->fct;
+    int height = arg->height;
+    int i, x, y;
+
+    for (i = x = y = 0; i < n; i++) {
+	fct (mc_dest + y * MC_STRIDE + x, mc_ref + (y + 1) * MC_STRIDE + x + 1,
+	     MC_STRIDE, height);
+	x += 16;
+	if (x == MC_STRIDE - 32) {
+	    x = 0;
+	    y = (y + 16) & 31;
+	}
+    }
+}
+
+static void bench_mc (void)
+{
+    static const char * const name[] = {"o", "x", "y", "xy"};
+    mc_arg_t arg;
+    timing_t t;
+    int avg, i;
+
+    printf ("  \"mc\": [\n");
+    t.body = mc_body;
+    t.arg = &arg;
+    for (avg = 0; avg < 2; avg++)
+	for (i = 0; i < 8; i++) {
+	    int width = (i < 4) ? 16 : 8;
+
+	    arg.fct = avg ? mpeg2_mc.avg[i] : mpeg2_mc.put[i];
+	    arg.height = width;
+	    measure (&t);
+	    printf ("    {\"op\": \"%s\", \"pos\": \"%s\", \"width\": %d, "
+		    "\"height\": %d, ", avg ? "avg" : "put", name[i & 3],
+		    width, width);
+	    print_timing ((avg && i == 7) ? "" : ",", &t, width * width);
+	}
+    printf ("  ],\n");
+}
+
+/*
+ * Sparsity patterns are the top-left corners of the block that the idct
+ * shapes cover, with every coefficient in them nonzero. The decoder
+ * writes exactly those into a cleared block and the idct clears it
+ * again, so the body does the same.
+ */
+typedef struct {
+    int add;
+    int shape;
+    int count;
+    uint8_t pos[64];
+} idct_arg_t;
+
+static void idct_body (void * _arg, int n)
+{
+    idct_arg_t * arg = (idct_arg_t *) _arg;
+    int count = arg->count;
+    int i, j, x;
+
+    for (i = x = 0; i < n; i++) {
+	idct_block[arg->pos[0]] = 1024;
+	for (j = 1; j < count; j++)
+	    idct_block[arg->pos[j]] = (j & 1) ? 37 : -21;
+	if (arg->add)
+	    mpeg2_idct_add (arg->shape, idct_block, mc_dest + x, MC_STRIDE);
+	else
+	    mpeg2_idct_copy (arg->shape, idct_block, mc_dest + x, MC_STRIDE);
+	x = (x + 8) & 511;
+    }
+}
+
+static void bench_idct (void)
+{
+    static const struct {
+	const char * name;
+	int rows, cols;
+    } shapes[] = {{"dc", 1, 1}, {"row", 1, 8}, {"4x4", 4, 4}, {"full", 8, 8}};
+    uint8_t perm[64];
+    idct_arg_t arg;
+    timing_t t;
+    int add, i, j, coded;
+
+    for (j = 0; j < 64; j++)
+	perm[scan_norm[j]] = mpeg2_scan_norm[j];
+    printf ("  \"idct\": [\n");
+    t.body = idct_body;
+    t.arg = &arg;
+    for (add = 0; add < 2; add++)
+	for (i = 0; i < 4; i++) {
+	    arg.add = add;
+	    arg.count = coded = 0;
+	    for (j = 0; j < 64; j++)
+		if (j >> 3 < shapes[i].rows && (j & 7) < shapes[i].cols) {
+		    arg.pos[arg.count++] = perm[j];
+		    coded |= perm[j];
+		}
+	    arg.shape = mpeg2_idct_shape[coded];
+	    measure (&t);
+	    printf ("    {\"op\": \"%s\", \"shape\": \"%s\", ",
+		    add ? "add" : "copy", shapes[i].name);
+	    print_timing ((add && i == 3) ? "" : ",", &t, 64);
+	}
+    printf ("  ],\n");
+}
+
+typedef struct {
+    mpeg2_convert_init_t init;
+    void * id;
+    mpeg2_fbuf_t fbuf;
+    mpeg2_picture_t picture;
+    uint8_t * src[3];
+} convert_arg_t;
+
+static void convert_body (void * _arg, int n)
+{
+    convert_arg_t * arg = (convert_arg_t *) _arg;
+    uint8_t * src[3];
+    int i, y;
+
+    for (i = 0; i < n; i++) {
+	arg->init.start (arg->id, &arg->fbuf, &arg->picture, NULL);
+	for (y = 0; y < HEIGHT; y += 16) {
+	    src[0] = arg->src[0] + y * WIDTH;
+	    src[1] = arg->src[1] + (y >> 1) * (WIDTH >> 1);
+	    src[2] = arg->src[2] + (y >> 1) * (WIDTH >> 1);
+	    arg->init.copy (arg->id, src, y);
+	}
+    }
+}
+
+static void bench_convert (void)
+{
+    static struct {
+	const char * name;
+	mpeg2_convert_t * convert;
+    } converters[] = {
+	{"rgb32", mpeg2convert_rgb32}, {"rgb24", mpeg2convert_rgb24},
+	{"rgb16", mpeg2convert_rgb16}, {"rgb15", mpeg2convert_rgb15},
+	{"rgb8", mpeg2convert_rgb8}, {"bgr32", mpeg2convert_bgr32},
+	{"bgr24", mpeg2convert_bgr24}, {"bgr16", mpeg2convert_bgr16},
+	{"bgr15", mpeg2convert_bgr15}, {"bgr8", mpeg2convert_bgr8},
+	{"uyvy", mpeg2convert_uyvy}
+    };
+    static const int count = sizeof (converters) / sizeof (converters[0]);
+    mpeg2_sequence_t sequence;
+    convert_arg_t arg;
+    timing_t t;
+    int i, stride;
+
+    memset (&sequence, 0, sizeof (sequence));
+    sequence.width = sequence.picture_width = WIDTH;
+    sequence.height = sequence.picture_height = HEIGHT;
+    sequence.chroma_width = WIDTH >> 1;
+    sequence.chroma_height = HEIGHT >> 1;
+    sequence.flags = SEQ_FLAG_PROGRESSIVE_SEQUENCE;
+    memset (&arg.picture, 0, sizeof (arg.picture));
+    arg.picture.nb_fields = 2;
+    arg.picture.flags = PIC_FLAG_PROGRESSIVE_FRAME | PIC_FLAG_TOP_FIELD_FIRST;
+    arg.src[0] = (uint8_t *) malloc (WIDTH * HEIGHT);
+    arg.src[1] = (uint8_t *) malloc (WIDTH * HEIGHT / 4);
+    arg.src[2] = (uint8_t *) malloc (WIDTH * HEIGHT / 4);
+    for (i = 0; i < WIDTH * HEIGHT; i++)
+	arg.src[0][i] = i * 7;
+    for (i = 0; i < WIDTH * HEIGHT / 4; i++) {
+	arg.src[1][i] = i * 3;
+	arg.src[2][i] = i * 5;
+    }
+
+    printf ("  \"convert\": [\n");
+    t.body = convert_body;
+    t.arg = &arg;
+    for (i = 0; i < count; i++) {
+	converters[i].convert (MPEG2_CONVERT_SET, NULL, &sequence, 0,
+			       accel, NULL, &arg.init);
+	stride = converters[i].convert (MPEG2_CONVERT_STRIDE, NULL, &sequence,
+					0, accel, NULL, &arg.init);
+	arg.id = malloc (arg.init.id_size);
+	converters[i].convert (MPEG2_CONVERT_START, arg.id, &sequence, stride,
+			       accel, NULL, &arg.init);
+	arg.fbuf.buf[0] = (uint8_t *) malloc (arg.init.buf_size[0]);
+	arg.fbuf.buf[1] = arg.fbuf.buf[2] = NULL;
+	arg.fbuf.id = NULL;
+	measure (&t);
+	/* per macroblock, so that the numbers compare with mc and idct */
+	t.ns /= (WIDTH / 16) * (HEIGHT / 16);
+	if (t.cycles >= 0)
+	    t.cycles /= (WIDTH / 16) * (HEIGHT / 16);
+	printf ("    {\"op\": \"%s\", \"width\": %d, \"height\": %d, ",
+		converters[i].name, WIDTH, HEIGHT);
+	print_timing ((i == count - 1) ? "" : ",", &t,
+		      arg.init.buf_size[0] / ((WIDTH / 16) * (HEIGHT / 16)));
+	free (arg.fbuf.buf[0]);
+	free (arg.id);
+    }
+    printf ("  ]\n");
+
+    free (arg.src[0]);
+    free (arg.src[1]);
+    free (arg.src[2]);
+}
+
+static const char * accel_name (uint32_t level)
+{
+    if (!level)
+	return "c";
+#ifdef ARCH_X86
+    if (level & MPEG2_ACCEL_X86_SSE3)
+	return "sse3";
+    if (level & MPEG2_ACCEL_X86_SSE2)
+	return "sse2";
+    if (level & MPEG2_ACCEL_X86_MMXEXT)
+	return "mmxext";
+    if (level & MPEG2_ACCEL_X86_3DNOW)
+	return "3dnow";
+    if (level & MPEG2_ACCEL_X86_MMX)
+	return "mmx";
+#endif
+#ifdef ARCH_PPC
+    if (level & MPEG2_ACCEL_PPC_ALTIVEC)
+	return "altivec";
+#endif
+#ifdef ARCH_ALPHA
+    if (level & MPEG2_ACCEL_ALPHA_MVI)
+	return "mvi";
+    if (level & MPEG2_ACCEL_ALPHA)
+	return "alpha";
+#endif
+#ifdef ARCH_SPARC
+    if (level & MPEG2_ACCEL_SPARC_VIS2)
+	return "vis2";
+    if (level & MPEG2_ACCEL_SPARC_VIS)
+	return "vis";
+#endif
+#ifdef ARCH_ARM
+    if (level & MPEG2_ACCEL_ARM)
+	return "arm";
+#endif
+    return "unknown";
+}
+
+/*
+ * Every accel level is the detected flags up to and including one of
+ * its bits, so each kernel is timed at the level that selects it as the
+ * decoder would, starting from plain C.
+ */
+int main (int argc, char ** argv)
+{
+    uint32_t detected, bit;
+    int first;
+
+    detected = mpeg2_detect_accel (MPEG2_ACCEL_DETECT);
+    memcpy (scan_norm, mpeg2_scan_norm, 64);
+    memcpy (scan_alt, mpeg2_scan_alt, 64);
+    memset (mc_ref, 0x80, sizeof (mc_ref));
+    memset (idct_block, 0, sizeof (idct_block));
+
+    printf ("[\n");
+    first = 1;
+    for (bit = 0; bit < 32; bit++) {
+	if (bit && !(detected & (1 << (bit - 1))))
+	    continue;
+	accel = bit ? detected & ((1 << bit) - 1) : 0;
+
+	memcpy (mpeg2_scan_norm, scan_norm, 64);
+	memcpy (mpeg2_scan_alt, scan_alt, 64);
+	mpeg2_cpu_state_restore = NULL;
+	mpeg2_cpu_state_init (accel);
+	mpeg2_idct_init (accel);
+	mpeg2_mc_init (accel);
+
+	printf ("%s {\"accel\": \"%s\", \"flags\": %u,\n",
+		first ? "" : ",", accel_name (accel), (unsigned int) accel);
+	bench_mc ();
+	bench_idct ();
+	bench_convert ();
+	printf (" }\n");
+	first = 0;
+    }
+    printf ("]\n");
+
+    return 0;
+}
@@ -0,0 +1,786 @@
+/*
+ * mkstream.c
+ * Copyright (C) 2000-2003 Michel Lespinasse <walken@zoy.org>
+ * Copyright (C) 1999-2000 Aaron Holtzman <aholtzma@ess.engr.uvic.ca>
+ *
+ * This file is part of mpeg2dec, a free MPEG-2 video stream decoder.
+ * See http://libmpeg2.sourceforge.net/ for updates.
+ *
+ * mpeg2dec is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpeg2dec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpeg2dec; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+
+#include "mpeg2.h"
+#include "attributes.h"
+#include "mpeg2_internal.h"
+#include "vlc.h"
+
+#define I_PICTURE 1
+#define P_PICTURE 2
+#define B_PICTURE 3
+
+#define TOP_FIELD 1
+#define BOTTOM_FIELD 2
+#define FRAME 3
+
+static FILE * out_file, * ts_file;
+static int ts_packet_size = 0;
+static int mpeg1 = 0;
+static int width = 720, height = 576;
+static int chroma_format = 1;
+static int gop_size = 12, anchor_distance = 3;
+static int field_pictures = 0, interlaced = 0;
+static int quantiser = 8;
+static int f_code = 3;
+static int density = 6;
+static int frames = 50;
+static int intra_vlc_format = 0, alternate_scan = 0;
+static uint32_t seed = 1;
+
+static int mb_width, mb_height, coded_height;
+static int picture_structure, frame_pred_frame_dct, coding_type;
+
+static uint64_t out_bits;
+static int out_count;
+
+typedef struct {
+    uint32_t code;
+    int len;
+} vlc_t;
+
+static vlc_t mb_p_vlc[32], mb_b_vlc[32], cbp_vlc[64], mv_vlc[17];
+static vlc_t dc_vlc[2][12];
+static vlc_t dct_vlc[2][33][41];	/* [intra_vlc_format][run + 1][level] */
+static vlc_t eob_vlc[2];
+
+static uint32_t rnd (void)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+static int rnd_range (int lo, int hi)
+{
+    return lo + (int) (rnd () % (uint32_t) (hi - lo + 1));
+}
+
+static void vlc_set (vlc_t * vlc, uint32_t prefix, int len)
+{
+    if (!vlc->len) {
+	vlc->code = prefix >> (16 - len);
+	vlc->len = len;
+    }
+}
+
+/*
+ * Build the encoding tables by running every 16-bit prefix through the
+ * same lookups that slice.c does on vlc.h, so that the two can not
+ * disagree. Escape and invalid entries are left out.
+ */
+static void vlc_init (void)
+{
+    uint32_t prefix, bit_buf;
+    const DCTtab * tab;
+    int b15, len;
+
+    for (prefix = 0; prefix < 65536; prefix++) {
+	bit_buf = prefix << 16;
+
+	vlc_set (mb_p_vlc + MB_P[UBITS (bit_buf, 5)].modes, prefix,
+		 MB_P[UBITS (bit_buf, 5)].len);
+	if (UBITS (bit_buf, 6))
+	    vlc_set (mb_b_vlc + MB_B[UBITS (bit_buf, 6)].modes, prefix,
+		     MB_B[UBITS (bit_buf, 6)].len);
+
+	if (bit_buf >= 0x20000000)
+	    vlc_set (cbp_vlc + CBP_7[UBITS (bit_buf, 7) - 16].cbp, prefix,
+		     CBP_7[UBITS (bit_buf, 7) - 16].len);
+	else if (UBITS (bit_buf, 9))
+	    vlc_set (cbp_vlc + CBP_9[UBITS (bit_buf, 9)].cbp, prefix,
+		     CBP_9[UBITS (bit_buf, 9)].len);
+
+	if (bit_buf & 0x80000000)
+	    vlc_set (mv_vlc, prefix, 1);
+	else if (bit_buf >= 0x0c000000)
+	    vlc_set (mv_vlc + MV_4[UBITS (bit_buf, 4)].delta + 1, prefix,
+		     MV_4[UBITS (bit_buf, 4)].len);
+	else if (UBITS (bit_buf, 10) >= 12)
+	    vlc_set (mv_vlc + MV_10[UBITS (bit_buf, 10)].delta + 1, prefix,
+		     MV_10[UBITS (bit_buf, 10)].len);
+
+	if (bit_buf < 0xf8000000) {
+	    vlc_set (dc_vlc[0] + DC_lum_5[UBITS (bit_buf, 5)].size, prefix,
+		     DC_lum_5[UBITS (bit_buf, 5)].len);
+	    vlc_set (dc_vlc[1] + DC_chrom_5[UBITS (bit_buf, 5)].size, prefix,
+		     DC_chrom_5[UBITS (bit_buf, 5)].len);
+	} else {
+	    vlc_set (dc_vlc[0] + DC_long[UBITS (bit_buf, 9) - 0x1e0].size,
+		     prefix, DC_long[UBITS (bit_buf, 9) - 0x1e0].len);
+	    vlc_set (dc_vlc[1] + DC_long[UBITS (bit_buf, 10) - 0x3e0].size,
+		     prefix, DC_long[UBITS (bit_buf, 10) - 0x3e0].len + 1);
+	}
+
+	for (b15 = 0; b15 < 2; b15++) {
+	    if (bit_buf >= 0x28000000 && !b15)
+		tab = DCT_B14AC_5 + (UBITS (bit_buf, 5) - 5);
+	    else if (bit_buf >= 0x04000000)
+		tab = ((b15 ? DCT_B15_8 : DCT_B14_8) +
+		       (UBITS (bit_buf, 8) - 4));
+	    else if (bit_buf >= 0x02000000)
+		tab = ((b15 ? DCT_B15_10 : DCT_B14_10) +
+		       (UBITS (bit_buf, 10) - 8));
+	    else if (bit_buf >= 0x00800000)
+		tab = DCT_13 + (UBITS (bit_buf, 13) - 16);
+	    else if (bit_buf >= 0x00200000)
+		tab = DCT_15 + (UBITS (bit_buf, 15) - 16);
+	    else
+		tab = DCT_16 + UBITS (bit_buf, 16);
+	    len = tab->len + ((bit_buf < 0x00200000) ? 16 : 0);
+	    if (tab->run == 129 && len < 16)
+		vlc_set (eob_vlc + b15, prefix, len);
+	    else if (tab->run <= 32 && tab->level <= 40)
+		vlc_set (dct_vlc[b15][tab->run] + tab->level, prefix, len);
+	}
+    }
+}
+
+static void put_bits (uint32_t value, int n)
+{
+    out_bits = (out_bits << n) | (value & ((1 << n) - 1));
+    out_count += n;
+    while (out_count >= 8) {
+	out_count -= 8;
+	putc ((int) (out_bits >> out_count) & 0xff, out_file);
+    }
+}
+
+static void put_vlc (const vlc_t * vlc)
+{
+    put_bits (vlc->code, vlc->len);
+}
+
+static void put_start_code (int code)
+{
+    if (out_count)
+	put_bits (0, 8 - out_count);
+    put_bits (0, 16);
+    put_bits (0x100 | code, 16);
+}
+
+static void put_sequence (void)
+{
+    int vbv_buffer_size, profile_level_id;
+
+    if (width <= 720 && height <= 576) {
+	vbv_buffer_size = (chroma_format == 2) ? 229 : 112;
+	profile_level_id = (chroma_format == 2) ? 0x85 : 0x48;
+    } else {
+	vbv_buffer_size = (chroma_format == 2) ? 1222 : 597;
+	profile_level_id = (chroma_format == 2) ? 0x82 : 0x44;
+    }
+    if (chroma_format == 3)
+	profile_level_id = 0x14;
+    if (mpeg1)
+	vbv_buffer_size = (width <= 352 && height <= 288) ? 20 : 112;
+
+    put_start_code (0xb3);
+    put_bits (width, 12);
+    put_bits (height, 12);
+    put_bits (1, 4);		/* aspect ratio: square pixels */
+    put_bits (3, 4);		/* 25 fps */
+    put_bits (0x3ffff, 18);	/* variable bit rate */
+    put_bits (1, 1);
+    put_bits (vbv_buffer_size, 10);
+    put_bits (0, 3);		/* constrained parameters, matrices */
+
+    if (!mpeg1) {
+	put_start_code (0xb5);
+	put_bits (1, 4);
+	put_bits (profile_level_id, 8);
+	put_bits (!(field_pictures || interlaced), 1);
+	put_bits (chroma_format, 2);
+	put_bits (0, 4);	/* size extension */
+	put_bits (0, 12);	/* bit rate extension */
+	put_bits (1, 1);
+	put_bits (vbv_buffer_size >> 10, 8);
+	put_bits (anchor_distance == 1, 1);	/* low delay */
+	put_bits (0, 7);	/* frame rate extension */
+    }
+}
+
+static void put_gop (int frame)
+{
+    put_start_code (0xb8);
+    put_bits (0, 1);
+    put_bits (frame / (25 * 3600), 5);
+    put_bits ((frame / (25 * 60)) % 60, 6);
+    put_bits (1, 1);
+    put_bits ((frame / 25) % 60, 6);
+    put_bits (frame % 25, 6);
+    put_bits (2, 2);		/* closed gop */
+}
+
+static void put_picture_header (int temporal_reference)
+{
+    int f_codes[2][2];
+
+    put_start_code (0x00);
+    put_bits (temporal_reference & 1023, 10);
+    put_bits (coding_type, 3);
+    put_bits (0xffff, 16);
+    if (coding_type != I_PICTURE)
+	put_bits (mpeg1 ? f_code : 7, 4);
+    if (coding_type == B_PICTURE)
+	put_bits (mpeg1 ? f_code : 7, 4);
+    put_bits (0, 1);
+    if (mpeg1)
+	return;
+
+    f_codes[0][0] = f_codes[0][1] = (coding_type != I_PICTURE) ? f_code : 15;
+    f_codes[1][0] = f_codes[1][1] = (coding_type == B_PICTURE) ? f_code : 15;
+    put_start_code (0xb5);
+    put_bits (8, 4);
+    put_bits (f_codes[0][0], 4);
+    put_bits (f_codes[0][1], 4);
+    put_bits (f_codes[1][0], 4);
+    put_bits (f_codes[1][1], 4);
+    put_bits (0, 2);		/* intra dc precision */
+    put_bits (picture_structure, 2);
+    put_bits (interlaced && picture_structure == FRAME, 1);
+    put_bits (frame_pred_frame_dct, 1);
+    put_bits (0, 2);		/* concealment vectors, q_scale_type */
+    put_bits (intra_vlc_format, 1);
+    put_bits (alternate_scan, 1);
+    put_bits (0, 1);		/* repeat first field */
+    put_bits (!(field_pictures || interlaced) && chroma_format == 1, 1);
+    put_bits (!(field_pictures || interlaced), 1);
+    put_bits (0, 1);
+}
+
+static int random_level (void)
+{
+    int r, level;
+
+    r = rnd () % 100;
+    if (r < 60)
+	level = 1;
+    else if (r < 80)
+	level = 2;
+    else if (r < 95)
+	level = rnd_range (3, 5);
+    else if (r < 99)
+	level = rnd_range (6, 40);
+    else
+	level = rnd_range (41, mpeg1 ? 255 : 400);
+    return (rnd () & 1) ? -level : level;
+}
+
+static void put_coefficient (int b15, int run, int level, int first)
+{
+    int abs_level = (level < 0) ? -level : level;
+    const vlc_t * vlc;
+
+    vlc = ((run < 32 && abs_level <= 40) ?
+	   dct_vlc[b15][run + 1] + abs_level : NULL);
+    if (first && run == 0 && abs_level == 1)
+	put_bits (2 | (level < 0), 2);
+    else if (vlc && vlc->len) {
+	put_vlc (vlc);
+	put_bits (level < 0, 1);
+    } else {
+	put_bits (1, 6);
+	put_bits (run, 6);
+	if (!mpeg1)
+	    put_bits (level, 12);
+	else if (abs_level < 128)
+	    put_bits (level, 8);
+	else {
+	    put_bits ((level < 0) ? 0x80 : 0, 8);
+	    put_bits (level, 8);
+	}
+    }
+}
+
+/* write count coefficients spread over the rest of the block, then EOB */
+static void put_block (int b15, int pos, int count)
+{
+    int run, max_run, first;
+
+    first = !pos;
+    for (; count; count--) {
+	max_run = 64 - pos - count;
+	run = rnd_range (0, max_run ? 2 * max_run / count : 0);
+	if (run > max_run)
+	    run = max_run;
+	put_coefficient (b15, run, random_level (), first);
+	pos += run + 1;
+	first = 0;
+    }
+    put_vlc (eob_vlc + b15);
+}
+
+static int block_count (void)
+{
+    int count;
+
+    count = rnd_range (0, 2 * density);
+    return (count > 63) ? 63 : count;
+}
+
+static void put_intra_block (int cc, int * dc_pred)
+{
+    int dc, diff, size;
+
+    dc = *dc_pred + rnd_range (-16, 16);
+    dc = (dc < 0) ? 0 : ((dc > 255) ? 255 : dc);
+    diff = dc - *dc_pred;
+    *dc_pred = dc;
+    for (size = 0; (diff < 0 ? -diff : diff) >> size; size++);
+    put_vlc (dc_vlc[!!cc] + size);
+    if (size)
+	put_bits ((diff > 0) ? diff : diff + (1 << size) - 1, size);
+    put_block (intra_vlc_format, 1, block_count ());
+}
+
+/* code a vector near the prediction, keeping the block inside [lo, hi] */
+static void put_motion (int * pred, int lo, int hi)
+{
+    int r_size = f_code - 1;
+    int range = 16 << r_size;
+    int vector, delta, code;
+
+    if (lo < -range)
+	lo = -range;
+    if (hi > range - 1)
+	hi = range - 1;
+    vector = *pred + rnd_range (-(range >> 2), range >> 2);
+    vector = (vector < lo) ? lo : ((vector > hi) ? hi : vector);
+    delta = vector - *pred;
+    if (delta < -range)
+	delta += 2 * range;
+    else if (delta >= range)
+	delta -= 2 * range;
+    *pred = vector;
+
+    if (!delta) {
+	put_vlc (mv_vlc);
+	return;
+    }
+    code = ((delta < 0) ? -delta : delta) - 1;
+    put_vlc (mv_vlc + (code >> r_size) + 1);
+    put_bits (delta < 0, 1);
+    put_bits (code, r_size);
+}
+
+static void put_vectors (int pmv[2], int x, int y)
+{
+    int field = (picture_structure != FRAME);
+    int lines = field ? coded_height >> 1 : coded_height;
+
+    if (field)
+	put_bits (rnd () & 1, 1);	/* motion vertical field select */
+    put_motion (pmv, -2 * x, 2 * (mb_width * 16 - 16 - x));
+    put_motion (pmv + 1, -2 * y, 2 * (lines - 16 - y));
+}
+
+static int macroblock_modes (void)
+{
+    static const int p_modes[] = {
+	MACROBLOCK_MOTION_FORWARD | MACROBLOCK_PATTERN,
+	MACROBLOCK_MOTION_FORWARD | MACROBLOCK_PATTERN,
+	MACROBLOCK_MOTION_FORWARD | MACROBLOCK_PATTERN,
+	MACROBLOCK_MOTION_FORWARD, MACROBLOCK_PATTERN
+    };
+    static const int b_modes[] = {
+	MACROBLOCK_MOTION_FORWARD, MACROBLOCK_MOTION_BACKWARD,
+	MACROBLOCK_MOTION_FORWARD | MACROBLOCK_MOTION_BACKWARD
+    };
+    int modes;
+
+    if (coding_type == I_PICTURE || rnd () % 100 < 5)
+	return MACROBLOCK_INTRA;
+    else if (coding_type == P_PICTURE)
+	return p_modes[rnd () % 5];
+    modes = b_modes[rnd () % 3];
+    if (rnd () & 1)
+	modes |= MACROBLOCK_PATTERN;
+    return modes;
+}
+
+static void put_macroblock (int x, int y, int pmv[2][2], int dc_pred[3])
+{
+    int modes, blocks, i, cbp, ext;
+
+    modes = macroblock_modes ();
+    blocks = 4 + (2 << (chroma_format - 1));
+    put_bits (1, 1);		/* macroblock address increment */
+    if (coding_type == I_PICTURE)
+	put_bits (1, 1);
+    else
+	put_vlc (((coding_type == P_PICTURE) ? mb_p_vlc : mb_b_vlc) + modes);
+
+    if (picture_structure != FRAME) {
+	if (!(modes & MACROBLOCK_INTRA) &&
+	    (modes & (MACROBLOCK_MOTION_FORWARD | MACROBLOCK_MOTION_BACKWARD)))
+	    put_bits (MC_FIELD, 2);
+    } else if (!frame_pred_frame_dct) {
+	if (modes & (MACROBLOCK_MOTION_FORWARD | MACROBLOCK_MOTION_BACKWARD))
+	    put_bits (MC_FRAME, 2);
+	if (modes & (MACROBLOCK_INTRA | MACROBLOCK_PATTERN))
+	    put_bits (rnd () & 1, 1);	/* dct type */
+    }
+
+    if (modes & MACROBLOCK_INTRA) {
+	memset (pmv, 0, 4 * sizeof (int));
+	for (i = 0; i < blocks; i++)
+	    put_intra_block ((i < 4) ? 0 : 1 + (i & 1),
+			     dc_pred + ((i < 4) ? 0 : 1 + (i & 1)));
+	return;
+    }
+
+    dc_pred[0] = dc_pred[1] = dc_pred[2] = 128;
+    if (modes & MACROBLOCK_MOTION_FORWARD)
+	put_vectors (pmv[0], x, y);
+    else if (coding_type == P_PICTURE)
+	pmv[0][0] = pmv[0][1] = 0;
+    if (modes & MACROBLOCK_MOTION_BACKWARD)
+	put_vectors (pmv[1], x, y);
+
+    if (modes & MACROBLOCK_PATTERN) {
+	cbp = rnd_range (1, 63);
+	ext = rnd () & ((1 << (blocks - 6)) - 1);
+	put_vlc (cbp_vlc + cbp);
+	put_bits (ext, blocks - 6);
+	for (i = 0; i < 6; i++)
+	    if (cbp & (1 << i))
+		put_block (0, 0, 1 + block_count ());
+	for (i = blocks - 7; i >= 0; i--)
+	    if (ext & (1 << i))
+		put_block (0, 0, 1 + block_count ());
+    }
+}
+
+static void put_picture (int type, int temporal_reference, int structure)
+{
+    int rows, row, col;
+    int pmv[2][2], dc_pred[3];
+
+    coding_type = type;
+    picture_structure = structure;
+    frame_pred_frame_dct = !(field_pictures || interlaced);
+    put_picture_header (temporal_reference);
+
+    rows = (structure == FRAME) ? mb_height : mb_height >> 1;
+    for (row = 0; row < rows; row++) {
+	put_start_code (row + 1);
+	put_bits (quantiser, 5);
+	put_bits (0, 1);
+	memset (pmv, 0, sizeof (pmv));
+	dc_pred[0] = dc_pred[1] = dc_pred[2] = 128;
+	for (col = 0; col < mb_width; col++)
+	    put_macroblock (16 * col, 16 * row, pmv, dc_pred);
+    }
+}
+
+static void put_frame (int type, int temporal_reference)
+{
+    if (field_pictures) {
+	put_picture (type, temporal_reference, TOP_FIELD);
+	put_picture (type, temporal_reference, BOTTOM_FIELD);
+    } else
+	put_picture (type, temporal_reference, FRAME);
+}
+
+#define TS_VIDEO_PID 0x100
+#define TS_PMT_PID 0x1000
+#define TS_PES_SIZE 2000
+
+static void put_ts_packet (int pid, int start, const uint8_t * payload,
+			   int len)
+{
+    static int continuity[3];	/* PAT, PMT, video */
+    uint8_t packet[204];
+    uint8_t * p;
+    int stuffing;
+
+    memset (packet, 0, sizeof (packet));
+    p = packet + ((ts_packet_size == 192) ? 4 : 0);
+    stuffing = 184 - len;
+    p[0] = 0x47;
+    p[1] = (start ? 0x40 : 0) | (pid >> 8);
+    p[2] = pid;
+    p[3] = ((stuffing ? 0x30 : 0x10) |
+	    (continuity[(pid == TS_PMT_PID) + 2 * (pid == TS_VIDEO_PID)]++ & 15));
+    if (stuffing) {
+	p[4] = stuffing - 1;
+	if (stuffing > 1) {
+	    p[5] = 0;
+	    memset (p + 6, 0xff, stuffing - 2);
+	}
+    }
+    memcpy (p + 4 + stuffing, payload, len);
+    fwrite (packet, ts_packet_size, 1, ts_file);
+}
+
+static void put_ts_section (int pid, uint8_t * section, int len)
+{
+    uint8_t payload[184];
+    uint32_t crc;
+    int i, j;
+
+    section[1] = 0xb0 | ((len - 3 + 4) >> 8);
+    section[2] = len - 3 + 4;
+    crc = 0xffffffff;
+    for (i = 0; i < len; i++) {
+	crc ^= (uint32_t) section[i] << 24;
+	for (j = 0; j < 8; j++)
+	    crc = (crc << 1) ^ ((crc & 0x80000000) ? 0x04c11db7 : 0);
+    }
+    for (i = 0; i < 4; i++)
+	section[len++] = crc >> (24 - 8 * i);
+    memset (payload, 0xff, sizeof (payload));
+    payload[0] = 0;		/* pointer field */
+    memcpy (payload + 1, section, len);
+    put_ts_packet (pid, 1, payload, sizeof (payload));
+}
+
+static void put_ts (FILE * es_file)
+{
+    static uint8_t pat[16] = {0x00, 0, 0, 0, 1, 0xc1, 0, 0,
+			      0, 1, 0xe0 | (TS_PMT_PID >> 8), TS_PMT_PID & 0xff};
+    static uint8_t pmt[24] = {0x02, 0, 0, 0, 1, 0xc1, 0, 0,
+			      0xe0 | (TS_VIDEO_PID >> 8), TS_VIDEO_PID & 0xff,
+			      0xf0, 0, 0x02,
+			      0xe0 | (TS_VIDEO_PID >> 8), TS_VIDEO_PID & 0xff,
+			      0xf0, 0};
+    uint8_t pes[9 + TS_PES_SIZE];
+    int len, offset;
+
+    rewind (es_file);
+    put_ts_section (0, pat, 12);
+    put_ts_section (TS_PMT_PID, pmt, 17);
+    pes[0] = pes[1] = 0;
+    pes[2] = 1;
+    pes[3] = 0xe0;
+    pes[6] = 0x80;
+    pes[7] = pes[8] = 0;
+    while ((len = fread (pes + 9, 1, TS_PES_SIZE, es_file)) > 0) {
+	pes[4] = (len + 3) >> 8;
+	pes[5] = len + 3;
+	for (offset = 0; offset < 9 + len; offset += 184)
+	    put_ts_packet (TS_VIDEO_PID, !offset, pes + offset,
+			   (9 + len - offset < 184) ? 9 + len - offset : 184);
+    }
+}
+
+static void print_usage (char ** argv)
+{
+    fprintf (stderr, "usage: %s [-h] [-1] [-s <width>x<height>] "
+	     "[-c 420|422|444] \\\n"
+	     "\t\t[-g <n>[,<m>]] [-f] [-i] [-q <qscale>] [-m <f_code>] "
+	     "\\\n"
+	     "\t\t[-d <density>] [-n <frames>] [-r <seed>] [-V] [-A] "
+	     "[-t <size>] [-o <file>]\n"
+	     "\t-h\tdisplay help\n"
+	     "\t-1\tmpeg-1 stream\n"
+	     "\t-s\tpicture size (default 720x576)\n"
+	     "\t-c\tchroma format (mpeg-2 only, default 420)\n"
+	     "\t-g\tgop length and anchor distance (default 12,3)\n"
+	     "\t-f\tfield pictures\n"
+	     "\t-i\tinterlaced frame pictures\n"
+	     "\t-q\tquantiser scale code, 1-31 (default 8)\n"
+	     "\t-m\tmotion vector f_code (default 3)\n"
+	     "\t-d\taverage coefficients per coded block (default 6)\n"
+	     "\t-n\tnumber of frames (default 50)\n"
+	     "\t-r\trandom seed\n"
+	     "\t-V\tuse intra vlc format 1\n"
+	     "\t-A\tuse alternate scan\n"
+	     "\t-t\twrap in a transport stream of 188, 192 or 204 byte "
+	     "packets\n"
+	     "\t-o\toutput file (default stdout)\n", argv[0]);
+
+    exit (1);
+}
+
+static void handle_args (int argc, char ** argv)
+{
+    int c;
+    char * s;
+
+    out_file = stdout;
+    while ((c = getopt (argc, argv, "h1s:c:g:fiq:m:d:n:r:VAt:o:")) != -1)
+	switch (c) {
+	case '1':
+	    mpeg1 = 1;
+	    break;
+
+	case 's':
+	    width = strtol (optarg, &s, 0);
+	    if (*s != 'x')
+		print_usage (argv);
+	    height = strtol (s + 1, &s, 0);
+	    if (*s || width <= 0 || width > 4095 || height <= 0 ||
+		height > 2800)
+		print_usage (argv);
+	    break;
+
+	case 'c':
+	    c = strtol (optarg, &s, 0);
+	    chroma_format = (c == 420) ? 1 : (c == 422) ? 2 : (c == 444) ? 3 : 0;
+	    if (*s || !chroma_format)
+		print_usage (argv);
+	    break;
+
+	case 'g':
+	    gop_size = strtol (optarg, &s, 0);
+	    if (*s == ',')
+		anchor_distance = strtol (s + 1, &s, 0);
+	    if (*s || gop_size < 1 || anchor_distance < 1)
+		print_usage (argv);
+	    break;
+
+	case 'f':
+	    field_pictures = 1;
+	    break;
+
+	case 'i':
+	    interlaced = 1;
+	    break;
+
+	case 'q':
+	    quantiser = strtol (optarg, &s, 0);
+	    if (*s || quantiser < 1 || quantiser > 31)
+		print_usage (argv);
+	    break;
+
+	case 'm':
+	    f_code = strtol (optarg, &s, 0);
+	    if (*s || f_code < 1 || f_code > 9)
+		print_usage (argv);
+	    break;
+
+	case 'd':
+	    density = strtol (optarg, &s, 0);
+	    if (*s || density < 0 || density > 63)
+		print_usage (argv);
+	    break;
+
+	case 'n':
+	    frames = strtol (optarg, &s, 0);
+	    if (*s || frames < 1)
+		print_usage (argv);
+	    break;
+
+	case 'r':
+	    seed = strtoul (optarg, &s, 0);
+	    if (*s || !seed)
+		print_usage (argv);
+	    break;
+
+	case 'V':
+	    intra_vlc_format = 1;
+	    break;
+
+	case 'A':
+	    alternate_scan = 1;
+	    break;
+
+	case 't':
+	    ts_packet_size = strtol (optarg, &s, 0);
+	    if (*s || (ts_packet_size != 188 && ts_packet_size != 192 &&
+		       ts_packet_size != 204))
+		print_usage (argv);
+	    break;
+
+	case 'o':
+	    out_file = fopen (optarg, "wb");
+	    if (!out_file) {
+		fprintf (stderr, "%s - could not open file %s\n",
+			 strerror (errno), optarg);
+		exit (1);
+	    }
+	    break;
+
+	default:
+	    print_usage (argv);
+	}
+
+    if (optind < argc)
+	print_usage (argv);
+    if (mpeg1 && (chroma_format != 1 || field_pictures || interlaced ||
+		  intra_vlc_format || alternate_scan || f_code > 7)) {
+	fprintf (stderr, "option not available in mpeg-1 streams\n");
+	exit (1);
+    }
+    if (field_pictures && interlaced)
+	print_usage (argv);
+    if (ts_packet_size) {
+	ts_file = out_file;
+	out_file = tmpfile ();
+	if (!out_file) {
+	    fprintf (stderr, "%s - could not create temporary file\n",
+		     strerror (errno));
+	    exit (1);
+	}
+    }
+}
+
+int main (int argc, char ** argv)
+{
+    int gop, n, prev, next, b;
+
+    handle_args (argc, argv);
+    vlc_init ();
+
+    mb_width = (width + 15) >> 4;
+    coded_height = (field_pictures || interlaced) ?
+	(height + 31) & ~31 : (height + 15) & ~15;
+    mb_height = coded_height >> 4;
+
+    for (gop = 0; gop < frames; gop += gop_size) {
+	n = (frames - gop < gop_size) ? frames - gop : gop_size;
+	put_sequence ();
+	put_gop (gop);
+	put_frame (I_PICTURE, 0);
+	for (prev = 0; prev < n - 1; prev = next) {
+	    next = (prev + anchor_distance < n) ? prev + anchor_distance : n - 1;
+	    put_frame (P_PICTURE, next);
+	    for (b = prev + 1; b < next; b++)
+		put_frame (B_PICTURE, b);
+	}
+    }
+    put_start_code (0xb7);
+
+    if (ts_packet_size) {
+	put_ts (out_file);
+	fclose (out_file);
+	out_file = ts_file;
+    }
+    if (fclose (out_file)) {
+	fprintf (stderr, "%s - could not write output\n", strerror (errno));
+	exit (1);
+    }
+    return 0;
+}
@@ -0,0 +1,281 @@
+/*
+ * slices.c
+ * Copyright (C) 2000-2003 Michel Lespinasse <walken@zoy.org>
+ * Copyright (C) 1999-2000 Aaron Holtzman <aholtzma@ess.engr.uvic.ca>
+ *
+ * This file is part of mpeg2dec, a free MPEG-2 video stream decoder.
+ * See http://libmpeg2.sourceforge.net/ for updates.
+ *
+ * mpeg2dec is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpeg2dec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpeg2dec; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Time the decoding of whole elementary streams from memory and report
+ * it per macroblock, so that changes to the slice engine can be compared
+ * across streams of different sizes. Nothing is output or converted.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <sys/time.h>
+
+#include "mpeg2.h"
+
+#define MAX_SIZE (64 << 20)
+#define ARENA_SIZE (64 << 20)
+
+static int runs = 5;
+static int disable_accel = 0;
+static int border = 0;
+static int policy = 0;
+static int tiled = 0;
+static int use_arena = 0;
+
+/* a bump allocator, emptied in one go after each decode */
+typedef struct {
+    uint8_t * base;
+    unsigned long used;
+} arena_t;
+
+static void * arena_alloc (void * arg, unsigned size, mpeg2_alloc_t reason)
+{
+    arena_t * arena = (arena_t *) arg;
+    void * buf;
+
+    size = (size + 63) & ~63;
+    if (arena->used + size > ARENA_SIZE)
+	return NULL;
+    buf = arena->base + arena->used;
+    arena->used += size;
+    return buf;
+}
+
+static double usec (void)
+{
+    struct timeval tv;
+
+    gettimeofday (&tv, NULL);
+    return tv.tv_sec * 1000000.0 + tv.tv_usec;
+}
+
+#ifdef ARCH_X86
+static uint64_t rdtsc (void)
+{
+    uint32_t lo, hi;
+
+    __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t) hi << 32) | lo;
+}
+#endif
+
+/* decode the whole stream, returning the number of macroblocks */
+static uint64_t decode (uint8_t * buf, long size, arena_t * arena)
+{
+    mpeg2dec_t * decoder;
+    mpeg2_allocator_t allocator;
+    const mpeg2_info_t * info;
+    mpeg2_state_t state;
+    uint64_t macroblocks;
+
+    if (use_arena) {
+	allocator.alloc_func = arena_alloc;
+	allocator.free_func = NULL;
+	allocator.arg = arena;
+	decoder = mpeg2_init_with_allocator (&allocator);
+    } else
+	decoder = mpeg2_init ();
+    if (decoder == NULL) {
+	fprintf (stderr, "Could not allocate a decoder object.\n");
+	exit (1);
+    }
+    mpeg2_border (decoder, border);
+    mpeg2_alloc_policy (decoder, policy);
+    mpeg2_tiled (decoder, tiled);
+    info = mpeg2_info (decoder);
+    mpeg2_buffer (decoder, buf, buf + size);
+    macroblocks = 0;
+    do {
+	state = mpeg2_parse (decoder);
+	if (state == STATE_PICTURE)
+	    macroblocks += ((info->sequence->width >> 4) *
+			    (info->sequence->height >> 4));
+    } while (state != STATE_BUFFER);
+    mpeg2_close (decoder);
+    arena->used = 0;
+    return macroblocks;
+}
+
+static void bench (const char * name, const char * sep)
+{
+    uint8_t * buf;
+    FILE * file;
+    long size;
+    uint64_t macroblocks;
+    uint8_t * mem;
+    arena_t arena;
+    double ns, cycles;
+    int run;
+
+    file = fopen (name, "rb");
+    if (file == NULL) {
+	fprintf (stderr, "%s - could not open file %s\n", strerror (errno),
+		 name);
+	exit (1);
+    }
+    fseek (file, 0, SEEK_END);
+    size = ftell (file);
+    fseek (file, 0, SEEK_SET);
+    if (size <= 0 || size > MAX_SIZE) {
+	fprintf (stderr, "%s: empty or larger than %d bytes\n", name,
+		 MAX_SIZE);
+	exit (1);
+    }
+    buf = (uint8_t *) malloc (size);
+    if (fread (buf, size, 1, file) != 1) {
+	fprintf (stderr, "%s - could not read file %s\n", strerror (errno),
+		 name);
+	exit (1);
+    }
+    fclose (file);
+    mem = NULL;
+    if (use_arena) {
+	mem = (uint8_t *) malloc (ARENA_SIZE + 63);
+	if (mem == NULL) {
+	    fprintf (stderr, "could not allocate the arena\n");
+	    exit (1);
+	}
+    }
+    arena.base = (uint8_t *) (((uintptr_t) mem + 63) & ~(uintptr_t) 63);
+    arena.used = 0;
+
+    /* the first run warms the caches and counts the macroblocks */
+    macroblocks = decode (buf, size, &arena);
+    if (!macroblocks) {
+	fprintf (stderr, "%s: no pictures\n", name);
+	exit (1);
+    }
+    ns = cycles = -1;
+    for (run = 0; run < runs; run++) {
+	double start, t, c = -1;
+#ifdef ARCH_X86
+	uint64_t tsc;
+
+	tsc = rdtsc ();
+#endif
+	start = usec ();
+	decode (buf, size, &arena);
+	t = (usec () - start) * 1000.0 / macroblocks;
+#ifdef ARCH_X86
+	c = (double) (rdtsc () - tsc) / macroblocks;
+#endif
+	if (ns < 0 || t < ns)
+	    ns = t;
+	if (cycles < 0 || c < cycles)
+	    cycles = c;
+    }
+    free (buf);
+    free (mem);
+
+    printf (" {\"stream\": \"%s\", \"macroblocks\": %" PRIu64 ", "
+	    "\"ns\": %.1f, ", name, macroblocks, ns);
+    if (cycles >= 0)
+	printf ("\"cycles\": %.0f}%s\n", cycles, sep);
+    else
+	printf ("\"cycles\": null}%s\n", sep);
+}
+
+static void print_usage (char ** argv)
+{
+    fprintf (stderr, "usage: %s [-h] [-c] [-b <border>] [-p <policy>] [-t] "
+	     "[-a] [-n <runs>] <stream> ...\n"
+	     "\t-h\tdisplay help\n"
+	     "\t-c\tuse c implementation, disables all accelerations\n"
+	     "\t-b\tdecode into frame buffers with a border of 16 or 32\n"
+	     "\t-p\tallocation policy: 1 huge pages, 2 numa local, 3 both\n"
+	     "\t-t\tdecode into tiled reference frames\n"
+	     "\t-a\tallocate from an arena emptied after each run\n"
+	     "\t-n\tnumber of timed runs, the best one is kept "
+	     "(default 5)\n", argv[0]);
+
+    exit (1);
+}
+
+static void handle_args (int argc, char ** argv)
+{
+    int c;
+    char * s;
+
+    while ((c = getopt (argc, argv, "hcb:p:tan:")) != -1)
+	switch (c) {
+	case 'c':
+	    disable_accel = 1;
+	    break;
+
+	case 'b':
+	    border = strtol (optarg, &s, 0);
+	    if (*s || border < 0)
+		print_usage (argv);
+	    break;
+
+	case 'p':
+	    policy = strtol (optarg, &s, 0);
+	    if (*s || policy < 0)
+		print_usage (argv);
+	    break;
+
+	case 't':
+	    tiled = 1;
+	    break;
+
+	case 'a':
+	    use_arena = 1;
+	    break;
+
+	case 'n':
+	    runs = strtol (optarg, &s, 0);
+	    if (*s || runs < 1)
+		print_usage (argv);
+	    break;
+
+	default:
+	    print_usage (argv);
+	}
+
+    if (optind == argc)
+	print_usage (argv);
+}
+
+int main (int argc, char ** argv)
+{
+    uint32_t accel;
+
+    handle_args (argc, argv);
+    accel = mpeg2_accel (disable_accel ? 0 : MPEG2_ACCEL_DETECT);
+
+    printf ("{\"flags\": %u, \"border\": %d, \"policy\": %d, "
+	    "\"tiled\": %d, \"arena\": %d, \"slices\": [\n",
+	    (unsigned int) accel, border, policy, tiled, use_arena);
+    for (; optind < argc; optind++)
+	bench (argv[optind], (optind == argc - 1) ? "" : ",");
+    printf ("]}\n");
+
+    return 0;
+}
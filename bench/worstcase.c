@@ -0,0 +1,404 @@
+/*
+ * worstcase.c
+ * Copyright (C) 2000-2003 Michel Lespinasse <walken@zoy.org>
+ * Copyright (C) 1999-2000 Aaron Holtzman <aholtzma@ess.engr.uvic.ca>
+ *
+ * This file is part of mpeg2dec, a free MPEG-2 video stream decoder.
+ * See http://libmpeg2.sourceforge.net/ for updates.
+ *
+ * mpeg2dec is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpeg2dec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpeg2dec; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Search for the inputs the decoder is slowest on. Streams are mutated
+ * the way corrupted broadcast feeds are, with random byte corruption as
+ * in corrupt_mpeg2 plus repeated chunks and runs of macroblock escapes,
+ * and the mutants that take the longest to decode per input byte or
+ * per picture are kept in the corpus to be mutated further.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <sys/time.h>
+
+#include "mpeg2.h"
+
+#define CORPUS_SIZE 16
+#define MAX_SIZE (16 << 20)
+
+typedef struct {
+    uint8_t * buf;
+    int size;
+    double per_byte;		/* decode time per input byte, in ns */
+    double per_picture;		/* longest picture decode, in us */
+} input_t;
+
+static input_t corpus[CORPUS_SIZE];
+static int corpus_count = 0;
+static double seed_per_byte = 0, seed_per_picture = 0;
+static double worst_per_byte, worst_per_picture;
+static int iterations = 1000;
+static const char * prefix = "worst";
+static uint32_t seed = 1;
+
+static uint32_t rnd (void)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+static int rnd_range (int lo, int hi)
+{
+    return lo + (int) (rnd () % (uint32_t) (hi - lo + 1));
+}
+
+static double usec (void)
+{
+    struct timeval tv;
+
+    gettimeofday (&tv, NULL);
+    return tv.tv_sec * 1000000.0 + tv.tv_usec;
+}
+
+static void decode (input_t * input)
+{
+    mpeg2dec_t * decoder;
+    mpeg2_state_t state;
+    double start, last, now;
+
+    decoder = mpeg2_init ();
+    if (decoder == NULL) {
+	fprintf (stderr, "Could not allocate a decoder object.\n");
+	exit (1);
+    }
+    mpeg2_buffer (decoder, input->buf, input->buf + input->size);
+    input->per_picture = 0;
+    start = last = usec ();
+    do {
+	state = mpeg2_parse (decoder);
+	if (state == STATE_SLICE || state == STATE_END ||
+	    state == STATE_INVALID_END) {
+	    now = usec ();
+	    if (now - last > input->per_picture)
+		input->per_picture = now - last;
+	    last = now;
+	}
+    } while (state != STATE_BUFFER);
+    now = usec ();
+    if (now - last > input->per_picture)
+	input->per_picture = now - last;
+    input->per_byte = (now - start) * 1000 / input->size;
+    mpeg2_close (decoder);
+}
+
+/* offset of the first start code at or after pos, or size */
+static int next_start_code (const input_t * input, int pos)
+{
+    for (; pos + 3 < input->size; pos++)
+	if (!input->buf[pos] && !input->buf[pos + 1] &&
+	    input->buf[pos + 2] == 1)
+	    return pos;
+    return input->size;
+}
+
+static int in_start_code (const input_t * input, int pos)
+{
+    int i;
+
+    for (i = (pos < 3) ? 0 : pos - 3; i <= pos && i + 3 < input->size; i++)
+	if (!input->buf[i] && !input->buf[i + 1] && input->buf[i + 2] == 1)
+	    return 1;
+    return 0;
+}
+
+static void insert (input_t * input, int pos, const uint8_t * buf, int size)
+{
+    if (input->size + size > MAX_SIZE)
+	return;
+    input->buf = (uint8_t *) realloc (input->buf, input->size + size);
+    memmove (input->buf + pos + size, input->buf + pos, input->size - pos);
+    memcpy (input->buf + pos, buf, size);
+    input->size += size;
+}
+
+/* flip or overwrite a few bytes, leaving start codes alone */
+static void mutate_bytes (input_t * input, int overwrite)
+{
+    int n, pos;
+
+    for (n = rnd_range (1, 16); n; n--) {
+	pos = rnd_range (0, input->size - 1);
+	if (in_start_code (input, pos))
+	    continue;
+	if (overwrite)
+	    input->buf[pos] = rnd ();
+	else
+	    input->buf[pos] ^= 1 << rnd_range (0, 7);
+    }
+}
+
+/* repeat one chunk, as feeds that resend slices do */
+static void mutate_repeat (input_t * input)
+{
+    uint8_t * chunk;
+    int start, end, n;
+
+    start = next_start_code (input, rnd_range (0, input->size - 1));
+    if (start == input->size)
+	return;
+    end = next_start_code (input, start + 3);
+    chunk = (uint8_t *) malloc (end - start);
+    memcpy (chunk, input->buf + start, end - start);
+    for (n = rnd_range (1, 8); n; n--)
+	insert (input, end, chunk, end - start);
+    free (chunk);
+}
+
+/* insert a multiple of 8 macroblock escapes, so the data stays aligned */
+static void mutate_escapes (input_t * input)
+{
+    static const uint8_t escapes[11] = {
+	0x01, 0x00, 0x20, 0x04, 0x00, 0x80, 0x10, 0x02, 0x00, 0x40, 0x08
+    };
+    uint8_t * run;
+    int pos, n, i;
+
+    pos = rnd_range (0, input->size - 1);
+    if (in_start_code (input, pos))
+	return;
+    n = rnd_range (1, 64);
+    run = (uint8_t *) malloc (11 * n);
+    for (i = 0; i < n; i++)
+	memcpy (run + 11 * i, escapes, 11);
+    insert (input, pos, run, 11 * n);
+    free (run);
+}
+
+/* splice in a piece of another corpus entry */
+static void mutate_splice (input_t * input)
+{
+    const input_t * other;
+    int start, end, pos;
+
+    other = corpus + rnd_range (0, corpus_count - 1);
+    start = next_start_code (other, rnd_range (0, other->size - 1));
+    if (start == other->size)
+	return;
+    end = next_start_code (other, rnd_range (start, other->size - 1) + 3);
+    pos = next_start_code (input, rnd_range (0, input->size - 1));
+    if (end > start)
+	insert (input, pos, other->buf + start, end - start);
+}
+
+static void mutate (input_t * input, const input_t * parent)
+{
+    int n;
+
+    input->size = parent->size;
+    input->buf = (uint8_t *) malloc (input->size);
+    memcpy (input->buf, parent->buf, input->size);
+    for (n = rnd_range (1, 4); n; n--)
+	switch (rnd_range (0, 4)) {
+	case 0:
+	    mutate_bytes (input, 0);
+	    break;
+	case 1:
+	    mutate_bytes (input, 1);
+	    break;
+	case 2:
+	    mutate_repeat (input);
+	    break;
+	case 3:
+	    mutate_escapes (input);
+	    break;
+	case 4:
+	    mutate_splice (input);
+	    break;
+	}
+}
+
+static void save (const input_t * input, const char * what)
+{
+    char name[1024];
+    FILE * file;
+
+    snprintf (name, sizeof (name), "%s-%s.mpg", prefix, what);
+    file = fopen (name, "wb");
+    if (file == NULL || fwrite (input->buf, input->size, 1, file) != 1 ||
+	fclose (file)) {
+	fprintf (stderr, "%s - could not write file %s\n", strerror (errno),
+		 name);
+	exit (1);
+    }
+}
+
+/*
+ * Save the inputs that set a new record, and keep the slowest ones per
+ * byte in the corpus along with the one holding the per picture record.
+ */
+static void keep (input_t * input, int iteration)
+{
+    int i, weakest, record;
+
+    record = 0;
+    if (input->per_byte > worst_per_byte) {
+	worst_per_byte = input->per_byte;
+	save (input, "byte");
+	printf ("%d: %.1f ns/byte (%.1fx)\n", iteration, input->per_byte,
+		input->per_byte / seed_per_byte);
+    }
+    if (input->per_picture > worst_per_picture) {
+	worst_per_picture = input->per_picture;
+	save (input, "picture");
+	printf ("%d: %.0f us/picture (%.1fx)\n", iteration,
+		input->per_picture, input->per_picture / seed_per_picture);
+	record = 1;
+    }
+
+    weakest = 0;
+    for (i = 1; i < corpus_count; i++)
+	if (corpus[i].per_byte < corpus[weakest].per_byte)
+	    weakest = i;
+    if (input->per_byte > corpus[weakest].per_byte || record) {
+	free (corpus[weakest].buf);
+	corpus[weakest] = *input;
+    } else
+	free (input->buf);
+}
+
+static void load (const char * name)
+{
+    input_t * input;
+    FILE * file;
+    long size;
+
+    if (corpus_count == CORPUS_SIZE) {
+	fprintf (stderr, "at most %d streams\n", CORPUS_SIZE);
+	exit (1);
+    }
+    file = fopen (name, "rb");
+    if (file == NULL) {
+	fprintf (stderr, "%s - could not open file %s\n", strerror (errno),
+		 name);
+	exit (1);
+    }
+    fseek (file, 0, SEEK_END);
+    size = ftell (file);
+    fseek (file, 0, SEEK_SET);
+    if (size <= 0 || size > MAX_SIZE) {
+	fprintf (stderr, "%s: empty or larger than %d bytes\n", name,
+		 MAX_SIZE);
+	exit (1);
+    }
+    input = corpus + corpus_count++;
+    input->size = size;
+    input->buf = (uint8_t *) malloc (size);
+    if (fread (input->buf, size, 1, file) != 1) {
+	fprintf (stderr, "%s - could not read file %s\n", strerror (errno),
+		 name);
+	exit (1);
+    }
+    fclose (file);
+    decode (input);
+    if (input->per_byte > seed_per_byte)
+	worst_per_byte = seed_per_byte = input->per_byte;
+    if (input->per_picture > seed_per_picture)
+	worst_per_picture = seed_per_picture = input->per_picture;
+    printf ("%s: %.1f ns/byte, %.0f us/picture\n", name, input->per_byte,
+	    input->per_picture);
+}
+
+static void print_usage (char ** argv)
+{
+    fprintf (stderr, "usage: %s [-h] [-n <iterations>] [-r <seed>] "
+	     "[-o <prefix>] <stream> ...\n"
+	     "\t-h\tdisplay help\n"
+	     "\t-n\tnumber of mutants to try (default 1000)\n"
+	     "\t-r\trandom seed\n"
+	     "\t-o\tprefix of the kept inputs (default worst)\n", argv[0]);
+
+    exit (1);
+}
+
+static void handle_args (int argc, char ** argv)
+{
+    int c;
+    char * s;
+
+    while ((c = getopt (argc, argv, "hn:r:o:")) != -1)
+	switch (c) {
+	case 'n':
+	    iterations = strtol (optarg, &s, 0);
+	    if (*s || iterations < 0)
+		print_usage (argv);
+	    break;
+
+	case 'r':
+	    seed = strtoul (optarg, &s, 0);
+	    if (*s || !seed)
+		print_usage (argv);
+	    break;
+
+	case 'o':
+	    prefix = optarg;
+	    break;
+
+	default:
+	    print_usage (argv);
+	}
+
+    if (optind == argc)
+	print_usage (argv);
+    while (optind < argc)
+	load (argv[optind++]);
+}
+
+int main (int argc, char ** argv)
+{
+    input_t input;
+    int i;
+
+    handle_args (argc, argv);
+
+    for (i = 1; i <= iterations; i++) {
+	mutate (&input, corpus + rnd_range (0, corpus_count - 1));
+	decode (&input);
+	if (input.per_byte > worst_per_byte ||
+	    input.per_picture > worst_per_picture) {
+	    /* rule out timing noise before keeping it */
+	    input_t again = input;
+
+	    decode (&again);
+	    if (again.per_byte < input.per_byte)
+		input.per_byte = again.per_byte;
+	    if (again.per_picture < input.per_picture)
+		input.per_picture = again.per_picture;
+	}
+	keep (&input, i);
+    }
+
+    printf ("worst: %.1f ns/byte (%.1fx), %.0f us/picture (%.1fx)\n",
+	    worst_per_byte, worst_per_byte / seed_per_byte,
+	    worst_per_picture, worst_per_picture / seed_per_picture);
+    return 0;
+}
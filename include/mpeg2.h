@@ -88,6 +88,8 @@ typedef struct mpeg2_gop_s {
 #define PIC_FLAG_SKIP 64
 #define PIC_FLAG_TAGS 128
 #define PIC_FLAG_REPEAT_FIRST_FIELD 256
+#define PIC_FLAG_PTS 512
+#define PIC_FLAG_DTS 1024
 #define PIC_MASK_COMPOSITE_DISPLAY 0xfffff000
 
 typedef struct mpeg2_picture_s {
@@ -98,6 +100,7 @@ typedef struct mpeg2_picture_s {
     struct {
 	int x, y;
     } display_offset[3];
+    int64_t pts, dts;
 } mpeg2_picture_t;
 
 typedef struct mpeg2_fbuf_s {
@@ -119,6 +122,24 @@ typedef struct mpeg2_info_s {
     unsigned int user_data_len;
 } mpeg2_info_t;
 
+#define MPEG2_STATS_NANOSECONDS 1
+
+/*
+ * Times are in cpu cycles, or in nanoseconds if MPEG2_STATS_NANOSECONDS
+ * is set. slice_time includes the idct, mc and convert times. The idct
+ * counts are by shape of the coded coefficients: dc only, first row
+ * only, top-left 4x4 only, and other. The mc counts are indexed as the
+ * o, x, y, xy functions at width 16 followed by the same at width 8.
+ */
+typedef struct mpeg2_stats_s {
+    uint32_t flags;
+    uint64_t chunk_time, chunk_bytes;
+    uint64_t slice_time, slices;
+    uint64_t idct_time, idct_intra[4], idct_non_intra[4];
+    uint64_t mc_time, mc_put[8], mc_avg[8];
+    uint64_t convert_time, convert_calls;
+} mpeg2_stats_t;
+
 typedef struct mpeg2dec_s mpeg2dec_t;
 
 typedef enum {
@@ -156,6 +177,8 @@ int mpeg2_convert (mpeg2dec_t * mpeg2dec, mpeg2_convert_t convert, void * arg);
 int mpeg2_stride (mpeg2dec_t * mpeg2dec, int stride);
 void mpeg2_set_buf (mpeg2dec_t * mpeg2dec, uint8_t * buf[3], void * id);
 void mpeg2_custom_fbuf (mpeg2dec_t * mpeg2dec, int custom_fbuf);
+int mpeg2_border (mpeg2dec_t * mpeg2dec, int border);
+int mpeg2_tiled (mpeg2dec_t * mpeg2dec, int tiled);
 
 #define MPEG2_ACCEL_X86_MMX 1
 #define MPEG2_ACCEL_X86_3DNOW 2
@@ -184,6 +207,9 @@ void mpeg2_skip (mpeg2dec_t * mpeg2dec, int skip);
 void mpeg2_slice_region (mpeg2dec_t * mpeg2dec, int start, int end);
 
 void mpeg2_tag_picture (mpeg2dec_t * mpeg2dec, uint32_t tag, uint32_t tag2);
+void mpeg2_tag_timestamps (mpeg2dec_t * mpeg2dec, int64_t pts, int64_t dts);
+
+const mpeg2_stats_t * mpeg2_get_stats (const mpeg2dec_t * mpeg2dec);
 
 int mpeg2_guess_aspect (const mpeg2_sequence_t * sequence,
 			unsigned int * pixel_width,
@@ -194,14 +220,51 @@ typedef enum {
     MPEG2_ALLOC_CHUNK = 1,
     MPEG2_ALLOC_YUV = 2,
     MPEG2_ALLOC_CONVERT_ID = 3,
-    MPEG2_ALLOC_CONVERTED = 4
+    MPEG2_ALLOC_CONVERTED = 4,
+    /* only in mpeg2_memory_t, the malloc hook sees these as YUV */
+    MPEG2_ALLOC_YUV_REFERENCE = 5,
+    MPEG2_ALLOC_YUV_SCRATCH = 6
 } mpeg2_alloc_t;
+#define MPEG2_ALLOC_REASONS 7
+
+/*
+ * Bytes allocated by one decoder, as requested from the malloc hook or
+ * from malloc, by reason. The peak of each reason is tracked on its own,
+ * total_peak is the largest total reached at any one time. untracked
+ * counts the buffers left out of these figures, which only happens when
+ * a decoder has more live buffers than libmpeg2 expects.
+ */
+typedef struct mpeg2_memory_s {
+    unsigned long in_use[MPEG2_ALLOC_REASONS];
+    unsigned long peak[MPEG2_ALLOC_REASONS];
+    unsigned long total, total_peak;
+    unsigned long untracked;
+} mpeg2_memory_t;
 
 void * mpeg2_malloc (unsigned size, mpeg2_alloc_t reason);
 void mpeg2_free (void * buf);
 void mpeg2_malloc_hooks (void * malloc (unsigned, mpeg2_alloc_t),
 			 int free (void *));
 
+#define MPEG2_POLICY_HUGEPAGES 1
+#define MPEG2_POLICY_NUMA_LOCAL 2
+
+int mpeg2_alloc_policy (mpeg2dec_t * mpeg2dec, int policy);
+
+/*
+ * An allocator for the buffers of one decoder, instead of the hooks.
+ * Buffers must be aligned on 64 bytes. When alloc_func returns NULL
+ * libmpeg2 allocates the buffer itself; free_func may be NULL.
+ */
+typedef struct mpeg2_allocator_s {
+    void * (* alloc_func) (void * arg, unsigned size, mpeg2_alloc_t reason);
+    void (* free_func) (void * arg, void * buf);
+    void * arg;
+} mpeg2_allocator_t;
+
+mpeg2dec_t * mpeg2_init_with_allocator (const mpeg2_allocator_t * allocator);
+const mpeg2_memory_t * mpeg2_memory_usage (const mpeg2dec_t * mpeg2dec);
+
 /* Ends C function definitions when using C++ */
 #ifdef __cplusplus
 }
@@ -0,0 +1,67 @@
+/*
+ * vo_shm.h
+ * Copyright (C) 2000-2003 Michel Lespinasse <walken@zoy.org>
+ * Copyright (C) 1999-2000 Aaron Holtzman <aholtzma@ess.engr.uvic.ca>
+ *
+ * This file is part of mpeg2dec, a free MPEG-2 video stream decoder.
+ * See http://libmpeg2.sourceforge.net/ for updates.
+ *
+ * mpeg2dec is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpeg2dec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpeg2dec; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef LIBMPEG2_VO_SHM_H
+#define LIBMPEG2_VO_SHM_H
+
+/*
+ * Layout of the POSIX shared memory object written by the shm output
+ * driver, named by $MPEG2DEC_SHM (default VO_SHM_NAME). libmpeg2
+ * decodes straight into its slots, each holding one planar YUV frame.
+ *
+ * The consumer maps the object, checks magic, sets consumer to 1 and
+ * released to seq, then for frame n = released, released + 1, ...:
+ * waits until seq > n (a futex wait on seq, on Linux), reads the frame
+ * in slot ring[n % VO_SHM_RING], and sets released to n + 1 followed by
+ * a futex wake on released. While a consumer is attached the decoder
+ * never reuses a slot it has not released, unless it stalls for more
+ * than a second. eof is set after the last frame. When the picture
+ * size changes the object is recreated and magic cleared in the old one.
+ */
+
+#define VO_SHM_NAME "/mpeg2dec"
+#define VO_SHM_MAGIC 0x6d327368
+#define VO_SHM_SLOTS 8
+#define VO_SHM_RING 16
+
+typedef struct {
+    volatile uint32_t magic;
+    uint32_t size;		/* of the whole object */
+    uint32_t width, height;
+    uint32_t chroma_width, chroma_height;
+    uint32_t nb_slots;
+    uint32_t slot_offset;	/* of the first slot */
+    uint32_t slot_size;
+    uint32_t plane_offset[3];	/* of Y, U and V in a slot */
+
+    /* written by the decoder */
+    volatile uint32_t seq;	/* number of frames published */
+    volatile uint32_t eof;
+    volatile uint32_t ring[VO_SHM_RING];
+
+    /* written by the consumer */
+    volatile uint32_t consumer;
+    volatile uint32_t released;	/* number of frames it is done with */
+} vo_shm_header_t;
+
+#endif /* LIBMPEG2_VO_SHM_H */
@@ -21,14 +21,57 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include "config.h"
+
+#include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 #include <inttypes.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_SYS_SYSCALL_H
+#include <sys/syscall.h>
+#endif
 
 #include "mpeg2.h"
+#include "attributes.h"
+#include "mpeg2_internal.h"
+
+#if defined (HAVE_MADVISE) && defined (MADV_HUGEPAGE) && \
+    defined (MAP_ANONYMOUS)
+#define POLICY_HUGEPAGES MPEG2_POLICY_HUGEPAGES
+#else
+#define POLICY_HUGEPAGES 0
+#endif
+#if defined (HAVE_UNISTD_H) && defined (SYS_getcpu) && defined (SYS_mbind)
+#define POLICY_NUMA_LOCAL MPEG2_POLICY_NUMA_LOCAL
+#else
+#define POLICY_NUMA_LOCAL 0
+#endif
+
+#define HUGE_PAGE_SIZE (2 << 20)
 
 static void * (* malloc_hook) (unsigned size, mpeg2_alloc_t reason) = NULL;
 static int (* free_hook) (void * buf) = NULL;
 
+static void * aligned_malloc (unsigned long size, unsigned long align)
+{
+    char * buf;
+    char * align_buf;
+
+    buf = (char *) malloc (size + align - 1 + sizeof (void **));
+    if (buf == NULL)
+	return NULL;
+    align_buf = buf + align - 1 + sizeof (void **);
+    align_buf -= (long)align_buf & (align - 1);
+    *(((void **)align_buf) - 1) = buf;
+    return align_buf;
+}
+
 void * mpeg2_malloc (unsigned size, mpeg2_alloc_t reason)
 {
     char * buf;
@@ -39,18 +82,257 @@ void * mpeg2_malloc (unsigned size, mpeg2_alloc_t reason)
 	    return buf;
     }
 
-    if (size) {
-	buf = (char *) malloc (size + 63 + sizeof (void **));
+    if (size)
+	return aligned_malloc (size, 64);
+    return NULL;
+}
+
+#if POLICY_NUMA_LOCAL
+/* prefer the node of the cpu we run on, moving pages already touched */
+static void bind_local (void * buf, unsigned long length)
+{
+    unsigned int cpu, node;
+    unsigned long mask;
+
+    if (syscall (SYS_getcpu, &cpu, &node, NULL) ||
+	node >= 8 * sizeof (mask))
+	return;
+    mask = 1UL << node;
+    /* MPOL_PREFERRED with MPOL_MF_MOVE, failures are not fatal */
+    syscall (SYS_mbind, buf, length, 1, &mask, 8 * sizeof (mask) + 1, 2);
+}
+#endif
+
+#if POLICY_HUGEPAGES
+/*
+ * Huge page buffers are mapped on their own, with the mapping trimmed
+ * to a 2 MiB aligned start and to the pages the buffer uses, so that
+ * the alignment costs no memory. The page before the buffer records the
+ * mapping, after a NULL in place of the pointer aligned_malloc stores.
+ */
+static void * huge_malloc (unsigned long length, unsigned long page)
+{
+    char * map;
+    char * buf;
+    unsigned long map_length, head;
+
+    map_length = page + length + HUGE_PAGE_SIZE;
+    map = (char *) mmap (NULL, map_length, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED)
+	return NULL;
+    buf = map + page + HUGE_PAGE_SIZE - 1;
+    buf -= (unsigned long)buf & (HUGE_PAGE_SIZE - 1);
+    head = buf - page - map;
+    if (head)
+	munmap (map, head);
+    if (map_length - head - page - length)
+	munmap (buf + length, map_length - head - page - length);
+    ((void **)buf)[-1] = NULL;
+    ((void **)buf)[-2] = buf - page;
+    ((unsigned long *)buf)[-3] = page + length;
+    madvise (buf, length, MADV_HUGEPAGE);
+    return buf;
+}
+#endif
+
+/* our own allocation, without the hooks */
+static void * malloc_policy (unsigned size, int policy)
+{
+    char * buf;
+    unsigned long align, length, huge_length;
+
+    if (!size)
+	return NULL;
+    policy &= POLICY_HUGEPAGES | POLICY_NUMA_LOCAL;
+    if (!policy)
+	return aligned_malloc (size, 64);
+
+    /* both madvise and mbind want whole pages */
+#ifdef HAVE_UNISTD_H
+    align = sysconf (_SC_PAGESIZE);
+#else
+    align = 4096;
+#endif
+    length = (size + align - 1) & ~(align - 1);
+    if (policy & MPEG2_POLICY_HUGEPAGES) {
+	/* only whole huge pages are used, round up when that is cheap */
+	huge_length = (length + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+	if (huge_length - length <= length / 8)
+	    length = huge_length;
+	if (length < HUGE_PAGE_SIZE)
+	    policy &= ~MPEG2_POLICY_HUGEPAGES;
+    }
+#if POLICY_HUGEPAGES
+    if (policy & MPEG2_POLICY_HUGEPAGES)
+	buf = (char *) huge_malloc (length, align);
+    else
+#endif
+	buf = (char *) aligned_malloc (length, align);
+    if (buf == NULL)
+	return NULL;
+#if POLICY_NUMA_LOCAL
+    if (policy & MPEG2_POLICY_NUMA_LOCAL)
+	bind_local (buf, length);
+#endif
+    return buf;
+}
+
+static void default_free (void * buf)
+{
+    if (buf == NULL)
+	return;
+#if POLICY_HUGEPAGES
+    if (((void **)buf)[-1] == NULL) {
+	munmap (((void **)buf)[-2], ((unsigned long *)buf)[-3]);
+	return;
+    }
+#endif
+    free (*(((void **)buf) - 1));
+}
+
+static void account (mpeg2dec_t * mpeg2dec, alloc_entry_t * entry,
+		     void * buf, unsigned size, mpeg2_alloc_t reason,
+		     int allocator)
+{
+    mpeg2_memory_t * memory = &(mpeg2dec->memory);
+
+    entry->buf = buf;
+    entry->size = size;
+    entry->reason = reason;
+    entry->allocator = allocator;
+    memory->in_use[reason] += size;
+    if (memory->peak[reason] < memory->in_use[reason])
+	memory->peak[reason] = memory->in_use[reason];
+    memory->total += size;
+    if (memory->total_peak < memory->total)
+	memory->total_peak = memory->total;
+}
+
+/*
+ * Buffers come from the allocator of the decoder if it has one, or from
+ * the malloc hook otherwise, and from our own allocation with the policy
+ * of the decoder when they return NULL. Only the buffers with a free
+ * entry to account for them are asked from the allocator, so that each
+ * one goes back to where it came from. The allocator and the hook see
+ * all frame buffers as MPEG2_ALLOC_YUV, as they always did; the finer
+ * reasons are only used for mpeg2_memory_usage.
+ */
+void * mpeg2_malloc_decoder (mpeg2dec_t * mpeg2dec, unsigned size,
+			     mpeg2_alloc_t reason)
+{
+    alloc_entry_t * entry;
+    mpeg2_alloc_t hook_reason;
+    void * buf;
+    int i;
+
+    hook_reason = reason;
+    if (reason == MPEG2_ALLOC_YUV_REFERENCE ||
+	reason == MPEG2_ALLOC_YUV_SCRATCH)
+	hook_reason = MPEG2_ALLOC_YUV;
+
+    entry = NULL;
+    for (i = 0; i < MAX_ALLOCS; i++)
+	if (mpeg2dec->allocs[i].buf == NULL) {
+	    entry = mpeg2dec->allocs + i;
+	    break;
+	}
+    buf = NULL;
+    if (mpeg2dec->allocator.alloc_func) {
+	if (entry && size)
+	    buf = mpeg2dec->allocator.alloc_func (mpeg2dec->allocator.arg,
+						  size, hook_reason);
 	if (buf) {
-	    char * align_buf;
+	    account (mpeg2dec, entry, buf, size, reason, 1);
+	    return buf;
+	}
+    } else if (malloc_hook)
+	buf = malloc_hook (size, hook_reason);
+    if (buf == NULL)
+	buf = malloc_policy (size, mpeg2dec->alloc_policy);
+    if (buf && entry)
+	account (mpeg2dec, entry, buf, size, reason, 0);
+    else if (buf)
+	mpeg2dec->memory.untracked++;
+    return buf;
+}
 
-	    align_buf = buf + 63 + sizeof (void **);
-	    align_buf -= (long)align_buf & 63;
-	    *(((void **)align_buf) - 1) = buf;
-	    return align_buf;
+void mpeg2_free_decoder (mpeg2dec_t * mpeg2dec, void * buf)
+{
+    int i, allocator;
+
+    if (buf == NULL)
+	return;
+    allocator = 0;
+    for (i = 0; i < MAX_ALLOCS; i++)
+	if (mpeg2dec->allocs[i].buf == buf) {
+	    mpeg2dec->memory.in_use[mpeg2dec->allocs[i].reason] -=
+		mpeg2dec->allocs[i].size;
+	    mpeg2dec->memory.total -= mpeg2dec->allocs[i].size;
+	    mpeg2dec->allocs[i].buf = NULL;
+	    allocator = mpeg2dec->allocs[i].allocator;
+	    break;
 	}
-    }
-    return NULL;
+    /* buf may be mpeg2dec itself, the call is the last access to it */
+    if (allocator) {
+	if (mpeg2dec->allocator.free_func)
+	    mpeg2dec->allocator.free_func (mpeg2dec->allocator.arg, buf);
+    } else if (mpeg2dec->allocator.alloc_func)
+	default_free (buf);
+    else
+	mpeg2_free (buf);
+}
+
+mpeg2dec_t * mpeg2_malloc_mpeg2dec (const mpeg2_allocator_t * allocator)
+{
+    mpeg2dec_t * mpeg2dec;
+    int from_allocator;
+    size_t prescale_start, prescale_end;
+
+    mpeg2dec = NULL;
+    from_allocator = 0;
+    if (allocator && allocator->alloc_func) {
+	mpeg2dec = (mpeg2dec_t *)
+	    allocator->alloc_func (allocator->arg, sizeof (mpeg2dec_t),
+				   MPEG2_ALLOC_MPEG2DEC);
+	from_allocator = (mpeg2dec != NULL);
+	if (mpeg2dec == NULL)
+	    mpeg2dec = (mpeg2dec_t *) malloc_policy (sizeof (mpeg2dec_t), 0);
+    } else
+	mpeg2dec = (mpeg2dec_t *) mpeg2_malloc (sizeof (mpeg2dec_t),
+						MPEG2_ALLOC_MPEG2DEC);
+    if (mpeg2dec == NULL)
+	return NULL;
+
+    /*
+     * whatever init does not set explicitly starts out as zero, except
+     * for quantizer_prescale: the prescaled bitmask guards it, and
+     * leaving its 16 KiB untouched is what keeps it from being paged in
+     * for quantizer scales the stream never uses.
+     */
+    prescale_start = offsetof (mpeg2dec_t, decoder.quantizer_prescale);
+    prescale_end = (prescale_start +
+		    sizeof (mpeg2dec->decoder.quantizer_prescale));
+    memset (mpeg2dec, 0, prescale_start);
+    memset ((char *) mpeg2dec + prescale_end, 0,
+	    sizeof (mpeg2dec_t) - prescale_end);
+    if (allocator)
+	mpeg2dec->allocator = *allocator;
+    /* the decoder accounts for itself, and for all it allocates later */
+    account (mpeg2dec, mpeg2dec->allocs, mpeg2dec, sizeof (mpeg2dec_t),
+	     MPEG2_ALLOC_MPEG2DEC, from_allocator);
+    return mpeg2dec;
+}
+
+const mpeg2_memory_t * mpeg2_memory_usage (const mpeg2dec_t * mpeg2dec)
+{
+    return &(mpeg2dec->memory);
+}
+
+int mpeg2_alloc_policy (mpeg2dec_t * mpeg2dec, int policy)
+{
+    mpeg2dec->alloc_policy = policy & (POLICY_HUGEPAGES | POLICY_NUMA_LOCAL);
+    return mpeg2dec->alloc_policy;
 }
 
 void mpeg2_free (void * buf)
@@ -58,8 +340,7 @@ void mpeg2_free (void * buf)
     if (free_hook && free_hook (buf))
 	return;
 
-    if (buf)
-	free (*(((void **)buf) - 1));
+    default_free (buf);
 }
 
 void mpeg2_malloc_hooks (void * alloc_func (unsigned, mpeg2_alloc_t),
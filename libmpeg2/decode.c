@@ -33,7 +33,14 @@
 
 static int mpeg2_accels = 0;
 
-#define BUFFER_SIZE (1194 * 1024)
+/* the chunk buffer starts small and grows with the largest chunk seen */
+#define BUFFER_SIZE (16 * 1024)
+/*
+ * it may grow up to the vbv buffer size of the stream, but always has room
+ * for main profile at high level and never more than 4:2:2 profile allows
+ */
+#define BUFFER_SIZE_MIN (1194 * 1024)
+#define BUFFER_SIZE_MAX (5760 * 1024)
 
 const mpeg2_info_t * mpeg2_info (mpeg2dec_t * mpeg2dec)
 {
@@ -79,10 +86,12 @@ static inline int copy_chunk (mpeg2dec_t * mpeg2dec, int bytes)
     uint8_t * chunk_ptr;
     uint8_t * limit;
     uint8_t byte;
+    STATS (uint64_t stats_start;)
 
     if (!bytes)
 	return 0;
 
+    STATS (stats_start = stats_clock ();)
     current = mpeg2dec->buf_start;
     shift = mpeg2dec->shift;
     chunk_ptr = mpeg2dec->chunk_ptr;
@@ -97,6 +106,9 @@ static inline int copy_chunk (mpeg2dec_t * mpeg2dec, int bytes)
 	    mpeg2dec->chunk_ptr = chunk_ptr + 1;
 	    copied = current - mpeg2dec->buf_start;
 	    mpeg2dec->buf_start = current;
+	    STATS (mpeg2dec->decoder.stats.chunk_bytes += copied;)
+	    STATS (mpeg2dec->decoder.stats.chunk_time +=
+		   stats_clock () - stats_start;)
 	    return copied;
 	}
 	shift = (shift | byte) << 8;
@@ -105,6 +117,41 @@ static inline int copy_chunk (mpeg2dec_t * mpeg2dec, int bytes)
 
     mpeg2dec->shift = shift;
     mpeg2dec->buf_start = current;
+    STATS (mpeg2dec->decoder.stats.chunk_bytes += bytes;)
+    STATS (mpeg2dec->decoder.stats.chunk_time += stats_clock () - stats_start;)
+    return 0;
+}
+
+/* called with a full chunk buffer, returns nonzero if it can not grow */
+static int grow_chunk (mpeg2dec_t * mpeg2dec)
+{
+    uint8_t * buffer;
+    unsigned int limit;
+    int size;
+
+    limit = BUFFER_SIZE_MIN;
+    if (mpeg2dec->sequence.width != (unsigned)-1 &&
+	mpeg2dec->sequence.vbv_buffer_size > limit)
+	limit = mpeg2dec->sequence.vbv_buffer_size;
+    if (limit > BUFFER_SIZE_MAX)
+	limit = BUFFER_SIZE_MAX;
+    if ((unsigned) mpeg2dec->chunk_size >= limit)
+	return 1;
+
+    size = 2 * mpeg2dec->chunk_size;
+    if ((unsigned) size > limit)
+	size = limit;
+    buffer = (uint8_t *) mpeg2_malloc_decoder (mpeg2dec, size + 4,
+					       MPEG2_ALLOC_CHUNK);
+    if (buffer == NULL)
+	return 1;
+    memcpy (buffer, mpeg2dec->chunk_buffer, mpeg2dec->chunk_size);
+    mpeg2dec->chunk_start =
+	buffer + (mpeg2dec->chunk_start - mpeg2dec->chunk_buffer);
+    mpeg2dec->chunk_ptr = buffer + mpeg2dec->chunk_size;
+    mpeg2_free_decoder (mpeg2dec, mpeg2dec->chunk_buffer);
+    mpeg2dec->chunk_buffer = buffer;
+    mpeg2dec->chunk_size = size;
     return 0;
 }
 
@@ -126,11 +173,13 @@ static inline mpeg2_state_t seek_chunk (mpeg2dec_t * mpeg2dec)
     size = mpeg2dec->buf_end - mpeg2dec->buf_start;
     skipped = skip_chunk (mpeg2dec, size);
     if (!skipped) {
-	mpeg2dec->bytes_since_tag += size;
+	mpeg2dec->bytes_parsed += size;
+	PROBE2 (buffer, mpeg2dec, mpeg2dec->bytes_parsed);
 	return STATE_BUFFER;
     }
-    mpeg2dec->bytes_since_tag += skipped;
+    mpeg2dec->bytes_parsed += skipped;
     mpeg2dec->code = mpeg2dec->buf_start[-1];
+    PROBE3 (resync, mpeg2dec, skipped, mpeg2dec->code);
     return STATE_INTERNAL_NORETURN;
 }
 
@@ -149,44 +198,70 @@ mpeg2_state_t mpeg2_seek_header (mpeg2dec_t * mpeg2dec)
 
 #define RECEIVED(code,state) (((state) << 8) + (code))
 
+/* the frames to display and discard go to the user with these states */
+static inline mpeg2_state_t probe_display (mpeg2dec_t * mpeg2dec,
+					   mpeg2_state_t state)
+{
+    if (state == STATE_SLICE || state == STATE_END ||
+	state == STATE_INVALID_END) {
+	if (mpeg2dec->info.display_fbuf)
+	    PROBE3 (display, mpeg2dec, mpeg2dec->info.display_fbuf,
+		    mpeg2dec->info.display_picture);
+	if (mpeg2dec->info.discard_fbuf)
+	    PROBE2 (discard, mpeg2dec, mpeg2dec->info.discard_fbuf);
+    }
+    return state;
+}
+
 mpeg2_state_t mpeg2_parse (mpeg2dec_t * mpeg2dec)
 {
     int size_buffer, size_chunk, copied;
+    STATS (uint64_t stats_start;)
 
     if (mpeg2dec->action) {
 	mpeg2_state_t state;
 
 	state = mpeg2dec->action (mpeg2dec);
 	if ((int)state > (int)STATE_INTERNAL_NORETURN)
-	    return state;
+	    return probe_display (mpeg2dec, state);
     }
 
     while (1) {
 	while ((unsigned) (mpeg2dec->code - mpeg2dec->first_decode_slice) <
 	       mpeg2dec->nb_decode_slices) {
 	    size_buffer = mpeg2dec->buf_end - mpeg2dec->buf_start;
-	    size_chunk = (mpeg2dec->chunk_buffer + BUFFER_SIZE -
+	    size_chunk = (mpeg2dec->chunk_buffer + mpeg2dec->chunk_size -
 			  mpeg2dec->chunk_ptr);
 	    if (size_buffer <= size_chunk) {
 		copied = copy_chunk (mpeg2dec, size_buffer);
 		if (!copied) {
-		    mpeg2dec->bytes_since_tag += size_buffer;
+		    mpeg2dec->bytes_parsed += size_buffer;
 		    mpeg2dec->chunk_ptr += size_buffer;
+		    PROBE2 (buffer, mpeg2dec, mpeg2dec->bytes_parsed);
 		    return STATE_BUFFER;
 		}
 	    } else {
 		copied = copy_chunk (mpeg2dec, size_chunk);
 		if (!copied) {
+		    mpeg2dec->bytes_parsed += size_chunk;
+		    if (!grow_chunk (mpeg2dec))
+			continue;
 		    /* filled the chunk buffer without finding a start code */
-		    mpeg2dec->bytes_since_tag += size_chunk;
 		    mpeg2dec->action = seek_chunk;
 		    return STATE_INVALID;
 		}
 	    }
-	    mpeg2dec->bytes_since_tag += copied;
+	    mpeg2dec->bytes_parsed += copied;
 
+	    STATS (stats_start = stats_clock ();)
+	    PROBE2 (slice_start, mpeg2dec, mpeg2dec->code);
 	    mpeg2_slice (&(mpeg2dec->decoder), mpeg2dec->code,
 			 mpeg2dec->chunk_start);
+	    PROBE3 (slice_end, mpeg2dec, mpeg2dec->code,
+		    mpeg2dec->decoder.v_offset);
+	    STATS (mpeg2dec->decoder.stats.slice_time +=
+		   stats_clock () - stats_start;)
+	    STATS (mpeg2dec->decoder.stats.slices++;)
 	    mpeg2dec->code = mpeg2dec->buf_start[-1];
 	    mpeg2dec->chunk_ptr = mpeg2dec->chunk_start;
 	}
@@ -196,14 +271,19 @@ mpeg2_state_t mpeg2_parse (mpeg2dec_t * mpeg2dec)
 	    return STATE_BUFFER;
     }
 
+    /* the slices of the picture are done */
+    if (mpeg2dec->decoder.tiled)
+	mpeg2_tile_picture (&(mpeg2dec->decoder));
+
     mpeg2dec->action = mpeg2_seek_header;
     switch (mpeg2dec->code) {
     case 0x00:
-	return mpeg2dec->state;
+	return probe_display (mpeg2dec, mpeg2dec->state);
     case 0xb3:
     case 0xb7:
     case 0xb8:
-	return (mpeg2dec->state == STATE_SLICE) ? STATE_SLICE : STATE_INVALID;
+	return probe_display (mpeg2dec, ((mpeg2dec->state == STATE_SLICE) ?
+					 STATE_SLICE : STATE_INVALID));
     default:
 	mpeg2dec->action = seek_chunk;
 	return STATE_INVALID;
@@ -222,26 +302,29 @@ mpeg2_state_t mpeg2_parse_header (mpeg2dec_t * mpeg2dec)
     mpeg2dec->info.user_data = NULL;	mpeg2dec->info.user_data_len = 0;
     while (1) {
 	size_buffer = mpeg2dec->buf_end - mpeg2dec->buf_start;
-	size_chunk = (mpeg2dec->chunk_buffer + BUFFER_SIZE -
+	size_chunk = (mpeg2dec->chunk_buffer + mpeg2dec->chunk_size -
 		      mpeg2dec->chunk_ptr);
 	if (size_buffer <= size_chunk) {
 	    copied = copy_chunk (mpeg2dec, size_buffer);
 	    if (!copied) {
-		mpeg2dec->bytes_since_tag += size_buffer;
+		mpeg2dec->bytes_parsed += size_buffer;
 		mpeg2dec->chunk_ptr += size_buffer;
+		PROBE2 (buffer, mpeg2dec, mpeg2dec->bytes_parsed);
 		return STATE_BUFFER;
 	    }
 	} else {
 	    copied = copy_chunk (mpeg2dec, size_chunk);
 	    if (!copied) {
+		mpeg2dec->bytes_parsed += size_chunk;
+		if (!grow_chunk (mpeg2dec))
+		    continue;
 		/* filled the chunk buffer without finding a start code */
-		mpeg2dec->bytes_since_tag += size_chunk;
 		mpeg2dec->code = 0xb4;
 		mpeg2dec->action = mpeg2_seek_header;
 		return STATE_INVALID;
 	    }
 	}
-	mpeg2dec->bytes_since_tag += copied;
+	mpeg2dec->bytes_parsed += copied;
 
 	if (process_header[mpeg2dec->code & 0x0b] (mpeg2dec)) {
 	    mpeg2dec->code = mpeg2dec->buf_start[-1];
@@ -309,8 +392,12 @@ int mpeg2_convert (mpeg2dec_t * mpeg2dec, mpeg2_convert_t convert, void * arg)
 int mpeg2_stride (mpeg2dec_t * mpeg2dec, int stride)
 {
     if (!mpeg2dec->convert) {
-	if (stride < (int) mpeg2dec->sequence.width)
-	    stride = mpeg2dec->sequence.width;
+	int width = mpeg2dec->sequence.width;
+
+	if (!mpeg2dec->custom_fbuf)
+	    width += 2 * mpeg2dec->border;
+	if (stride < width)
+	    stride = width;
 	mpeg2dec->decoder.stride_frame = stride;
     } else {
 	mpeg2_convert_init_t convert_init;
@@ -325,6 +412,19 @@ int mpeg2_stride (mpeg2dec_t * mpeg2dec, int stride)
     return stride;
 }
 
+int mpeg2_border (mpeg2dec_t * mpeg2dec, int border)
+{
+    border = (border <= 0) ? 0 : (border <= 16) ? 16 : 32;
+    mpeg2dec->border = border;
+    return border;
+}
+
+int mpeg2_tiled (mpeg2dec_t * mpeg2dec, int tiled)
+{
+    mpeg2dec->tiled = (tiled != 0);
+    return mpeg2dec->tiled;
+}
+
 void mpeg2_set_buf (mpeg2dec_t * mpeg2dec, uint8_t * buf[3], void * id)
 {
     mpeg2_fbuf_t * fbuf;
@@ -381,7 +481,34 @@ void mpeg2_tag_picture (mpeg2dec_t * mpeg2dec, uint32_t tag, uint32_t tag2)
     mpeg2dec->tag_current = tag;
     mpeg2dec->tag2_current = tag2;
     mpeg2dec->num_tags++;
-    mpeg2dec->bytes_since_tag = 0;
+    mpeg2dec->tag_pos = mpeg2dec->bytes_parsed;
+}
+
+void mpeg2_tag_timestamps (mpeg2dec_t * mpeg2dec, int64_t pts, int64_t dts)
+{
+    timestamp_t * ts;
+
+    if (mpeg2dec->num_timestamps == MPEG2_TIMESTAMPS) {
+	/* no picture start code for a while - forget the oldest one */
+	mpeg2dec->first_timestamp =
+	    (mpeg2dec->first_timestamp + 1) % MPEG2_TIMESTAMPS;
+	mpeg2dec->num_timestamps--;
+    }
+    ts = mpeg2dec->timestamps + ((mpeg2dec->first_timestamp +
+				  mpeg2dec->num_timestamps++) %
+				 MPEG2_TIMESTAMPS);
+    ts->pos = mpeg2dec->bytes_parsed;
+    ts->pts = pts;
+    ts->dts = dts;
+}
+
+const mpeg2_stats_t * mpeg2_get_stats (const mpeg2dec_t * mpeg2dec)
+{
+#ifdef LIBMPEG2_STATS
+    return &(mpeg2dec->decoder.stats);
+#else
+    return NULL;
+#endif
 }
 
 uint32_t mpeg2_accel (uint32_t accel)
@@ -391,6 +518,7 @@ uint32_t mpeg2_accel (uint32_t accel)
 	mpeg2_cpu_state_init (mpeg2_accels);
 	mpeg2_idct_init (mpeg2_accels);
 	mpeg2_mc_init (mpeg2_accels);
+	mpeg2_vlc_init ();
     }
     return mpeg2_accels & ~MPEG2_ACCEL_DETECT;
 }
@@ -399,6 +527,11 @@ void mpeg2_reset (mpeg2dec_t * mpeg2dec, int full_reset)
 {
     mpeg2dec->buf_start = mpeg2dec->buf_end = NULL;
     mpeg2dec->num_tags = 0;
+    mpeg2dec->tag_pos = 0;
+    mpeg2dec->bytes_parsed = 0;
+    mpeg2dec->first_timestamp = 0;
+    mpeg2dec->num_timestamps = 0;
+    mpeg2dec->next_pts = -1;
     mpeg2dec->shift = 0xffffff00;
     mpeg2dec->code = 0xb4;
     mpeg2dec->action = mpeg2_seek_header;
@@ -417,20 +550,30 @@ void mpeg2_reset (mpeg2dec_t * mpeg2dec, int full_reset)
 }
 
 mpeg2dec_t * mpeg2_init (void)
+{
+    return mpeg2_init_with_allocator (NULL);
+}
+
+mpeg2dec_t * mpeg2_init_with_allocator (const mpeg2_allocator_t * allocator)
 {
     mpeg2dec_t * mpeg2dec;
 
     mpeg2_accel (MPEG2_ACCEL_DETECT);
 
-    mpeg2dec = (mpeg2dec_t *) mpeg2_malloc (sizeof (mpeg2dec_t),
-					    MPEG2_ALLOC_MPEG2DEC);
+    mpeg2dec = mpeg2_malloc_mpeg2dec (allocator);
     if (mpeg2dec == NULL)
 	return NULL;
 
-    memset (mpeg2dec->decoder.DCTblock, 0, 64 * sizeof (int16_t));
+    /* the decoder comes cleared, including DCTblock and the stats */
+    STATS (mpeg2dec->decoder.stats.flags = STATS_FLAGS;)
 
-    mpeg2dec->chunk_buffer = (uint8_t *) mpeg2_malloc (BUFFER_SIZE + 4,
-						       MPEG2_ALLOC_CHUNK);
+    mpeg2dec->chunk_buffer = (uint8_t *)
+	mpeg2_malloc_decoder (mpeg2dec, BUFFER_SIZE + 4, MPEG2_ALLOC_CHUNK);
+    if (mpeg2dec->chunk_buffer == NULL) {
+	mpeg2_free_decoder (mpeg2dec, mpeg2dec);
+	return NULL;
+    }
+    mpeg2dec->chunk_size = BUFFER_SIZE;
 
     mpeg2dec->sequence.width = (unsigned)-1;
     mpeg2_reset (mpeg2dec, 1);
@@ -441,6 +584,6 @@ mpeg2dec_t * mpeg2_init (void)
 void mpeg2_close (mpeg2dec_t * mpeg2dec)
 {
     mpeg2_header_state_init (mpeg2dec);
-    mpeg2_free (mpeg2dec->chunk_buffer);
-    mpeg2_free (mpeg2dec);
+    mpeg2_free_decoder (mpeg2dec, mpeg2dec->chunk_buffer);
+    mpeg2_free_decoder (mpeg2dec, mpeg2dec);
 }
@@ -77,29 +77,37 @@ uint8_t mpeg2_scan_alt[64] ATTR_ALIGN(16) = {
 void mpeg2_header_state_init (mpeg2dec_t * mpeg2dec)
 {
     if (mpeg2dec->sequence.width != (unsigned)-1) {
-	int i;
+	int i, j;
 
 	mpeg2dec->sequence.width = (unsigned)-1;
 	if (!mpeg2dec->custom_fbuf)
 	    for (i = mpeg2dec->alloc_index_user;
-		 i < mpeg2dec->alloc_index; i++) {
-		mpeg2_free (mpeg2dec->fbuf_alloc[i].fbuf.buf[0]);
-		mpeg2_free (mpeg2dec->fbuf_alloc[i].fbuf.buf[1]);
-		mpeg2_free (mpeg2dec->fbuf_alloc[i].fbuf.buf[2]);
-	    }
+		 i < mpeg2dec->alloc_index; i++)
+		for (j = 0; j < 3; j++) {
+		    mpeg2_free_decoder (mpeg2dec,
+					mpeg2dec->fbuf_alloc[i].mem[j]);
+		    if (mpeg2dec->decoder.tiled)
+			mpeg2_free_decoder (mpeg2dec,
+					    mpeg2dec->fbuf_alloc[i].tiles[j]);
+		}
 	if (mpeg2dec->convert_start)
-	    for (i = 0; i < 3; i++) {
-		mpeg2_free (mpeg2dec->yuv_buf[i][0]);
-		mpeg2_free (mpeg2dec->yuv_buf[i][1]);
-		mpeg2_free (mpeg2dec->yuv_buf[i][2]);
-	    }
+	    for (i = 0; i < (mpeg2dec->yuv_rows ? 3 : 2); i++)
+		for (j = 0; j < 3; j++)
+		    mpeg2_free_decoder (mpeg2dec, mpeg2dec->yuv_buf[i][j]);
 	if (mpeg2dec->decoder.convert_id)
-	    mpeg2_free (mpeg2dec->decoder.convert_id);
+	    mpeg2_free_decoder (mpeg2dec, mpeg2dec->decoder.convert_id);
     }
     mpeg2dec->decoder.coding_type = I_TYPE;
+    mpeg2dec->decoder.border = 0;
+    mpeg2dec->decoder.tiled = 0;
     mpeg2dec->decoder.convert = NULL;
     mpeg2dec->decoder.convert_id = NULL;
     mpeg2dec->coding.matrix_updates = 0;
+    mpeg2dec->decoder.chroma_quantizer[0] = 0;
+    mpeg2dec->decoder.chroma_quantizer[1] = 1;
+    mpeg2dec->decoder.prescaled = 0;
+    mpeg2dec->decoder.q_scale_type = 0;
+    mpeg2dec->decoder.quantizer_source = mpeg2dec->coding.quantizer_matrix;
     mpeg2dec->picture = mpeg2dec->pictures;
     mpeg2dec->fbuf[0] = &mpeg2dec->fbuf_alloc[0].fbuf;
     mpeg2dec->fbuf[1] = &mpeg2dec->fbuf_alloc[1].fbuf;
@@ -113,6 +121,7 @@ void mpeg2_header_state_init (mpeg2dec_t * mpeg2dec)
     mpeg2dec->convert_start = NULL;
     mpeg2dec->custom_fbuf = 0;
     mpeg2dec->yuv_index = 0;
+    mpeg2dec->yuv_rows = 0;
 }
 
 void mpeg2_reset_info (mpeg2_info_t * info)
@@ -521,6 +530,68 @@ void mpeg2_set_fbuf (mpeg2dec_t * mpeg2dec, int b_type)
 	}
 }
 
+/*
+ * The timestamps of a PES packet belong to the first picture whose
+ * start code begins in its payload, at byte position start.
+ */
+static void picture_timestamps (mpeg2dec_t * mpeg2dec,
+				mpeg2_picture_t * picture, uint32_t start)
+{
+    timestamp_t * ts;
+    int i, n;
+
+    picture->pts = picture->dts = 0;
+    for (n = 0; n < mpeg2dec->num_timestamps; n++) {
+	i = (mpeg2dec->first_timestamp + n) % MPEG2_TIMESTAMPS;
+	if ((int32_t) (start - mpeg2dec->timestamps[i].pos) < 0)
+	    break;
+    }
+    if (!n)
+	return;
+    ts = mpeg2dec->timestamps + (mpeg2dec->first_timestamp + n - 1) %
+	MPEG2_TIMESTAMPS;
+    mpeg2dec->first_timestamp =
+	(mpeg2dec->first_timestamp + n) % MPEG2_TIMESTAMPS;
+    mpeg2dec->num_timestamps -= n;
+    if (ts->pts >= 0) {
+	picture->pts = ts->pts;
+	picture->flags |= PIC_FLAG_PTS;
+    }
+    /* a PES header only omits the dts when it equals the pts */
+    if (ts->dts >= 0 || ts->pts >= 0) {
+	picture->dts = (ts->dts >= 0) ? ts->dts : ts->pts;
+	picture->flags |= PIC_FLAG_DTS;
+    }
+}
+
+/*
+ * Give a pts to a picture about to be displayed that came without one.
+ * B pictures, and all pictures in low_delay streams, are displayed as
+ * soon as they are decoded: their pts is their dts. Reference pictures
+ * are displayed when the next one gets decoded, at that picture's dts.
+ * Otherwise, extrapolate from the previous picture and its duration.
+ */
+static void display_timestamps (mpeg2dec_t * mpeg2dec,
+				mpeg2_picture_t * display,
+				const mpeg2_picture_t * current)
+{
+    unsigned int fields;
+
+    if (display->flags & PIC_FLAG_PTS)
+	;
+    else if (current && (current->flags & PIC_FLAG_DTS))
+	display->pts = current->dts;
+    else if (mpeg2dec->next_pts >= 0)
+	display->pts = mpeg2dec->next_pts;
+    else
+	return;
+    display->flags |= PIC_FLAG_PTS;
+
+    fields = (display->nb_fields == 1) ? 2 : display->nb_fields;
+    mpeg2dec->next_pts = ((display->pts + mpeg2dec->sequence.frame_period *
+			   fields / 600) & (((int64_t) 1 << 33) - 1));
+}
+
 int mpeg2_header_picture (mpeg2dec_t * mpeg2dec)
 {
     uint8_t * buffer = mpeg2dec->chunk_start;
@@ -546,7 +617,8 @@ int mpeg2_header_picture (mpeg2dec_t * mpeg2dec)
     picture->flags = PIC_FLAG_PROGRESSIVE_FRAME | type;
     picture->tag = picture->tag2 = 0;
     if (mpeg2dec->num_tags) {
-	if (mpeg2dec->bytes_since_tag >= mpeg2dec->chunk_ptr - buffer + 4) {
+	if ((int) (mpeg2dec->bytes_parsed - mpeg2dec->tag_pos) >=
+	    mpeg2dec->chunk_ptr - buffer + 4) {
 	    mpeg2dec->num_tags = 0;
 	    picture->tag = mpeg2dec->tag_current;
 	    picture->tag2 = mpeg2dec->tag2_current;
@@ -558,6 +630,9 @@ int mpeg2_header_picture (mpeg2dec_t * mpeg2dec)
 	    picture->flags |= PIC_FLAG_TAGS;
 	}
     }
+    picture_timestamps (mpeg2dec, picture,
+			mpeg2dec->bytes_parsed -
+			(mpeg2dec->chunk_ptr - buffer + 4));
     picture->nb_fields = 2;
     picture->display_offset[0].x = picture->display_offset[1].x =
 	picture->display_offset[2].x = mpeg2dec->display_offset_x;
@@ -573,6 +648,7 @@ int mpeg2_header_picture (mpeg2dec_t * mpeg2dec)
     coding->alternate_scan = 0;
     mpeg2dec->copy_matrix = 0;
 
+    PROBE3 (picture_start, mpeg2dec, type, picture->temporal_reference);
     return 0;
 }
 
@@ -700,14 +776,18 @@ void mpeg2_header_picture_finalize (mpeg2dec_t * mpeg2dec, uint32_t accels)
 		mpeg2dec->info.discard_fbuf =
 		    mpeg2dec->fbuf[!low_delay + !mpeg2dec->convert];
 	}
+	if (mpeg2dec->info.display_picture)
+	    display_timestamps (mpeg2dec,
+				((mpeg2dec->info.display_picture == picture) ?
+				 picture : other), picture);
 	if (mpeg2dec->convert) {
 	    mpeg2_convert_init_t convert_init;
 	    if (!mpeg2dec->convert_start) {
-		int y_size, uv_size;
+		int y_size, uv_size, i;
 
 		mpeg2dec->decoder.convert_id =
-		    mpeg2_malloc (mpeg2dec->convert_id_size,
-				  MPEG2_ALLOC_CONVERT_ID);
+		    mpeg2_malloc_decoder (mpeg2dec, mpeg2dec->convert_id_size,
+					  MPEG2_ALLOC_CONVERT_ID);
 		mpeg2dec->convert (MPEG2_CONVERT_START,
 				   mpeg2dec->decoder.convert_id,
 				   &(mpeg2dec->sequence),
@@ -716,62 +796,88 @@ void mpeg2_header_picture_finalize (mpeg2dec_t * mpeg2dec, uint32_t accels)
 		mpeg2dec->convert_start = convert_init.start;
 		mpeg2dec->decoder.convert = convert_init.copy;
 
+		/* the B picture strip waits for the first B picture */
 		y_size = decoder->stride_frame * mpeg2dec->sequence.height;
 		uv_size = y_size >> (2 - mpeg2dec->decoder.chroma_format);
-		mpeg2dec->yuv_buf[0][0] =
-		    (uint8_t *) mpeg2_malloc (y_size, MPEG2_ALLOC_YUV);
-		mpeg2dec->yuv_buf[0][1] =
-		    (uint8_t *) mpeg2_malloc (uv_size, MPEG2_ALLOC_YUV);
-		mpeg2dec->yuv_buf[0][2] =
-		    (uint8_t *) mpeg2_malloc (uv_size, MPEG2_ALLOC_YUV);
-		mpeg2dec->yuv_buf[1][0] =
-		    (uint8_t *) mpeg2_malloc (y_size, MPEG2_ALLOC_YUV);
-		mpeg2dec->yuv_buf[1][1] =
-		    (uint8_t *) mpeg2_malloc (uv_size, MPEG2_ALLOC_YUV);
-		mpeg2dec->yuv_buf[1][2] =
-		    (uint8_t *) mpeg2_malloc (uv_size, MPEG2_ALLOC_YUV);
-		y_size = decoder->stride_frame * 32;
-		uv_size = y_size >> (2 - mpeg2dec->decoder.chroma_format);
-		mpeg2dec->yuv_buf[2][0] =
-		    (uint8_t *) mpeg2_malloc (y_size, MPEG2_ALLOC_YUV);
-		mpeg2dec->yuv_buf[2][1] =
-		    (uint8_t *) mpeg2_malloc (uv_size, MPEG2_ALLOC_YUV);
-		mpeg2dec->yuv_buf[2][2] =
-		    (uint8_t *) mpeg2_malloc (uv_size, MPEG2_ALLOC_YUV);
+		for (i = 0; i < 2; i++) {
+		    mpeg2dec->yuv_buf[i][0] = (uint8_t *)
+			mpeg2_malloc_decoder (mpeg2dec, y_size,
+					      MPEG2_ALLOC_YUV_REFERENCE);
+		    mpeg2dec->yuv_buf[i][1] = (uint8_t *)
+			mpeg2_malloc_decoder (mpeg2dec, uv_size,
+					      MPEG2_ALLOC_YUV_REFERENCE);
+		    mpeg2dec->yuv_buf[i][2] = (uint8_t *)
+			mpeg2_malloc_decoder (mpeg2dec, uv_size,
+					      MPEG2_ALLOC_YUV_REFERENCE);
+		}
 	    }
 	    if (!mpeg2dec->custom_fbuf) {
 		while (mpeg2dec->alloc_index < 3) {
+		    fbuf_alloc_t * alloc;
 		    mpeg2_fbuf_t * fbuf;
+		    int i;
 
-		    fbuf = &mpeg2dec->fbuf_alloc[mpeg2dec->alloc_index++].fbuf;
+		    alloc = &mpeg2dec->fbuf_alloc[mpeg2dec->alloc_index++];
+		    fbuf = &alloc->fbuf;
 		    fbuf->id = NULL;
-		    fbuf->buf[0] =
-			(uint8_t *) mpeg2_malloc (convert_init.buf_size[0],
-						  MPEG2_ALLOC_CONVERTED);
-		    fbuf->buf[1] =
-			(uint8_t *) mpeg2_malloc (convert_init.buf_size[1],
-						  MPEG2_ALLOC_CONVERTED);
-		    fbuf->buf[2] =
-			(uint8_t *) mpeg2_malloc (convert_init.buf_size[2],
+		    for (i = 0; i < 3; i++)
+			fbuf->buf[i] = alloc->mem[i] = (uint8_t *)
+			    mpeg2_malloc_decoder (mpeg2dec,
+						  convert_init.buf_size[i],
 						  MPEG2_ALLOC_CONVERTED);
 		}
 		mpeg2_set_fbuf (mpeg2dec, (decoder->coding_type == B_TYPE));
 	    }
 	} else if (!mpeg2dec->custom_fbuf) {
+	    /* a border or tiles are only used when all three buffers */
+	    /* are ours, and the tiles need no border */
+	    if (!mpeg2dec->alloc_index) {
+		int width = mpeg2dec->sequence.width + 2 * mpeg2dec->border;
+
+		decoder->tiled = mpeg2dec->tiled;
+		if (!decoder->tiled)
+		    decoder->border = mpeg2dec->border;
+		if (decoder->stride_frame < width)
+		    decoder->stride_frame = width;
+	    }
 	    while (mpeg2dec->alloc_index < 3) {
-		mpeg2_fbuf_t * fbuf;
-		int y_size, uv_size;
-
-		fbuf = &(mpeg2dec->fbuf_alloc[mpeg2dec->alloc_index++].fbuf);
-		fbuf->id = NULL;
-		y_size = decoder->stride_frame * mpeg2dec->sequence.height;
-		uv_size = y_size >> (2 - decoder->chroma_format);
-		fbuf->buf[0] = (uint8_t *) mpeg2_malloc (y_size,
-							 MPEG2_ALLOC_YUV);
-		fbuf->buf[1] = (uint8_t *) mpeg2_malloc (uv_size,
-							 MPEG2_ALLOC_YUV);
-		fbuf->buf[2] = (uint8_t *) mpeg2_malloc (uv_size,
-							 MPEG2_ALLOC_YUV);
+		fbuf_alloc_t * alloc;
+		int i, width, stride, height, border_x, border_y;
+
+		alloc = &(mpeg2dec->fbuf_alloc[mpeg2dec->alloc_index++]);
+		alloc->fbuf.id = NULL;
+		for (i = 0; i < 3; i++) {
+		    width = mpeg2dec->sequence.width;
+		    stride = decoder->stride_frame;
+		    height = mpeg2dec->sequence.height;
+		    border_x = border_y = decoder->border;
+		    if (i && decoder->chroma_format != 2) {
+			width >>= 1;
+			stride >>= 1;
+			border_x >>= 1;
+		    }
+		    if (i && decoder->chroma_format == 0) {
+			height >>= 1;
+			border_y >>= 1;
+		    }
+		    alloc->mem[i] = (uint8_t *)
+			mpeg2_malloc_decoder (mpeg2dec,
+					      stride * (height + 2 * border_y),
+					      MPEG2_ALLOC_YUV);
+		    alloc->fbuf.buf[i] =
+			alloc->mem[i] + border_y * stride + border_x;
+		    alloc->tiles[i] = NULL;
+		    if (decoder->tiled) {
+			int x_shift = (stride < decoder->stride_frame);
+			int tile_width = (1 << TILE_SHIFT) >> x_shift;
+			int tiles = (width + tile_width - 1) / tile_width;
+
+			alloc->tiles[i] = (uint8_t *)
+			    mpeg2_malloc_decoder (mpeg2dec, tiles * height *
+						  (TILE_STRIDE >> x_shift),
+						  MPEG2_ALLOC_YUV_REFERENCE);
+		    }
+		}
 	    }
 	    mpeg2_set_fbuf (mpeg2dec, (decoder->coding_type == B_TYPE));
 	}
@@ -785,6 +891,8 @@ void mpeg2_header_picture_finalize (mpeg2dec_t * mpeg2dec, uint32_t accels)
     }
 
     info_user_data (mpeg2dec);
+    PROBE3 (picture_finalize, mpeg2dec, decoder->coding_type,
+	    decoder->second_field);
 }
 
 static int copyright_ext (mpeg2dec_t * mpeg2dec)
@@ -834,6 +942,29 @@ int mpeg2_header_user_data (mpeg2dec_t * mpeg2dec)
     return 0;
 }
 
+/*
+ * B pictures are converted as soon as each macroblock row is decoded, so
+ * their rows only need a strip of 16 rows, or 32 for field pictures. It
+ * is allocated for the first B picture and grown for the first B field.
+ */
+static void yuv_strip (mpeg2dec_t * mpeg2dec, int rows)
+{
+    int i, size;
+
+    if (mpeg2dec->yuv_rows >= rows)
+	return;
+    for (i = 0; i < 3; i++) {
+	if (mpeg2dec->yuv_rows)
+	    mpeg2_free_decoder (mpeg2dec, mpeg2dec->yuv_buf[2][i]);
+	size = mpeg2dec->decoder.stride_frame * rows;
+	if (i)
+	    size >>= 2 - mpeg2dec->decoder.chroma_format;
+	mpeg2dec->yuv_buf[2][i] = (uint8_t *)
+	    mpeg2_malloc_decoder (mpeg2dec, size, MPEG2_ALLOC_YUV_SCRATCH);
+    }
+    mpeg2dec->yuv_rows = rows;
+}
+
 mpeg2_state_t mpeg2_header_slice_start (mpeg2dec_t * mpeg2dec)
 {
     mpeg2_decoder_t * decoder = &(mpeg2dec->decoder);
@@ -849,13 +980,16 @@ mpeg2_state_t mpeg2_header_slice_start (mpeg2dec_t * mpeg2dec)
 	mpeg2dec->convert_start (decoder->convert_id, mpeg2dec->fbuf[0],
 				 mpeg2dec->picture, mpeg2dec->info.gop);
 
-	if (mpeg2dec->decoder.coding_type == B_TYPE)
+	if (mpeg2dec->decoder.coding_type == B_TYPE) {
+	    /* a field picture interleaves its rows with the other field */
+	    yuv_strip (mpeg2dec, (mpeg2dec->new_picture.nb_fields > 1) ?
+		       16 : 32);
 	    mpeg2_init_fbuf (&(mpeg2dec->decoder), &(mpeg2dec->sequence),
 			     &(mpeg2dec->new_picture), &(mpeg2dec->coding),
 			     mpeg2dec->yuv_buf[2],
 			     mpeg2dec->yuv_buf[mpeg2dec->yuv_index ^ 1],
 			     mpeg2dec->yuv_buf[mpeg2dec->yuv_index]);
-	else {
+	} else {
 	    mpeg2_init_fbuf (&(mpeg2dec->decoder), &(mpeg2dec->sequence),
 			     &(mpeg2dec->new_picture), &(mpeg2dec->coding),
 			     mpeg2dec->yuv_buf[mpeg2dec->yuv_index ^ 1],
@@ -865,14 +999,27 @@ mpeg2_state_t mpeg2_header_slice_start (mpeg2dec_t * mpeg2dec)
 		mpeg2dec->yuv_index ^= 1;
 	}
     } else {
-	int b_type;
+	int b_type, i;
 
 	b_type = (mpeg2dec->decoder.coding_type == B_TYPE);
-	mpeg2_init_fbuf (&(mpeg2dec->decoder), &(mpeg2dec->sequence),
-			 &(mpeg2dec->new_picture), &(mpeg2dec->coding),
-			 mpeg2dec->fbuf[0]->buf,
-			 mpeg2dec->fbuf[b_type + 1]->buf,
-			 mpeg2dec->fbuf[b_type]->buf);
+	if (decoder->tiled) {
+	    fbuf_alloc_t * alloc[3];
+
+	    /* decode into the tiles, and copy the rows out to the fbuf */
+	    for (i = 0; i < 3; i++) {
+		alloc[i] = (fbuf_alloc_t *) mpeg2dec->fbuf[i];
+		decoder->tiled_out[i] = mpeg2dec->fbuf[0]->buf[i];
+	    }
+	    mpeg2_init_fbuf (decoder, &(mpeg2dec->sequence),
+			     &(mpeg2dec->new_picture), &(mpeg2dec->coding),
+			     alloc[0]->tiles, alloc[b_type + 1]->tiles,
+			     alloc[b_type]->tiles);
+	} else
+	    mpeg2_init_fbuf (&(mpeg2dec->decoder), &(mpeg2dec->sequence),
+			     &(mpeg2dec->new_picture), &(mpeg2dec->coding),
+			     mpeg2dec->fbuf[0]->buf,
+			     mpeg2dec->fbuf[b_type + 1]->buf,
+			     mpeg2dec->fbuf[b_type]->buf);
     }
     mpeg2dec->action = NULL;
     return STATE_INTERNAL_NORETURN;
@@ -901,6 +1048,7 @@ mpeg2_state_t mpeg2_header_end (mpeg2dec_t * mpeg2dec)
     mpeg2_reset_info (&(mpeg2dec->info));
     if (!(mpeg2dec->sequence.flags & SEQ_FLAG_LOW_DELAY)) {
 	mpeg2dec->info.display_picture = picture;
+	display_timestamps (mpeg2dec, picture, NULL);
 	if (picture->nb_fields == 1)
 	    mpeg2dec->info.display_picture_2nd = picture + 1;
 	mpeg2dec->info.display_fbuf = mpeg2dec->fbuf[b_type];
@@ -24,6 +24,7 @@
 #include "config.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <inttypes.h>
 
 #include "mpeg2.h"
@@ -38,10 +39,18 @@
 #define W7 565  /* 2048 * sqrt (2) * cos (7 * pi / 16) */
 
 /* idct main entry point  */
-void (* mpeg2_idct_copy) (int16_t * block, uint8_t * dest, int stride);
-void (* mpeg2_idct_add) (int last, int16_t * block,
+void (* mpeg2_idct_copy) (int shape, int16_t * block,
+			  uint8_t * dest, int stride);
+void (* mpeg2_idct_add) (int shape, int16_t * block,
 			 uint8_t * dest, int stride);
 
+/*
+ * Shape of a block, indexed by the or of the scan positions of its
+ * coded coefficients. The positions are the ones the selected idct
+ * expects, so the table is built once the scan tables are patched.
+ */
+uint8_t mpeg2_idct_shape[64];
+
 /*
  * In legal streams, the IDCT output should be between -384 and +384.
  * In corrupted streams, it is possible to force the IDCT output to go
@@ -160,43 +169,173 @@ static inline void idct_col (int16_t * const block)
     block[8*7] = (a0 - b0) >> 17;
 }
 
-static void mpeg2_idct_copy_c (int16_t * block, uint8_t * dest,
-			       const int stride)
+/*
+ * Row and column passes for blocks whose coefficients all sit in the
+ * top-left 4x4 corner: inputs 2, 3, 6 and 7 are known to be zero, and
+ * dropping them from the butterflies gives the same results.
+ */
+static inline void idct_row_4x4 (int16_t * const block)
 {
-    int i;
+    int d0, d1;
+    int a0, a1, a2, a3, b0, b1, b2, b3;
+    int t0, t1, t2, t3;
 
-    for (i = 0; i < 8; i++)
-	idct_row (block + 8 * i);
-    for (i = 0; i < 8; i++)
-	idct_col (block + i);
-    do {
-	dest[0] = CLIP (block[0]);
-	dest[1] = CLIP (block[1]);
-	dest[2] = CLIP (block[2]);
-	dest[3] = CLIP (block[3]);
-	dest[4] = CLIP (block[4]);
-	dest[5] = CLIP (block[5]);
-	dest[6] = CLIP (block[6]);
-	dest[7] = CLIP (block[7]);
-
-	((int32_t *)block)[0] = 0;	((int32_t *)block)[1] = 0;
-	((int32_t *)block)[2] = 0;	((int32_t *)block)[3] = 0;
-
-	dest += stride;
-	block += 8;
-    } while (--i);
+    /* shortcut */
+    if (likely (!(block[1] | ((int32_t *)block)[2]))) {
+	uint32_t tmp = (uint16_t) (block[0] >> 1);
+	tmp |= tmp << 16;
+	((int32_t *)block)[0] = tmp;
+	((int32_t *)block)[1] = tmp;
+	((int32_t *)block)[2] = tmp;
+	((int32_t *)block)[3] = tmp;
+	return;
+    }
+
+    d0 = (block[0] << 11) + 2048;
+    d1 = block[1];
+    a0 = d0 + W2 * d1;
+    a1 = d0 + W6 * d1;
+    a2 = d0 - W6 * d1;
+    a3 = d0 - W2 * d1;
+
+    d0 = block[4];
+    d1 = block[5];
+    t0 = W1 * d0;
+    t1 = W7 * d0;
+    t2 = W3 * d1;
+    t3 = -W5 * d1;
+    b0 = t0 + t2;
+    b3 = t1 + t3;
+    t0 -= t2;
+    t1 -= t3;
+    b1 = ((t0 + t1) >> 8) * 181;
+    b2 = ((t0 - t1) >> 8) * 181;
+
+    block[0] = (a0 + b0) >> 12;
+    block[1] = (a1 + b1) >> 12;
+    block[2] = (a2 + b2) >> 12;
+    block[3] = (a3 + b3) >> 12;
+    block[4] = (a3 - b3) >> 12;
+    block[5] = (a2 - b2) >> 12;
+    block[6] = (a1 - b1) >> 12;
+    block[7] = (a0 - b0) >> 12;
 }
 
-static void mpeg2_idct_add_c (const int last, int16_t * block,
-			      uint8_t * dest, const int stride)
+static inline void idct_col_4x4 (int16_t * const block)
+{
+    int d0, d1;
+    int a0, a1, a2, a3, b0, b1, b2, b3;
+    int t0, t1, t2, t3;
+
+    d0 = (block[8*0] << 11) + 65536;
+    d1 = block[8*1];
+    a0 = d0 + W2 * d1;
+    a1 = d0 + W6 * d1;
+    a2 = d0 - W6 * d1;
+    a3 = d0 - W2 * d1;
+
+    d0 = block[8*4];
+    d1 = block[8*5];
+    t0 = W1 * d0;
+    t1 = W7 * d0;
+    t2 = W3 * d1;
+    t3 = -W5 * d1;
+    b0 = t0 + t2;
+    b3 = t1 + t3;
+    t0 -= t2;
+    t1 -= t3;
+    b1 = ((t0 + t1) >> 8) * 181;
+    b2 = ((t0 - t1) >> 8) * 181;
+
+    block[8*0] = (a0 + b0) >> 17;
+    block[8*1] = (a1 + b1) >> 17;
+    block[8*2] = (a2 + b2) >> 17;
+    block[8*3] = (a3 + b3) >> 17;
+    block[8*4] = (a3 - b3) >> 17;
+    block[8*5] = (a2 - b2) >> 17;
+    block[8*6] = (a1 - b1) >> 17;
+    block[8*7] = (a0 - b0) >> 17;
+}
+
+static inline void idct (const int shape, int16_t * const block)
 {
     int i;
 
-    if (last != 129 || (block[0] & (7 << 4)) == (4 << 4)) {
+    switch (shape) {
+    case IDCT_ROW:
+	/* the column inputs are all zero below the first row */
+	idct_row (block);
+	for (i = 0; i < 8; i++) {
+	    int tmp = ((block[i] << 11) + 65536) >> 17;
+
+	    block[8*0 + i] = block[8*1 + i] = block[8*2 + i] = tmp;
+	    block[8*3 + i] = block[8*4 + i] = block[8*5 + i] = tmp;
+	    block[8*6 + i] = block[8*7 + i] = tmp;
+	}
+	break;
+    case IDCT_4X4:
+	/* the top-left 4x4 coefficients are in rows 0, 1, 4 and 5 */
+	idct_row_4x4 (block);
+	idct_row_4x4 (block + 8 * 1);
+	idct_row_4x4 (block + 8 * 4);
+	idct_row_4x4 (block + 8 * 5);
+	for (i = 0; i < 8; i++)
+	    idct_col_4x4 (block + i);
+	break;
+    default:
 	for (i = 0; i < 8; i++)
 	    idct_row (block + 8 * i);
 	for (i = 0; i < 8; i++)
 	    idct_col (block + i);
+    }
+}
+
+static void mpeg2_idct_copy_c (const int shape, int16_t * block,
+			       uint8_t * dest, const int stride)
+{
+    int i;
+
+    if (shape != IDCT_DC || (block[0] & (7 << 4)) == (4 << 4)) {
+	idct (shape, block);
+	i = 8;
+	do {
+	    dest[0] = CLIP (block[0]);
+	    dest[1] = CLIP (block[1]);
+	    dest[2] = CLIP (block[2]);
+	    dest[3] = CLIP (block[3]);
+	    dest[4] = CLIP (block[4]);
+	    dest[5] = CLIP (block[5]);
+	    dest[6] = CLIP (block[6]);
+	    dest[7] = CLIP (block[7]);
+
+	    ((int32_t *)block)[0] = 0;	((int32_t *)block)[1] = 0;
+	    ((int32_t *)block)[2] = 0;	((int32_t *)block)[3] = 0;
+
+	    dest += stride;
+	    block += 8;
+	} while (--i);
+    } else {
+	int DC;
+
+	DC = CLIP ((block[0] + 64) >> 7);
+	block[0] = block[63] = 0;
+	i = 8;
+	do {
+	    dest[0] = dest[1] = dest[2] = dest[3] = DC;
+	    dest[4] = dest[5] = dest[6] = dest[7] = DC;
+	    dest += stride;
+	} while (--i);
+    }
+}
+
+static void mpeg2_idct_add_c (const int shape, int16_t * block,
+			      uint8_t * dest, const int stride)
+{
+    int i;
+
+    if (shape != IDCT_DC || (block[0] & (7 << 4)) == (4 << 4)) {
+	idct (shape, block);
+	i = 8;
 	do {
 	    dest[0] = CLIP (block[0] + dest[0]);
 	    dest[1] = CLIP (block[1] + dest[1]);
@@ -233,8 +372,30 @@ static void mpeg2_idct_add_c (const int last, int16_t * block,
     }
 }
 
+/*
+ * The scan tables have been patched by the idct in use, but all of the
+ * patches move the bits of a position around, so the or of the coded
+ * positions tells which natural rows and columns they fall in.
+ */
+static void idct_shape_init (const uint8_t * const scan)
+{
+    uint8_t perm[64];
+    int i, row, half;
+
+    for (i = 0; i < 64; i++)
+	perm[scan[i]] = mpeg2_scan_norm[i];
+    row = perm[0x08] | perm[0x10] | perm[0x20];
+    half = perm[0x20] | perm[0x04];
+    for (i = 0; i < 64; i++)
+	mpeg2_idct_shape[i] = (!i ? IDCT_DC : !(i & row) ? IDCT_ROW :
+			       !(i & half) ? IDCT_4X4 : IDCT_FULL);
+}
+
 void mpeg2_idct_init (uint32_t accel)
 {
+    uint8_t scan[64];
+
+    memcpy (scan, mpeg2_scan_norm, 64);
 #ifdef ARCH_X86
     if (accel & MPEG2_ACCEL_X86_SSE2) {
 	mpeg2_idct_copy = mpeg2_idct_copy_sse2;
@@ -286,4 +447,5 @@ void mpeg2_idct_init (uint32_t accel)
 	    mpeg2_scan_alt[i] = ((j & 0x36) >> 1) | ((j & 0x09) << 2);
 	}
     }
+    idct_shape_init (scan);
 }
@@ -157,7 +157,8 @@ static inline void idct_col (int16_t * const block)
     block[8*7] = (a0 - b0) >> 17;
 }
 
-void mpeg2_idct_copy_mvi (int16_t * block, uint8_t * dest, const int stride)
+void mpeg2_idct_copy_mvi (const int shape, int16_t * block,
+			  uint8_t * dest, const int stride)
 {
     uint64_t clampmask;
     int i;
@@ -190,14 +191,14 @@ void mpeg2_idct_copy_mvi (int16_t * block, uint8_t * dest, const int stride)
     } while (--i);
 }
 
-void mpeg2_idct_add_mvi (const int last, int16_t * block,
+void mpeg2_idct_add_mvi (const int shape, int16_t * block,
 			 uint8_t * dest, const int stride)
 {
     uint64_t clampmask;
     uint64_t signmask;
     int i;
 
-    if (last != 129 || (block[0] & (7 << 4)) == (4 << 4)) {
+    if (shape != IDCT_DC || (block[0] & (7 << 4)) == (4 << 4)) {
 	for (i = 0; i < 8; i++)
 	    idct_row (block + 8 * i);
 	for (i = 0; i < 8; i++)
@@ -290,7 +291,8 @@ void mpeg2_idct_add_mvi (const int last, int16_t * block,
     }
 }
 
-void mpeg2_idct_copy_alpha (int16_t * block, uint8_t * dest, const int stride)
+void mpeg2_idct_copy_alpha (const int shape, int16_t * block,
+			    uint8_t * dest, const int stride)
 {
     int i;
 
@@ -316,12 +318,12 @@ void mpeg2_idct_copy_alpha (int16_t * block, uint8_t * dest, const int stride)
     } while (--i);
 }
 
-void mpeg2_idct_add_alpha (const int last, int16_t * block,
+void mpeg2_idct_add_alpha (const int shape, int16_t * block,
 			   uint8_t * dest, const int stride)
 {
     int i;
 
-    if (last != 129 || (block[0] & (7 << 4)) == (4 << 4)) {
+    if (shape != IDCT_DC || (block[0] & (7 << 4)) == (4 << 4)) {
 	for (i = 0; i < 8; i++)
 	    idct_row (block + 8 * i);
 	for (i = 0; i < 8; i++)
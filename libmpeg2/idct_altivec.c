@@ -204,8 +204,8 @@ static const vector_s16_t constants_4 ATTR_ALIGN(16) =
     vx6 = vec_sra (vy6, shift);						\
     vx7 = vec_sra (vy7, shift);
 
-void mpeg2_idct_copy_altivec (int16_t * const _block, uint8_t * dest,
-			      const int stride)
+void mpeg2_idct_copy_altivec (const int shape, int16_t * const _block,
+			      uint8_t * dest, const int stride)
 {
     vector_s16_t * const block = (vector_s16_t *)_block;
     vector_u8_t tmp;
@@ -230,7 +230,7 @@ void mpeg2_idct_copy_altivec (int16_t * const _block, uint8_t * dest,
     block[4] = block[5] = block[6] = block[7] = zero;
 }
 
-void mpeg2_idct_add_altivec (const int last, int16_t * const _block,
+void mpeg2_idct_add_altivec (const int shape, int16_t * const _block,
 			     uint8_t * dest, const int stride)
 {
     vector_s16_t * const block = (vector_s16_t *)_block;
@@ -134,6 +134,51 @@ static inline void idct_row (int16_t * row, int offset,
     packssdw_r2r (xmm6, row2);       /*    2:                             */ \
 } while (0)
 
+/* SSE2_IDCT_2ROW for a single row */
+#define SSE2_IDCT_ROW(table, row, round) do {                                \
+    pshufd_r2r   (row, xmm1, 0);     /* xmm1= x2 x0 x2 x0  x2 x0 x2 x0    */ \
+    pmaddwd_m2r  (table[0], xmm1);   /* xmm1= x2*C + x0*C ...             */ \
+    pshufd_r2r   (row, xmm3, 0xaa);  /* xmm3= x3 x1 x3 x1  x3 x1 x3 x1    */ \
+    pmaddwd_m2r  (table[2*8], xmm3); /* xmm3= x3*C + x1*C ...             */ \
+    pshufd_r2r   (row, xmm2, 0x55);  /* xmm2= x6 x4 x6 x4  x6 x4 x6 x4    */ \
+    pshufd_r2r   (row, row, 0xff);   /* row= x7 x5 x7 x5  x7 x5 x7 x5     */ \
+    pmaddwd_m2r  (table[1*8], xmm2); /* xmm2= x6*C + x4*C ...             */ \
+    paddd_m2r    (round, xmm1);      /* xmm1= x2*C + x0*C + round ...     */ \
+    pmaddwd_m2r  (table[3*8], row);  /* row= x7*C + x5*C ...              */ \
+    paddd_r2r    (xmm2, xmm1);       /* xmm1= a[]                         */ \
+    movdqa_r2r   (xmm1, xmm2);       /* xmm2= a[]                         */ \
+    paddd_r2r    (xmm3, row);        /* row= b[]= 7*C+5*C+3*C+1*C ...     */ \
+    psubd_r2r    (row, xmm2);        /* xmm2= a[] - b[]                   */ \
+    paddd_r2r    (xmm1, row);        /* row= a[] + b[]                    */ \
+    psrad_i2r    (ROW_SHIFT, xmm2);  /* xmm2= result 4...7                */ \
+    psrad_i2r    (ROW_SHIFT, row);   /* row= result 0...4                 */ \
+    pshufd_r2r   (xmm2, xmm2, 0x1b); /* [0 1 2 3] -> [3 2 1 0]            */ \
+    packssdw_r2r (xmm2, row);        /* row= result[]                     */ \
+} while (0)
+
+/* SSE2_IDCT_ROW when x4 ... x7 are zero: their products drop out */
+#define SSE2_IDCT_ROW_4(table, row, round) do {                              \
+    pshufd_r2r   (row, xmm1, 0);     /* xmm1= x2 x0 x2 x0  x2 x0 x2 x0    */ \
+    pmaddwd_m2r  (table[0], xmm1);   /* xmm1= x2*C + x0*C ...             */ \
+    pshufd_r2r   (row, row, 0xaa);   /* row= x3 x1 x3 x1  x3 x1 x3 x1     */ \
+    pmaddwd_m2r  (table[2*8], row);  /* row= b[]= x3*C + x1*C ...         */ \
+    paddd_m2r    (round, xmm1);      /* xmm1= a[]                         */ \
+    movdqa_r2r   (xmm1, xmm2);       /* xmm2= a[]                         */ \
+    psubd_r2r    (row, xmm2);        /* xmm2= a[] - b[]                   */ \
+    paddd_r2r    (xmm1, row);        /* row= a[] + b[]                    */ \
+    psrad_i2r    (ROW_SHIFT, xmm2);  /* xmm2= result 4...7                */ \
+    psrad_i2r    (ROW_SHIFT, row);   /* row= result 0...4                 */ \
+    pshufd_r2r   (xmm2, xmm2, 0x1b); /* [0 1 2 3] -> [3 2 1 0]            */ \
+    packssdw_r2r (xmm2, row);        /* row= result[]                     */ \
+} while (0)
+
+/* an all-zero row transforms to its rounder, which is not always zero */
+#define SSE2_IDCT_ZERO_ROW(row, round) do {                                  \
+    movdqa_m2r   (round, row);       /* row= round ...                    */ \
+    psrad_i2r    (ROW_SHIFT, row);   /* row= result 0...4                 */ \
+    packssdw_r2r (row, row);         /* row= result[]                     */ \
+} while (0)
+
 
 /* MMXEXT row IDCT */
 
@@ -898,7 +943,7 @@ static inline void idct (int16_t * const block)				\
     idct_col (block, 4);						\
 }
 
-static inline void sse2_idct (int16_t * const block)
+static inline void sse2_idct (const int shape, int16_t * const block)
 {
     static const int16_t table04[] ATTR_ALIGN(16) =
 	sse2_table (22725, 21407, 19266, 16384, 12873,  8867, 4520);
@@ -925,49 +970,110 @@ static inline void sse2_idct (int16_t * const block)
     static const int32_t rounder5_128[] ATTR_ALIGN(16) =
 	rounder_sse2 (-0.441341716183);	/* C3*(-C5/C4+C5-C3)/2 */
 
+    /* the rows a sparse shape leaves out transform to a known result */
 #if defined(__x86_64__)
-    movdqa_m2r (block[0*8], xmm8);
-    movdqa_m2r (block[4*8], xmm12);
-    SSE2_IDCT_2ROW (table04,  xmm8, xmm12, *rounder0_128, *rounder4_128);
-
-    movdqa_m2r (block[1*8], xmm9);
-    movdqa_m2r (block[7*8], xmm15);
-    SSE2_IDCT_2ROW (table17,  xmm9, xmm15, *rounder1_128, *rounder7_128);
-
-    movdqa_m2r (block[2*8], xmm10);
-    movdqa_m2r (block[6*8], xmm14);
-    SSE2_IDCT_2ROW (table26, xmm10, xmm14, *rounder2_128, *rounder6_128);
-
-    movdqa_m2r (block[3*8], xmm11);
-    movdqa_m2r (block[5*8], xmm13);
-    SSE2_IDCT_2ROW (table35, xmm11, xmm13, *rounder3_128, *rounder5_128);
+    if (shape == IDCT_ROW) {
+	movdqa_m2r (block[0*8], xmm8);
+	SSE2_IDCT_ROW (table04, xmm8, *rounder0_128);
+	SSE2_IDCT_ZERO_ROW (xmm9, *rounder1_128);
+	SSE2_IDCT_ZERO_ROW (xmm10, *rounder2_128);
+	SSE2_IDCT_ZERO_ROW (xmm11, *rounder3_128);
+	SSE2_IDCT_ZERO_ROW (xmm12, *rounder4_128);
+	SSE2_IDCT_ZERO_ROW (xmm13, *rounder5_128);
+	SSE2_IDCT_ZERO_ROW (xmm14, *rounder6_128);
+	SSE2_IDCT_ZERO_ROW (xmm15, *rounder7_128);
+    } else if (shape == IDCT_4X4) {
+	movdqa_m2r (block[0*8], xmm8);
+	SSE2_IDCT_ROW_4 (table04, xmm8, *rounder0_128);
+	movdqa_m2r (block[1*8], xmm9);
+	SSE2_IDCT_ROW_4 (table17, xmm9, *rounder1_128);
+	movdqa_m2r (block[2*8], xmm10);
+	SSE2_IDCT_ROW_4 (table26, xmm10, *rounder2_128);
+	movdqa_m2r (block[3*8], xmm11);
+	SSE2_IDCT_ROW_4 (table35, xmm11, *rounder3_128);
+	SSE2_IDCT_ZERO_ROW (xmm12, *rounder4_128);
+	SSE2_IDCT_ZERO_ROW (xmm13, *rounder5_128);
+	SSE2_IDCT_ZERO_ROW (xmm14, *rounder6_128);
+	SSE2_IDCT_ZERO_ROW (xmm15, *rounder7_128);
+    } else {
+	movdqa_m2r (block[0*8], xmm8);
+	movdqa_m2r (block[4*8], xmm12);
+	SSE2_IDCT_2ROW (table04,  xmm8, xmm12, *rounder0_128, *rounder4_128);
+
+	movdqa_m2r (block[1*8], xmm9);
+	movdqa_m2r (block[7*8], xmm15);
+	SSE2_IDCT_2ROW (table17,  xmm9, xmm15, *rounder1_128, *rounder7_128);
+
+	movdqa_m2r (block[2*8], xmm10);
+	movdqa_m2r (block[6*8], xmm14);
+	SSE2_IDCT_2ROW (table26, xmm10, xmm14, *rounder2_128, *rounder6_128);
+
+	movdqa_m2r (block[3*8], xmm11);
+	movdqa_m2r (block[5*8], xmm13);
+	SSE2_IDCT_2ROW (table35, xmm11, xmm13, *rounder3_128, *rounder5_128);
+    }
 
     /* OUTPUT: block in xmm8 ... xmm15 */
 
 #else
-    movdqa_m2r (block[0*8], xmm0);
-    movdqa_m2r (block[4*8], xmm4);
-    SSE2_IDCT_2ROW (table04, xmm0, xmm4, *rounder0_128, *rounder4_128);
-    movdqa_r2m (xmm0, block[0*8]);
-    movdqa_r2m (xmm4, block[4*8]);
-
-    movdqa_m2r (block[1*8], xmm0);
-    movdqa_m2r (block[7*8], xmm4);
-    SSE2_IDCT_2ROW (table17, xmm0, xmm4, *rounder1_128, *rounder7_128);
-    movdqa_r2m (xmm0, block[1*8]);
-    movdqa_r2m (xmm4, block[7*8]);
-
-    movdqa_m2r (block[2*8], xmm0);
-    movdqa_m2r (block[6*8], xmm4);
-    SSE2_IDCT_2ROW (table26, xmm0, xmm4, *rounder2_128, *rounder6_128);
-    movdqa_r2m (xmm0, block[2*8]);
-    movdqa_r2m (xmm4, block[6*8]);
-
-    movdqa_m2r (block[3*8], xmm0);
-    movdqa_m2r (block[5*8], xmm4);
-    SSE2_IDCT_2ROW (table35, xmm0, xmm4, *rounder3_128, *rounder5_128);
-    movdqa_r2m (xmm0, block[3*8]);
-    movdqa_r2m (xmm4, block[5*8]);
+    if (shape == IDCT_ROW) {
+	movdqa_m2r (block[0*8], xmm0);
+	SSE2_IDCT_ROW (table04, xmm0, *rounder0_128);
+	movdqa_r2m (xmm0, block[0*8]);
+	SSE2_IDCT_ZERO_ROW (xmm0, *rounder1_128);
+	movdqa_r2m (xmm0, block[1*8]);
+	SSE2_IDCT_ZERO_ROW (xmm0, *rounder2_128);
+	movdqa_r2m (xmm0, block[2*8]);
+	SSE2_IDCT_ZERO_ROW (xmm0, *rounder3_128);
+	movdqa_r2m (xmm0, block[3*8]);
+    } else if (shape == IDCT_4X4) {
+	movdqa_m2r (block[0*8], xmm0);
+	SSE2_IDCT_ROW_4 (table04, xmm0, *rounder0_128);
+	movdqa_r2m (xmm0, block[0*8]);
+	movdqa_m2r (block[1*8], xmm0);
+	SSE2_IDCT_ROW_4 (table17, xmm0, *rounder1_128);
+	movdqa_r2m (xmm0, block[1*8]);
+	movdqa_m2r (block[2*8], xmm0);
+	SSE2_IDCT_ROW_4 (table26, xmm0, *rounder2_128);
+	movdqa_r2m (xmm0, block[2*8]);
+	movdqa_m2r (block[3*8], xmm0);
+	SSE2_IDCT_ROW_4 (table35, xmm0, *rounder3_128);
+	movdqa_r2m (xmm0, block[3*8]);
+    }
+    if (shape == IDCT_ROW || shape == IDCT_4X4) {
+	SSE2_IDCT_ZERO_ROW (xmm4, *rounder4_128);
+	movdqa_r2m (xmm4, block[4*8]);
+	SSE2_IDCT_ZERO_ROW (xmm4, *rounder5_128);
+	movdqa_r2m (xmm4, block[5*8]);
+	SSE2_IDCT_ZERO_ROW (xmm4, *rounder6_128);
+	movdqa_r2m (xmm4, block[6*8]);
+	SSE2_IDCT_ZERO_ROW (xmm4, *rounder7_128);
+	movdqa_r2m (xmm4, block[7*8]);
+    } else {
+	movdqa_m2r (block[0*8], xmm0);
+	movdqa_m2r (block[4*8], xmm4);
+	SSE2_IDCT_2ROW (table04, xmm0, xmm4, *rounder0_128, *rounder4_128);
+	movdqa_r2m (xmm0, block[0*8]);
+	movdqa_r2m (xmm4, block[4*8]);
+
+	movdqa_m2r (block[1*8], xmm0);
+	movdqa_m2r (block[7*8], xmm4);
+	SSE2_IDCT_2ROW (table17, xmm0, xmm4, *rounder1_128, *rounder7_128);
+	movdqa_r2m (xmm0, block[1*8]);
+	movdqa_r2m (xmm4, block[7*8]);
+
+	movdqa_m2r (block[2*8], xmm0);
+	movdqa_m2r (block[6*8], xmm4);
+	SSE2_IDCT_2ROW (table26, xmm0, xmm4, *rounder2_128, *rounder6_128);
+	movdqa_r2m (xmm0, block[2*8]);
+	movdqa_r2m (xmm4, block[6*8]);
+
+	movdqa_m2r (block[3*8], xmm0);
+	movdqa_m2r (block[5*8], xmm4);
+	SSE2_IDCT_2ROW (table35, xmm0, xmm4, *rounder3_128, *rounder5_128);
+	movdqa_r2m (xmm0, block[3*8]);
+	movdqa_r2m (xmm4, block[5*8]);
+    }
 #endif
 
     sse2_idct_col (block);
@@ -1222,19 +1328,42 @@ static inline void block_add_DC (int16_t * const block, uint8_t * dest,
     movq_r2m (mm3, *(dest + 2*stride));
 }
 
-void mpeg2_idct_copy_sse2 (int16_t * const block, uint8_t * const dest,
-			   const int stride)
+static inline void block_copy_DC (int16_t * const block, uint8_t * dest,
+				  const int stride, const int cpu)
+{
+    movd_v2r ((block[0] + 64) >> 7, mm0);
+    dup4 (mm0);
+    packuswb_r2r (mm0, mm0);
+    block[0] = block[63] = 0;
+    movq_r2m (mm0, *dest);
+    movq_r2m (mm0, *(dest + stride));
+    dest += 2*stride;
+    movq_r2m (mm0, *dest);
+    movq_r2m (mm0, *(dest + stride));
+    dest += 2*stride;
+    movq_r2m (mm0, *dest);
+    movq_r2m (mm0, *(dest + stride));
+    dest += 2*stride;
+    movq_r2m (mm0, *dest);
+    movq_r2m (mm0, *(dest + stride));
+}
+
+void mpeg2_idct_copy_sse2 (const int shape, int16_t * const block,
+			   uint8_t * const dest, const int stride)
 {
-    sse2_idct (block);
-    sse2_block_copy (block, dest, stride);
-    sse2_block_zero (block);
+    if (shape != IDCT_DC || (block[0] & (7 << 4)) == (4 << 4)) {
+	sse2_idct (shape, block);
+	sse2_block_copy (block, dest, stride);
+	sse2_block_zero (block);
+    } else
+	block_copy_DC (block, dest, stride, CPU_MMXEXT);
 }
 
-void mpeg2_idct_add_sse2 (const int last, int16_t * const block,
+void mpeg2_idct_add_sse2 (const int shape, int16_t * const block,
 			  uint8_t * const dest, const int stride)
 {
-    if (last != 129 || (block[0] & (7 << 4)) == (4 << 4)) {
-	sse2_idct (block);
+    if (shape != IDCT_DC || (block[0] & (7 << 4)) == (4 << 4)) {
+	sse2_idct (shape, block);
 	sse2_block_add (block, dest, stride);
 	sse2_block_zero (block);
     } else
@@ -1245,18 +1374,21 @@ void mpeg2_idct_add_sse2 (const int last, int16_t * const block,
 declare_idct (mmxext_idct, mmxext_table,
 	      mmxext_row_head, mmxext_row, mmxext_row_tail, mmxext_row_mid)
 
-void mpeg2_idct_copy_mmxext (int16_t * const block, uint8_t * const dest,
-			     const int stride)
+void mpeg2_idct_copy_mmxext (const int shape, int16_t * const block,
+			     uint8_t * const dest, const int stride)
 {
-    mmxext_idct (block);
-    block_copy (block, dest, stride);
-    block_zero (block);
+    if (shape != IDCT_DC || (block[0] & (7 << 4)) == (4 << 4)) {
+	mmxext_idct (block);
+	block_copy (block, dest, stride);
+	block_zero (block);
+    } else
+	block_copy_DC (block, dest, stride, CPU_MMXEXT);
 }
 
-void mpeg2_idct_add_mmxext (const int last, int16_t * const block,
+void mpeg2_idct_add_mmxext (const int shape, int16_t * const block,
 			    uint8_t * const dest, const int stride)
 {
-    if (last != 129 || (block[0] & (7 << 4)) == (4 << 4)) {
+    if (shape != IDCT_DC || (block[0] & (7 << 4)) == (4 << 4)) {
 	mmxext_idct (block);
 	block_add (block, dest, stride);
 	block_zero (block);
@@ -1268,18 +1400,21 @@ void mpeg2_idct_add_mmxext (const int last, int16_t * const block,
 declare_idct (mmx_idct, mmx_table,
 	      mmx_row_head, mmx_row, mmx_row_tail, mmx_row_mid)
 
-void mpeg2_idct_copy_mmx (int16_t * const block, uint8_t * const dest,
-			  const int stride)
+void mpeg2_idct_copy_mmx (const int shape, int16_t * const block,
+			  uint8_t * const dest, const int stride)
 {
-    mmx_idct (block);
-    block_copy (block, dest, stride);
-    block_zero (block);
+    if (shape != IDCT_DC || (block[0] & (7 << 4)) == (4 << 4)) {
+	mmx_idct (block);
+	block_copy (block, dest, stride);
+	block_zero (block);
+    } else
+	block_copy_DC (block, dest, stride, CPU_MMX);
 }
 
-void mpeg2_idct_add_mmx (const int last, int16_t * const block,
+void mpeg2_idct_add_mmx (const int shape, int16_t * const block,
 			 uint8_t * const dest, const int stride)
 {
-    if (last != 129 || (block[0] & (7 << 4)) == (4 << 4)) {
+    if (shape != IDCT_DC || (block[0] & (7 << 4)) == (4 << 4)) {
 	mmx_idct (block);
 	block_add (block, dest, stride);
 	block_zero (block);
@@ -54,6 +54,45 @@
 #define B_TYPE 3
 #define D_TYPE 4
 
+/* optional per-stage statistics, see --enable-stats */
+#ifdef LIBMPEG2_STATS
+#define STATS(x) x
+#ifdef ARCH_X86
+#define STATS_FLAGS 0
+static inline uint64_t stats_clock (void)
+{
+    uint32_t lo, hi;
+
+    __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t) hi << 32) | lo;
+}
+#else
+#include <time.h>
+#define STATS_FLAGS MPEG2_STATS_NANOSECONDS
+static inline uint64_t stats_clock (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#endif
+#else
+#define STATS(x)
+#endif
+
+/* USDT probes for perf and bpftrace, a nop each unless traced */
+#ifdef LIBMPEG2_PROBES
+#include <sys/sdt.h>
+#define PROBE1(name,a) DTRACE_PROBE1 (libmpeg2, name, a)
+#define PROBE2(name,a,b) DTRACE_PROBE2 (libmpeg2, name, a, b)
+#define PROBE3(name,a,b,c) DTRACE_PROBE3 (libmpeg2, name, a, b, c)
+#else
+#define PROBE1(name,a)
+#define PROBE2(name,a,b)
+#define PROBE3(name,a,b,c)
+#endif
+
 typedef struct mpeg2_decoder_s mpeg2_decoder_t;
 
 typedef void mpeg2_mc_fct (uint8_t *, const uint8_t *, int, int);
@@ -65,22 +104,33 @@ typedef struct {
     int f_code[2];
 } motion_t;
 
+/*
+ * The bit parsing state of a slice. It lives on the stack of the slice
+ * loop and is handed down to the functions that parse macroblocks,
+ * rather than being kept in mpeg2_decoder_t.
+ */
+typedef struct {
+    uint32_t buf;		/* current 32 bit working set */
+    int bits;			/* used bits in working set */
+    const uint8_t * ptr;	/* buffer with stream data */
+} bitstream_t;
+
 typedef void motion_parser_t (mpeg2_decoder_t * decoder,
-			      motion_t * motion,
+			      bitstream_t * bs, motion_t * motion,
 			      mpeg2_mc_fct * const * table);
 
+typedef void slice_parser_t (mpeg2_decoder_t * decoder, int code,
+			     const uint8_t * buffer);
+
 struct mpeg2_decoder_s {
     /* first, state that carries information from one macroblock to the */
     /* next inside a slice, and is never used outside of mpeg2_slice() */
 
-    /* bit parsing stuff */
-    uint32_t bitstream_buf;		/* current 32 bit working set */
-    int bitstream_bits;			/* used bits in working set */
-    const uint8_t * bitstream_ptr;	/* buffer with stream data */
-
     uint8_t * dest[3];
 
     int offset;
+    /* offset of the macroblock in the luma and chroma dest rows */
+    int dest_x[2];
     int stride;
     int uv_stride;
     int slice_stride;
@@ -89,7 +139,17 @@ struct mpeg2_decoder_s {
     unsigned int limit_x;
     unsigned int limit_y_16;
     unsigned int limit_y_8;
+    unsigned int limit_y_field;
     unsigned int limit_y;
+    /* how far, in half pels, motion may reach into the reference borders */
+    int pad_x;
+    int pad_y;
+    int pad_y_field;
+    /* in tiled pictures, column x of a luma or chroma reference row */
+    /* is stored at (x >> tile_shift) * tile_size + (x & tile_mask) */
+    int tile_shift[2];
+    int tile_mask[2];
+    int tile_size[2];
 
     /* Motion vectors */
     /* The f_ and b_ correspond to the forward and backward motion */
@@ -97,6 +157,7 @@ struct mpeg2_decoder_s {
     motion_t b_motion;
     motion_t f_motion;
     motion_parser_t * motion_parser[5];
+    slice_parser_t * slice_parser;
 
     /* predictor for DC coefficients in intra blocks */
     int16_t dc_dct_pred[3];
@@ -105,6 +166,11 @@ struct mpeg2_decoder_s {
     int16_t DCTblock[64] ATTR_ALIGN(64);
 
     uint8_t * picture_dest[3];
+    /* raster copy of a tiled picture, for output */
+    uint8_t * tiled_out[3];
+    int tiled_out_stride;
+    /* rows copied out in order so far, or -1 after an out of order one */
+    int tiled_rows;
     void (* convert) (void * convert_id, uint8_t * const * src,
 		      unsigned int v_offset);
     void * convert_id;
@@ -112,17 +178,30 @@ struct mpeg2_decoder_s {
     int dmv_offset;
     unsigned int v_offset;
 
+    /* macroblocks the rest of this picture may still decode */
+    int mb_budget;
+
     /* now non-slice-specific information */
 
     /* sequence header stuff */
     uint16_t * quantizer_matrix[4];
-    uint16_t (* chroma_quantizer[2])[64];
-    uint16_t quantizer_prescale[4][32][64];
+    /* which prescaled matrix the intra and non-intra chroma blocks use */
+    int chroma_quantizer[2];
+    /* quantizer_scale_code values whose rows below are up to date */
+    uint32_t prescaled;
+    int q_scale_type;
+    const uint8_t (* quantizer_source)[64];
+    /* the 4 matrices for each quantizer_scale_code, filled in on demand */
+    uint16_t quantizer_prescale[32][4][64];
 
     /* The width and height of the picture snapped to macroblock units */
     int width;
     int vertical_position_extension;
     int chroma_format;
+    /* replicated border around the frame buffers, in luma pixels */
+    int border;
+    /* decode into column tiles, see tile_row() */
+    int tiled;
 
     /* picture header stuff */
 
@@ -154,13 +233,28 @@ struct mpeg2_decoder_s {
 
     int mpeg1;
 
-    int8_t scaled[4];
+#ifdef LIBMPEG2_STATS
+    mpeg2_stats_t stats;
+#endif
 };
 
 typedef struct {
     mpeg2_fbuf_t fbuf;
+    uint8_t * mem[3];	/* start of each allocation, before the border */
+    uint8_t * tiles[3];	/* tiled copy the decoder works on, or NULL */
 } fbuf_alloc_t;
 
+/* live buffers of one decoder: itself, the chunk buffer twice while it */
+/* grows, three fbufs and their tiles, yuv_buf and the convert id */
+#define MAX_ALLOCS 32
+
+typedef struct {
+    void * buf;
+    unsigned int size;
+    mpeg2_alloc_t reason;
+    int allocator;	/* from the allocator of the decoder */
+} alloc_entry_t;
+
 typedef struct {
     int f_code[2][2];
     int q_scale_type;
@@ -173,6 +267,13 @@ typedef struct {
     int matrix_updates;
 } coding_t;
 
+#define MPEG2_TIMESTAMPS 8
+
+typedef struct {
+    uint32_t pos;	/* bytes_parsed when the timestamps were given */
+    int64_t pts, dts;
+} timestamp_t;
+
 struct mpeg2dec_s {
     mpeg2_decoder_t decoder;
 
@@ -184,8 +285,10 @@ struct mpeg2dec_s {
     mpeg2_state_t state;
     uint32_t ext_state;
 
-    /* allocated in init - gcc has problems allocating such big structures */
+    /* allocated in init, grown while parsing large chunks */
     uint8_t * chunk_buffer;
+    /* its size, not counting the 4 bytes of padding at the end */
+    int chunk_size;
     /* pointer to start of the current chunk */
     uint8_t * chunk_start;
     /* pointer to current position in chunk_buffer */
@@ -196,7 +299,15 @@ struct mpeg2dec_s {
     /* picture tags */
     uint32_t tag_current, tag2_current, tag_previous, tag2_previous;
     int num_tags;
-    int bytes_since_tag;
+    uint32_t tag_pos;
+    /* bytes consumed from the user buffers so far */
+    uint32_t bytes_parsed;
+
+    /* timestamps waiting for their picture start code */
+    timestamp_t timestamps[MPEG2_TIMESTAMPS];
+    int first_timestamp, num_timestamps;
+    /* pts of the next picture to display, if it has none, or -1 */
+    int64_t next_pts;
 
     int first;
     int alloc_index_user;
@@ -218,9 +329,16 @@ struct mpeg2dec_s {
 
     fbuf_alloc_t fbuf_alloc[3];
     int custom_fbuf;
+    int border;
+    int tiled;
+    int alloc_policy;
+    mpeg2_allocator_t allocator;
+    alloc_entry_t allocs[MAX_ALLOCS];
+    mpeg2_memory_t memory;
 
     uint8_t * yuv_buf[3][3];
     int yuv_index;
+    int yuv_rows;		/* rows of the B picture strip yuv_buf[2] */
     mpeg2_convert_t * convert;
     void * convert_arg;
     unsigned int convert_id_size;
@@ -245,6 +363,12 @@ typedef struct {
     int dummy;
 } cpu_state_t;
 
+/* alloc.c */
+void * mpeg2_malloc_decoder (mpeg2dec_t * mpeg2dec, unsigned size,
+			     mpeg2_alloc_t reason);
+void mpeg2_free_decoder (mpeg2dec_t * mpeg2dec, void * buf);
+mpeg2dec_t * mpeg2_malloc_mpeg2dec (const mpeg2_allocator_t * allocator);
+
 /* cpu_accel.c */
 uint32_t mpeg2_detect_accel (uint32_t accel);
 
@@ -275,43 +399,63 @@ void mpeg2_set_fbuf (mpeg2dec_t * mpeg2dec, int b_type);
 extern void mpeg2_idct_init (uint32_t accel);
 extern uint8_t mpeg2_scan_norm[64];
 extern uint8_t mpeg2_scan_alt[64];
+extern uint8_t mpeg2_idct_shape[64];
+
+/* block shapes, by where the coded coefficients are */
+#define IDCT_DC 0	/* dc coefficient only */
+#define IDCT_ROW 1	/* first row only */
+#define IDCT_4X4 2	/* top-left 4x4 corner only */
+#define IDCT_FULL 3
 
 /* idct_mmx.c */
-void mpeg2_idct_copy_sse2 (int16_t * block, uint8_t * dest, int stride);
-void mpeg2_idct_add_sse2 (int last, int16_t * block,
+void mpeg2_idct_copy_sse2 (int shape, int16_t * block,
+			   uint8_t * dest, int stride);
+void mpeg2_idct_add_sse2 (int shape, int16_t * block,
 			  uint8_t * dest, int stride);
-void mpeg2_idct_copy_mmxext (int16_t * block, uint8_t * dest, int stride);
-void mpeg2_idct_add_mmxext (int last, int16_t * block,
+void mpeg2_idct_copy_mmxext (int shape, int16_t * block,
+			     uint8_t * dest, int stride);
+void mpeg2_idct_add_mmxext (int shape, int16_t * block,
 			    uint8_t * dest, int stride);
-void mpeg2_idct_copy_mmx (int16_t * block, uint8_t * dest, int stride);
-void mpeg2_idct_add_mmx (int last, int16_t * block,
+void mpeg2_idct_copy_mmx (int shape, int16_t * block,
+			  uint8_t * dest, int stride);
+void mpeg2_idct_add_mmx (int shape, int16_t * block,
 			 uint8_t * dest, int stride);
 void mpeg2_idct_mmx_init (void);
 
 /* idct_altivec.c */
-void mpeg2_idct_copy_altivec (int16_t * block, uint8_t * dest, int stride);
-void mpeg2_idct_add_altivec (int last, int16_t * block,
+void mpeg2_idct_copy_altivec (int shape, int16_t * block,
+			      uint8_t * dest, int stride);
+void mpeg2_idct_add_altivec (int shape, int16_t * block,
 			     uint8_t * dest, int stride);
 void mpeg2_idct_altivec_init (void);
 
 /* idct_alpha.c */
-void mpeg2_idct_copy_mvi (int16_t * block, uint8_t * dest, int stride);
-void mpeg2_idct_add_mvi (int last, int16_t * block,
+void mpeg2_idct_copy_mvi (int shape, int16_t * block,
+			  uint8_t * dest, int stride);
+void mpeg2_idct_add_mvi (int shape, int16_t * block,
 			 uint8_t * dest, int stride);
-void mpeg2_idct_copy_alpha (int16_t * block, uint8_t * dest, int stride);
-void mpeg2_idct_add_alpha (int last, int16_t * block,
+void mpeg2_idct_copy_alpha (int shape, int16_t * block,
+			    uint8_t * dest, int stride);
+void mpeg2_idct_add_alpha (int shape, int16_t * block,
 			   uint8_t * dest, int stride);
 void mpeg2_idct_alpha_init (void);
 
 /* motion_comp.c */
 void mpeg2_mc_init (uint32_t accel);
 
+/* tiled reference frames: tiles of 1 << TILE_SHIFT luma columns, each */
+/* followed by a copy of the first macroblock column of the next one */
+#define TILE_SHIFT 6
+#define TILE_STRIDE ((1 << TILE_SHIFT) + 16)
+
 /* slice.c */
 void mpeg2_init_fbuf (mpeg2_decoder_t * decoder, mpeg2_sequence_t * sequence,
 		      mpeg2_picture_t * picture, coding_t * coding,
 		      uint8_t * current_fbuf[3],
 		      uint8_t * forward_fbuf[3], uint8_t * backward_fbuf[3]);
 void mpeg2_slice (mpeg2_decoder_t * decoder, int code, const uint8_t * buffer);
+void mpeg2_tile_picture (mpeg2_decoder_t * decoder);
+void mpeg2_vlc_init (void);
 
 typedef struct {
     mpeg2_mc_fct * put [8];
@@ -24,6 +24,8 @@
 
 #include "config.h"
 
+#include <stdlib.h>
+#include <string.h>
 #include <inttypes.h>
 
 #include "mpeg2.h"
@@ -31,19 +33,98 @@
 #include "mpeg2_internal.h"
 
 extern mpeg2_mc_t mpeg2_mc;
-extern void (* mpeg2_idct_copy) (int16_t * block, uint8_t * dest, int stride);
-extern void (* mpeg2_idct_add) (int last, int16_t * block,
+extern void (* mpeg2_idct_copy) (int shape, int16_t * block,
+				 uint8_t * dest, int stride);
+extern void (* mpeg2_idct_add) (int shape, int16_t * block,
 				uint8_t * dest, int stride);
 extern void (* mpeg2_cpu_state_save) (cpu_state_t * state);
 extern void (* mpeg2_cpu_state_restore) (cpu_state_t * state);
 
 #include "vlc.h"
 
-static inline int get_macroblock_modes (mpeg2_decoder_t * const decoder)
+/* statistics: idct counts by block shape, mc counts by kernel */
+#ifdef LIBMPEG2_STATS
+#define MC_CALL(table,index) \
+    (((table) == mpeg2_mc.avg ? \
+      decoder->stats.mc_avg : decoder->stats.mc_put)[index]++, \
+     (table)[index])
+#else
+#define MC_CALL(table,index) (table)[index]
+#endif
+
+/*
+ * A picture may decode at most MB_BUDGET times as many macroblocks as
+ * it has. Valid streams decode each one once, but corrupted ones can
+ * repeat slices or skip over the whole picture with a few bytes of
+ * macroblock escapes, and this keeps their decoding time linear.
+ */
+#define MB_BUDGET 2
+
+/*
+ * Most coefficients use the shortest codes, and PAIR_BITS often hold two
+ * of them. These tables give the code at the start of the bits looked up
+ * as the B14 AC and B15 tables do, along with the code after it when that
+ * one fits in the bits looked up too, so that both decode at once.
+ */
+#define PAIR_BITS 10
+static DCTpair DCT_B14AC_pair[(1 << PAIR_BITS) - 160];
+static DCTpair DCT_B15_pair[(1 << PAIR_BITS) - 16];
+
+static const DCTtab * get_B14_code (const uint32_t bit_buf)
+{
+    if (bit_buf >= 0x28000000)
+	return DCT_B14AC_5 + (UBITS (bit_buf, 5) - 5);
+    else if (bit_buf >= 0x04000000)
+	return DCT_B14_8 + (UBITS (bit_buf, 8) - 4);
+    return NULL;
+}
+
+static const DCTtab * get_B15_code (const uint32_t bit_buf)
+{
+    if (bit_buf >= 0x04000000)
+	return DCT_B15_8 + (UBITS (bit_buf, 8) - 4);
+    return NULL;
+}
+
+static void pair_init (DCTpair * pair, uint32_t index,
+		       const DCTtab * (* get_code) (uint32_t))
+{
+    const DCTtab * tab;
+    uint32_t bit_buf;
+
+    for (; index < (1 << PAIR_BITS); index++, pair++) {
+	bit_buf = index << (32 - PAIR_BITS);
+	tab = get_code (bit_buf);
+	pair->tab[0] = *tab;
+	pair->tab[1].run = pair->tab[1].level = pair->tab[1].len = 0;
+	pair->run = (tab->run < 65) ? tab->run : 255;
+	pair->len = tab->len + 1;
+	pair->mask = 0;
+	if (tab->run >= 65)	/* escape or end of block */
+	    continue;
+	tab = get_code (bit_buf << pair->len);
+	if (tab != NULL && tab->run < 65 &&
+	    pair->len + tab->len + 1 <= PAIR_BITS) {
+	    pair->tab[1] = *tab;
+	    pair->run += tab->run;
+	    pair->len += tab->len + 1;
+	    pair->mask = -1;
+	}
+    }
+}
+
+void mpeg2_vlc_init (void)
+{
+    pair_init (DCT_B14AC_pair, 160, get_B14_code);
+    pair_init (DCT_B15_pair, 16, get_B15_code);
+}
+
+static inline int get_macroblock_modes (mpeg2_decoder_t * const decoder,
+					bitstream_t * const bs)
 {
-#define bit_buf (decoder->bitstream_buf)
-#define bits (decoder->bitstream_bits)
-#define bit_ptr (decoder->bitstream_ptr)
+#define bit_buf (bs->buf)
+#define bits (bs->bits)
+#define bit_ptr (bs->ptr)
     int macroblock_modes;
     const MBtab * tab;
 
@@ -132,36 +213,57 @@ static inline int get_macroblock_modes (mpeg2_decoder_t * const decoder)
 #undef bit_ptr
 }
 
-static inline void get_quantizer_scale (mpeg2_decoder_t * const decoder)
+/* fill in the prescaled matrices used by one quantizer_scale_code */
+static void prescale (mpeg2_decoder_t * const decoder, const int code)
 {
-#define bit_buf (decoder->bitstream_buf)
-#define bits (decoder->bitstream_bits)
-#define bit_ptr (decoder->bitstream_ptr)
+    static const uint8_t non_linear_scale [] = {
+	 0,  1,  2,  3,  4,  5,   6,   7,
+	 8, 10, 12, 14, 16, 18,  20,  22,
+	24, 28, 32, 36, 40, 44,  48,  52,
+	56, 64, 72, 80, 88, 96, 104, 112
+    };
+    uint16_t (* const row)[64] = decoder->quantizer_prescale[code];
+    int idx, j, k;
+
+    decoder->prescaled |= 1U << code;
+    k = decoder->q_scale_type ? non_linear_scale[code] : (code << 1);
+    for (idx = 0; idx < 4; idx++)
+	if (idx < 2 || decoder->chroma_quantizer[idx - 2] == idx)
+	    for (j = 0; j < 64; j++)
+		row[idx][mpeg2_scan_norm[j]] =
+		    k * decoder->quantizer_source[idx][j];
+}
+
+static inline void get_quantizer_scale (mpeg2_decoder_t * const decoder,
+					bitstream_t * const bs)
+{
+#define bit_buf (bs->buf)
+#define bits (bs->bits)
+#define bit_ptr (bs->ptr)
 
     int quantizer_scale_code;
+    uint16_t (* row)[64];
 
     quantizer_scale_code = UBITS (bit_buf, 5);
     DUMPBITS (bit_buf, bits, 5);
 
-    decoder->quantizer_matrix[0] =
-	decoder->quantizer_prescale[0][quantizer_scale_code];
-    decoder->quantizer_matrix[1] =
-	decoder->quantizer_prescale[1][quantizer_scale_code];
-    decoder->quantizer_matrix[2] =
-	decoder->chroma_quantizer[0][quantizer_scale_code];
-    decoder->quantizer_matrix[3] =
-	decoder->chroma_quantizer[1][quantizer_scale_code];
+    if (unlikely (!(decoder->prescaled & (1U << quantizer_scale_code))))
+	prescale (decoder, quantizer_scale_code);
+    row = decoder->quantizer_prescale[quantizer_scale_code];
+    decoder->quantizer_matrix[0] = row[0];
+    decoder->quantizer_matrix[1] = row[1];
+    decoder->quantizer_matrix[2] = row[decoder->chroma_quantizer[0]];
+    decoder->quantizer_matrix[3] = row[decoder->chroma_quantizer[1]];
 #undef bit_buf
 #undef bits
 #undef bit_ptr
 }
 
-static inline int get_motion_delta (mpeg2_decoder_t * const decoder,
-				    const int f_code)
+static inline int get_motion_delta (bitstream_t * const bs, const int f_code)
 {
-#define bit_buf (decoder->bitstream_buf)
-#define bits (decoder->bitstream_bits)
-#define bit_ptr (decoder->bitstream_ptr)
+#define bit_buf (bs->buf)
+#define bits (bs->bits)
+#define bit_ptr (bs->ptr)
 
     int delta;
     int sign;
@@ -215,11 +317,11 @@ static inline int bound_motion_vector (const int vector, const int f_code)
     return ((int32_t)vector << (27 - f_code)) >> (27 - f_code);
 }
 
-static inline int get_dmv (mpeg2_decoder_t * const decoder)
+static inline int get_dmv (bitstream_t * const bs)
 {
-#define bit_buf (decoder->bitstream_buf)
-#define bits (decoder->bitstream_bits)
-#define bit_ptr (decoder->bitstream_ptr)
+#define bit_buf (bs->buf)
+#define bits (bs->bits)
+#define bit_ptr (bs->ptr)
 
     const DMVtab * tab;
 
@@ -231,11 +333,11 @@ static inline int get_dmv (mpeg2_decoder_t * const decoder)
 #undef bit_ptr
 }
 
-static inline int get_coded_block_pattern (mpeg2_decoder_t * const decoder)
+static inline int get_coded_block_pattern (bitstream_t * const bs)
 {
-#define bit_buf (decoder->bitstream_buf)
-#define bits (decoder->bitstream_bits)
-#define bit_ptr (decoder->bitstream_ptr)
+#define bit_buf (bs->buf)
+#define bits (bs->bits)
+#define bit_ptr (bs->ptr)
 
     const CBPtab * tab;
 
@@ -259,11 +361,12 @@ static inline int get_coded_block_pattern (mpeg2_decoder_t * const decoder)
 #undef bit_ptr
 }
 
-static inline int get_luma_dc_dct_diff (mpeg2_decoder_t * const decoder)
+static inline int get_luma_dc_dct_diff (mpeg2_decoder_t * const decoder,
+					 bitstream_t * const bs)
 {
-#define bit_buf (decoder->bitstream_buf)
-#define bits (decoder->bitstream_bits)
-#define bit_ptr (decoder->bitstream_ptr)
+#define bit_buf (bs->buf)
+#define bits (bs->bits)
+#define bit_ptr (bs->ptr)
     const DCtab * tab;
     int size;
     int dc_diff;
@@ -296,11 +399,12 @@ static inline int get_luma_dc_dct_diff (mpeg2_decoder_t * const decoder)
 #undef bit_ptr
 }
 
-static inline int get_chroma_dc_dct_diff (mpeg2_decoder_t * const decoder)
+static inline int get_chroma_dc_dct_diff (mpeg2_decoder_t * const decoder,
+					   bitstream_t * const bs)
 {
-#define bit_buf (decoder->bitstream_buf)
-#define bits (decoder->bitstream_bits)
-#define bit_ptr (decoder->bitstream_ptr)
+#define bit_buf (bs->buf)
+#define bits (bs->bits)
+#define bit_ptr (bs->ptr)
     const DCtab * tab;
     int size;
     int dc_diff;
@@ -340,33 +444,71 @@ do {						\
 	val = (SBITS (val, 1) ^ 2047) << 4;	\
 } while (0)
 
-static void get_intra_block_B14 (mpeg2_decoder_t * const decoder,
-				 const uint16_t * const quant_matrix)
+static int get_intra_block_B14 (mpeg2_decoder_t * const decoder,
+				bitstream_t * const bs,
+				const uint16_t * const quant_matrix)
 {
     int i;
-    int j;
-    int val;
+    int j, j2;
+    int val, val2, sign;
+    int coded;
     const uint8_t * const scan = decoder->scan;
     int mismatch;
     const DCTtab * tab;
+    const DCTpair * pair;
     uint32_t bit_buf;
     int bits;
     const uint8_t * bit_ptr;
     int16_t * const dest = decoder->DCTblock;
 
     i = 0;
+    coded = 0;
     mismatch = ~dest[0];
 
-    bit_buf = decoder->bitstream_buf;
-    bits = decoder->bitstream_bits;
-    bit_ptr = decoder->bitstream_ptr;
+    bit_buf = bs->buf;
+    bits = bs->bits;
+    bit_ptr = bs->ptr;
 
     NEEDBITS (bit_buf, bits, bit_ptr);
 
     while (1) {
 	if (bit_buf >= 0x28000000) {
 
-	    tab = DCT_B14AC_5 + (UBITS (bit_buf, 5) - 5);
+	    pair = DCT_B14AC_pair + (UBITS (bit_buf, PAIR_BITS) - 160);
+
+	    if (i + pair->run < 64) {
+		/*
+		 * One or two short codes. A missing second code has no
+		 * run and no level, and its coefficient is stored first
+		 * so that the one of the first code overwrites it.
+		 */
+		i += pair->tab[0].run;
+		j = scan[i];
+		i += pair->tab[1].run;
+		j2 = scan[i];
+		val = (pair->tab[0].level * quant_matrix[j]) >> 4;
+		val2 = (pair->tab[1].level * quant_matrix[j2]) >> 4;
+
+		/* if (bitstream_get (1)) val = -val; */
+		sign = SBITS (bit_buf << pair->tab[0].len, 1);
+		val = (val ^ sign) - sign;
+		sign = SBITS (bit_buf << (pair->len - 1), 1);
+		val2 = (val2 ^ sign) - sign;
+
+		SATURATE (val);
+		SATURATE (val2);
+		dest[j2] = val2;
+		dest[j] = val;
+		mismatch ^= val ^ val2;
+		coded |= j | j2;
+
+		DUMPBITS (bit_buf, bits, pair->len);
+		NEEDBITS (bit_buf, bits, bit_ptr);
+
+		continue;
+	    }
+
+	    tab = pair->tab;
 
 	    i += tab->run;
 	    if (i >= 64)
@@ -374,6 +516,7 @@ static void get_intra_block_B14 (mpeg2_decoder_t * const decoder,
 
 	normal_code:
 	    j = scan[i];
+	    coded |= j;
 	    bit_buf <<= tab->len;
 	    bits += tab->len + 1;
 	    val = (tab->level * quant_matrix[j]) >> 4;
@@ -405,6 +548,7 @@ static void get_intra_block_B14 (mpeg2_decoder_t * const decoder,
 		break;	/* illegal, check needed to avoid buffer overflow */
 
 	    j = scan[i];
+	    coded |= j;
 
 	    DUMPBITS (bit_buf, bits, 12);
 	    NEEDBITS (bit_buf, bits, bit_ptr);
@@ -446,44 +590,84 @@ static void get_intra_block_B14 (mpeg2_decoder_t * const decoder,
     }
     dest[63] ^= mismatch & 16;
     DUMPBITS (bit_buf, bits, tab->len);	/* dump end of block code */
-    decoder->bitstream_buf = bit_buf;
-    decoder->bitstream_bits = bits;
-    decoder->bitstream_ptr = bit_ptr;
+    bs->buf = bit_buf;
+    bs->bits = bits;
+    bs->ptr = bit_ptr;
+    return coded;
 }
 
-static void get_intra_block_B15 (mpeg2_decoder_t * const decoder,
-				 const uint16_t * const quant_matrix)
+static int get_intra_block_B15 (mpeg2_decoder_t * const decoder,
+				bitstream_t * const bs,
+				const uint16_t * const quant_matrix)
 {
     int i;
-    int j;
-    int val;
+    int j, j2;
+    int val, val2, sign;
+    int coded;
     const uint8_t * const scan = decoder->scan;
     int mismatch;
     const DCTtab * tab;
+    const DCTpair * pair;
     uint32_t bit_buf;
     int bits;
     const uint8_t * bit_ptr;
     int16_t * const dest = decoder->DCTblock;
 
     i = 0;
+    coded = 0;
     mismatch = ~dest[0];
 
-    bit_buf = decoder->bitstream_buf;
-    bits = decoder->bitstream_bits;
-    bit_ptr = decoder->bitstream_ptr;
+    bit_buf = bs->buf;
+    bits = bs->bits;
+    bit_ptr = bs->ptr;
 
     NEEDBITS (bit_buf, bits, bit_ptr);
 
     while (1) {
 	if (bit_buf >= 0x04000000) {
 
-	    tab = DCT_B15_8 + (UBITS (bit_buf, 8) - 4);
+	    pair = DCT_B15_pair + (UBITS (bit_buf, PAIR_BITS) - 16);
+
+	    if (i + pair->run < 64) {
+		/*
+		 * One or two short codes. A missing second code has no
+		 * run and no level, and its coefficient is stored first
+		 * so that the one of the first code overwrites it.
+		 */
+		i += pair->tab[0].run;
+		j = scan[i];
+		i += pair->tab[1].run;
+		j2 = scan[i];
+		val = (pair->tab[0].level * quant_matrix[j]) >> 4;
+		val2 = (pair->tab[1].level * quant_matrix[j2]) >> 4;
+
+		/* if (bitstream_get (1)) val = -val; */
+		sign = SBITS (bit_buf << pair->tab[0].len, 1);
+		val = (val ^ sign) - sign;
+		sign = SBITS (bit_buf << (pair->len - 1), 1);
+		val2 = (val2 ^ sign) - sign;
+
+		SATURATE (val);
+		SATURATE (val2);
+		dest[j2] = val2;
+		dest[j] = val;
+		mismatch ^= val ^ val2;
+		coded |= j | j2;
+
+		DUMPBITS (bit_buf, bits, pair->len);
+		NEEDBITS (bit_buf, bits, bit_ptr);
+
+		continue;
+	    }
+
+	    tab = pair->tab;
 
 	    i += tab->run;
 	    if (i < 64) {
 
 	    normal_code:
 		j = scan[i];
+		coded |= j;
 		bit_buf <<= tab->len;
 		bits += tab->len + 1;
 		val = (tab->level * quant_matrix[j]) >> 4;
@@ -514,6 +698,7 @@ static void get_intra_block_B15 (mpeg2_decoder_t * const decoder,
 		    break;	/* illegal, check against buffer overflow */
 
 		j = scan[i];
+		coded |= j;
 
 		DUMPBITS (bit_buf, bits, 12);
 		NEEDBITS (bit_buf, bits, bit_ptr);
@@ -556,31 +741,36 @@ static void get_intra_block_B15 (mpeg2_decoder_t * const decoder,
     }
     dest[63] ^= mismatch & 16;
     DUMPBITS (bit_buf, bits, tab->len);	/* dump end of block code */
-    decoder->bitstream_buf = bit_buf;
-    decoder->bitstream_bits = bits;
-    decoder->bitstream_ptr = bit_ptr;
+    bs->buf = bit_buf;
+    bs->bits = bits;
+    bs->ptr = bit_ptr;
+    return coded;
 }
 
 static int get_non_intra_block (mpeg2_decoder_t * const decoder,
+				bitstream_t * const bs,
 				const uint16_t * const quant_matrix)
 {
     int i;
-    int j;
-    int val;
+    int j, j2;
+    int val, val2, sign;
+    int coded;
     const uint8_t * const scan = decoder->scan;
     int mismatch;
     const DCTtab * tab;
+    const DCTpair * pair;
     uint32_t bit_buf;
     int bits;
     const uint8_t * bit_ptr;
     int16_t * const dest = decoder->DCTblock;
 
     i = -1;
+    coded = 0;
     mismatch = -1;
 
-    bit_buf = decoder->bitstream_buf;
-    bits = decoder->bitstream_bits;
-    bit_ptr = decoder->bitstream_ptr;
+    bit_buf = bs->buf;
+    bits = bs->bits;
+    bit_ptr = bs->ptr;
 
     NEEDBITS (bit_buf, bits, bit_ptr);
     if (bit_buf >= 0x28000000) {
@@ -592,7 +782,42 @@ static int get_non_intra_block (mpeg2_decoder_t * const decoder,
     while (1) {
 	if (bit_buf >= 0x28000000) {
 
-	    tab = DCT_B14AC_5 + (UBITS (bit_buf, 5) - 5);
+	    pair = DCT_B14AC_pair + (UBITS (bit_buf, PAIR_BITS) - 160);
+
+	    if (i + pair->run < 64) {
+		/*
+		 * One or two short codes. A missing second code has no
+		 * run and no level, and its coefficient is stored first
+		 * so that the one of the first code overwrites it.
+		 */
+		i += pair->tab[0].run;
+		j = scan[i];
+		i += pair->tab[1].run;
+		j2 = scan[i];
+		val = ((2 * pair->tab[0].level + 1) * quant_matrix[j]) >> 5;
+		val2 = ((2 * pair->tab[1].level + 1) * quant_matrix[j2]) >> 5;
+		val2 &= pair->mask;
+
+		/* if (bitstream_get (1)) val = -val; */
+		sign = SBITS (bit_buf << pair->tab[0].len, 1);
+		val = (val ^ sign) - sign;
+		sign = SBITS (bit_buf << (pair->len - 1), 1);
+		val2 = (val2 ^ sign) - sign;
+
+		SATURATE (val);
+		SATURATE (val2);
+		dest[j2] = val2;
+		dest[j] = val;
+		mismatch ^= val ^ val2;
+		coded |= j | j2;
+
+		DUMPBITS (bit_buf, bits, pair->len);
+		NEEDBITS (bit_buf, bits, bit_ptr);
+
+		continue;
+	    }
+
+	    tab = pair->tab;
 
 	entry_1:
 	    i += tab->run;
@@ -601,6 +826,7 @@ static int get_non_intra_block (mpeg2_decoder_t * const decoder,
 
 	normal_code:
 	    j = scan[i];
+	    coded |= j;
 	    bit_buf <<= tab->len;
 	    bits += tab->len + 1;
 	    val = ((2 * tab->level + 1) * quant_matrix[j]) >> 5;
@@ -635,6 +861,7 @@ static int get_non_intra_block (mpeg2_decoder_t * const decoder,
 		break;	/* illegal, check needed to avoid buffer overflow */
 
 	    j = scan[i];
+	    coded |= j;
 
 	    DUMPBITS (bit_buf, bits, 12);
 	    NEEDBITS (bit_buf, bits, bit_ptr);
@@ -677,17 +904,19 @@ static int get_non_intra_block (mpeg2_decoder_t * const decoder,
     }
     dest[63] ^= mismatch & 16;
     DUMPBITS (bit_buf, bits, tab->len);	/* dump end of block code */
-    decoder->bitstream_buf = bit_buf;
-    decoder->bitstream_bits = bits;
-    decoder->bitstream_ptr = bit_ptr;
-    return i;
+    bs->buf = bit_buf;
+    bs->bits = bits;
+    bs->ptr = bit_ptr;
+    return coded;
 }
 
-static void get_mpeg1_intra_block (mpeg2_decoder_t * const decoder)
+static int get_mpeg1_intra_block (mpeg2_decoder_t * const decoder,
+				  bitstream_t * const bs)
 {
     int i;
     int j;
     int val;
+    int coded;
     const uint8_t * const scan = decoder->scan;
     const uint16_t * const quant_matrix = decoder->quantizer_matrix[0];
     const DCTtab * tab;
@@ -697,10 +926,11 @@ static void get_mpeg1_intra_block (mpeg2_decoder_t * const decoder)
     int16_t * const dest = decoder->DCTblock;
 
     i = 0;
+    coded = 0;
 
-    bit_buf = decoder->bitstream_buf;
-    bits = decoder->bitstream_bits;
-    bit_ptr = decoder->bitstream_ptr;
+    bit_buf = bs->buf;
+    bits = bs->bits;
+    bit_ptr = bs->ptr;
 
     NEEDBITS (bit_buf, bits, bit_ptr);
 
@@ -715,6 +945,7 @@ static void get_mpeg1_intra_block (mpeg2_decoder_t * const decoder)
 
 	normal_code:
 	    j = scan[i];
+	    coded |= j;
 	    bit_buf <<= tab->len;
 	    bits += tab->len + 1;
 	    val = (tab->level * quant_matrix[j]) >> 4;
@@ -748,6 +979,7 @@ static void get_mpeg1_intra_block (mpeg2_decoder_t * const decoder)
 		break;	/* illegal, check needed to avoid buffer overflow */
 
 	    j = scan[i];
+	    coded |= j;
 
 	    DUMPBITS (bit_buf, bits, 12);
 	    NEEDBITS (bit_buf, bits, bit_ptr);
@@ -795,16 +1027,19 @@ static void get_mpeg1_intra_block (mpeg2_decoder_t * const decoder)
 	break;	/* illegal, check needed to avoid buffer overflow */
     }
     DUMPBITS (bit_buf, bits, tab->len);	/* dump end of block code */
-    decoder->bitstream_buf = bit_buf;
-    decoder->bitstream_bits = bits;
-    decoder->bitstream_ptr = bit_ptr;
+    bs->buf = bit_buf;
+    bs->bits = bits;
+    bs->ptr = bit_ptr;
+    return coded;
 }
 
-static int get_mpeg1_non_intra_block (mpeg2_decoder_t * const decoder)
+static int get_mpeg1_non_intra_block (mpeg2_decoder_t * const decoder,
+				      bitstream_t * const bs)
 {
     int i;
     int j;
     int val;
+    int coded;
     const uint8_t * const scan = decoder->scan;
     const uint16_t * const quant_matrix = decoder->quantizer_matrix[1];
     const DCTtab * tab;
@@ -814,10 +1049,11 @@ static int get_mpeg1_non_intra_block (mpeg2_decoder_t * const decoder)
     int16_t * const dest = decoder->DCTblock;
 
     i = -1;
+    coded = 0;
 
-    bit_buf = decoder->bitstream_buf;
-    bits = decoder->bitstream_bits;
-    bit_ptr = decoder->bitstream_ptr;
+    bit_buf = bs->buf;
+    bits = bs->bits;
+    bit_ptr = bs->ptr;
 
     NEEDBITS (bit_buf, bits, bit_ptr);
     if (bit_buf >= 0x28000000) {
@@ -838,6 +1074,7 @@ static int get_mpeg1_non_intra_block (mpeg2_decoder_t * const decoder)
 
 	normal_code:
 	    j = scan[i];
+	    coded |= j;
 	    bit_buf <<= tab->len;
 	    bits += tab->len + 1;
 	    val = ((2 * tab->level + 1) * quant_matrix[j]) >> 5;
@@ -874,6 +1111,7 @@ static int get_mpeg1_non_intra_block (mpeg2_decoder_t * const decoder)
 		break;	/* illegal, check needed to avoid buffer overflow */
 
 	    j = scan[i];
+	    coded |= j;
 
 	    DUMPBITS (bit_buf, bits, 12);
 	    NEEDBITS (bit_buf, bits, bit_ptr);
@@ -922,382 +1160,478 @@ static int get_mpeg1_non_intra_block (mpeg2_decoder_t * const decoder)
 	break;	/* illegal, check needed to avoid buffer overflow */
     }
     DUMPBITS (bit_buf, bits, tab->len);	/* dump end of block code */
-    decoder->bitstream_buf = bit_buf;
-    decoder->bitstream_bits = bits;
-    decoder->bitstream_ptr = bit_ptr;
-    return i;
+    bs->buf = bit_buf;
+    bs->bits = bits;
+    bs->ptr = bit_ptr;
+    return coded;
+}
+
+/*
+ * Shape of the block from the or of its coded scan positions, as the
+ * idct may skip whatever it knows to be zero. Mismatch control can set
+ * the last coefficient without coding it, and only the dc path of the
+ * idct takes that into account.
+ */
+static inline int block_shape (mpeg2_decoder_t * const decoder,
+			       const int coded)
+{
+    int shape;
+
+    shape = mpeg2_idct_shape[coded];
+    if (shape != IDCT_DC && decoder->DCTblock[63])
+	shape = IDCT_FULL;
+    return shape;
 }
 
 static inline void slice_intra_DCT (mpeg2_decoder_t * const decoder,
-				    const int cc,
+				    bitstream_t * const bs, const int mpeg1,
+				    const int intra_vlc_format, const int cc,
 				    uint8_t * const dest, const int stride)
 {
-#define bit_buf (decoder->bitstream_buf)
-#define bits (decoder->bitstream_bits)
-#define bit_ptr (decoder->bitstream_ptr)
+    int coded, shape;
+    STATS (uint64_t stats_start;)
+
+#define bit_buf (bs->buf)
+#define bits (bs->bits)
+#define bit_ptr (bs->ptr)
     NEEDBITS (bit_buf, bits, bit_ptr);
     /* Get the intra DC coefficient and inverse quantize it */
     if (cc == 0)
 	decoder->DCTblock[0] =
-	    decoder->dc_dct_pred[0] += get_luma_dc_dct_diff (decoder);
+	    decoder->dc_dct_pred[0] += get_luma_dc_dct_diff (decoder, bs);
     else
 	decoder->DCTblock[0] =
-	    decoder->dc_dct_pred[cc] += get_chroma_dc_dct_diff (decoder);
+	    decoder->dc_dct_pred[cc] += get_chroma_dc_dct_diff (decoder, bs);
 
-    if (decoder->mpeg1) {
+    coded = 0;
+    if (mpeg1) {
 	if (decoder->coding_type != D_TYPE)
-	    get_mpeg1_intra_block (decoder);
-    } else if (decoder->intra_vlc_format)
-	get_intra_block_B15 (decoder, decoder->quantizer_matrix[cc ? 2 : 0]);
+	    coded = get_mpeg1_intra_block (decoder, bs);
+    } else if (intra_vlc_format)
+	coded = get_intra_block_B15 (decoder, bs,
+				     decoder->quantizer_matrix[cc ? 2 : 0]);
     else
-	get_intra_block_B14 (decoder, decoder->quantizer_matrix[cc ? 2 : 0]);
-    mpeg2_idct_copy (decoder->DCTblock, dest, stride);
+	coded = get_intra_block_B14 (decoder, bs,
+				     decoder->quantizer_matrix[cc ? 2 : 0]);
+    shape = block_shape (decoder, coded);
+    STATS (decoder->stats.idct_intra[shape]++;)
+    STATS (stats_start = stats_clock ();)
+    mpeg2_idct_copy (shape, decoder->DCTblock, dest, stride);
+    STATS (decoder->stats.idct_time += stats_clock () - stats_start;)
 #undef bit_buf
 #undef bits
 #undef bit_ptr
 }
 
 static inline void slice_non_intra_DCT (mpeg2_decoder_t * const decoder,
-					const int cc,
+					bitstream_t * const bs,
+					const int mpeg1, const int cc,
 					uint8_t * const dest, const int stride)
 {
-    int last;
+    int coded, shape;
+    STATS (uint64_t stats_start;)
 
-    if (decoder->mpeg1)
-	last = get_mpeg1_non_intra_block (decoder);
+    if (mpeg1)
+	coded = get_mpeg1_non_intra_block (decoder, bs);
     else
-	last = get_non_intra_block (decoder,
-				    decoder->quantizer_matrix[cc ? 3 : 1]);
-    mpeg2_idct_add (last, decoder->DCTblock, dest, stride);
+	coded = get_non_intra_block (decoder, bs,
+				     decoder->quantizer_matrix[cc ? 3 : 1]);
+    shape = block_shape (decoder, coded);
+    STATS (decoder->stats.idct_non_intra[shape]++;)
+    STATS (stats_start = stats_clock ();)
+    mpeg2_idct_add (shape, decoder->DCTblock, dest, stride);
+    STATS (decoder->stats.idct_time += stats_clock () - stats_start;)
 }
 
+/*
+ * Where column x of a reference row starts, c being 0 for luma and 1
+ * for chroma. tiled is a constant of the function using this, so that
+ * in raster pictures it compiles down to just x. In tiled ones each
+ * macroblock column is a tile of its own, which also holds a copy of
+ * the next column so that a half-pel prediction never straddles tiles.
+ */
+#define TILE_X(x,c)							\
+    (tiled ? (((x) >> decoder->tile_shift[c]) * decoder->tile_size[c] +	\
+	      ((x) & decoder->tile_mask[c])) : (x))
+
 #define MOTION_420(table,ref,motion_x,motion_y,size,y)			      \
     pos_x = 2 * decoder->offset + motion_x;				      \
     pos_y = 2 * decoder->v_offset + motion_y + 2 * y;			      \
-    if (unlikely (pos_x > decoder->limit_x)) {				      \
-	pos_x = ((int)pos_x < 0) ? 0 : decoder->limit_x;		      \
+    if (unlikely ((unsigned) (pos_x + decoder->pad_x) > decoder->limit_x)) {  \
+	pos_x = ((pos_x < 0) ? 0 : (int) decoder->limit_x) - decoder->pad_x;  \
 	motion_x = pos_x - 2 * decoder->offset;				      \
     }									      \
-    if (unlikely (pos_y > decoder->limit_y_ ## size)) {			      \
-	pos_y = ((int)pos_y < 0) ? 0 : decoder->limit_y_ ## size;	      \
+    if (unlikely ((unsigned) (pos_y + decoder->pad_y) >			      \
+		  decoder->limit_y_ ## size)) {				      \
+	pos_y = (((pos_y < 0) ? 0 : (int) decoder->limit_y_ ## size) -	      \
+		 decoder->pad_y);					      \
 	motion_y = pos_y - 2 * decoder->v_offset - 2 * y;		      \
     }									      \
     xy_half = ((pos_y & 1) << 1) | (pos_x & 1);				      \
-    table[xy_half] (decoder->dest[0] + y * decoder->stride + decoder->offset, \
-		    ref[0] + (pos_x >> 1) + (pos_y >> 1) * decoder->stride,   \
-		    decoder->stride, size);				      \
+    MC_CALL (table, xy_half) (decoder->dest[0] + y * decoder->stride +	      \
+			      decoder->dest_x[0],			      \
+			      ref[0] + TILE_X (pos_x >> 1, 0) +		      \
+			      (pos_y >> 1) * decoder->stride,		      \
+			      decoder->stride, size);			      \
     motion_x /= 2;	motion_y /= 2;					      \
     xy_half = ((motion_y & 1) << 1) | (motion_x & 1);			      \
-    offset = (((decoder->offset + motion_x) >> 1) +			      \
-	      ((((decoder->v_offset + motion_y) >> 1) + y/2) *		      \
+    offset = (TILE_X ((decoder->offset + motion_x) >> 1, 1) +		      \
+	      (((((int) decoder->v_offset + motion_y) >> 1) + y/2) *	      \
 	       decoder->uv_stride));					      \
-    table[4+xy_half] (decoder->dest[1] + y/2 * decoder->uv_stride +	      \
-		      (decoder->offset >> 1), ref[1] + offset,		      \
-		      decoder->uv_stride, size/2);			      \
-    table[4+xy_half] (decoder->dest[2] + y/2 * decoder->uv_stride +	      \
-		      (decoder->offset >> 1), ref[2] + offset,		      \
-		      decoder->uv_stride, size/2)
+    MC_CALL (table, 4+xy_half) (decoder->dest[1] + y/2 * decoder->uv_stride + \
+				decoder->dest_x[1], ref[1] + offset,	      \
+				decoder->uv_stride, size/2);		      \
+    MC_CALL (table, 4+xy_half) (decoder->dest[2] + y/2 * decoder->uv_stride + \
+				decoder->dest_x[1], ref[2] + offset,	      \
+				decoder->uv_stride, size/2)
 
 #define MOTION_FIELD_420(table,ref,motion_x,motion_y,dest_field,op,src_field) \
     pos_x = 2 * decoder->offset + motion_x;				      \
     pos_y = decoder->v_offset + motion_y;				      \
-    if (unlikely (pos_x > decoder->limit_x)) {				      \
-	pos_x = ((int)pos_x < 0) ? 0 : decoder->limit_x;		      \
+    if (unlikely ((unsigned) (pos_x + decoder->pad_x) > decoder->limit_x)) {  \
+	pos_x = ((pos_x < 0) ? 0 : (int) decoder->limit_x) - decoder->pad_x;  \
 	motion_x = pos_x - 2 * decoder->offset;				      \
     }									      \
-    if (unlikely (pos_y > decoder->limit_y)) {				      \
-	pos_y = ((int)pos_y < 0) ? 0 : decoder->limit_y;		      \
+    if (unlikely ((unsigned) (pos_y + decoder->pad_y_field) >		      \
+		  decoder->limit_y_field)) {				      \
+	pos_y = (((pos_y < 0) ? 0 : (int) decoder->limit_y_field) -	      \
+		 decoder->pad_y_field);					      \
 	motion_y = pos_y - decoder->v_offset;				      \
     }									      \
     xy_half = ((pos_y & 1) << 1) | (pos_x & 1);				      \
-    table[xy_half] (decoder->dest[0] + dest_field * decoder->stride +	      \
-		    decoder->offset,					      \
-		    (ref[0] + (pos_x >> 1) +				      \
-		     ((pos_y op) + src_field) * decoder->stride),	      \
-		    2 * decoder->stride, 8);				      \
+    MC_CALL (table, xy_half) (decoder->dest[0] +			      \
+			      dest_field * decoder->stride +		      \
+			      decoder->dest_x[0],			      \
+			      (ref[0] + TILE_X (pos_x >> 1, 0) +	      \
+			       ((pos_y op) + src_field) * decoder->stride),   \
+			      2 * decoder->stride, 8);			      \
     motion_x /= 2;	motion_y /= 2;					      \
     xy_half = ((motion_y & 1) << 1) | (motion_x & 1);			      \
-    offset = (((decoder->offset + motion_x) >> 1) +			      \
+    offset = (TILE_X ((decoder->offset + motion_x) >> 1, 1) +		      \
 	      (((decoder->v_offset >> 1) + (motion_y op) + src_field) *	      \
 	       decoder->uv_stride));					      \
-    table[4+xy_half] (decoder->dest[1] + dest_field * decoder->uv_stride +    \
-		      (decoder->offset >> 1), ref[1] + offset,		      \
-		      2 * decoder->uv_stride, 4);			      \
-    table[4+xy_half] (decoder->dest[2] + dest_field * decoder->uv_stride +    \
-		      (decoder->offset >> 1), ref[2] + offset,		      \
-		      2 * decoder->uv_stride, 4)
+    MC_CALL (table, 4+xy_half) (decoder->dest[1] +			      \
+				dest_field * decoder->uv_stride +	      \
+				decoder->dest_x[1], ref[1] + offset,	      \
+				2 * decoder->uv_stride, 4);		      \
+    MC_CALL (table, 4+xy_half) (decoder->dest[2] +			      \
+				dest_field * decoder->uv_stride +	      \
+				decoder->dest_x[1], ref[2] + offset,	      \
+				2 * decoder->uv_stride, 4)
 
 #define MOTION_DMV_420(table,ref,motion_x,motion_y)			      \
     pos_x = 2 * decoder->offset + motion_x;				      \
     pos_y = decoder->v_offset + motion_y;				      \
-    if (unlikely (pos_x > decoder->limit_x)) {				      \
-	pos_x = ((int)pos_x < 0) ? 0 : decoder->limit_x;		      \
+    if (unlikely ((unsigned) (pos_x + decoder->pad_x) > decoder->limit_x)) {  \
+	pos_x = ((pos_x < 0) ? 0 : (int) decoder->limit_x) - decoder->pad_x;  \
 	motion_x = pos_x - 2 * decoder->offset;				      \
     }									      \
-    if (unlikely (pos_y > decoder->limit_y)) {				      \
-	pos_y = ((int)pos_y < 0) ? 0 : decoder->limit_y;		      \
+    if (unlikely ((unsigned) (pos_y + decoder->pad_y_field) >		      \
+		  decoder->limit_y_field)) {				      \
+	pos_y = (((pos_y < 0) ? 0 : (int) decoder->limit_y_field) -	      \
+		 decoder->pad_y_field);					      \
 	motion_y = pos_y - decoder->v_offset;				      \
     }									      \
     xy_half = ((pos_y & 1) << 1) | (pos_x & 1);				      \
-    offset = (pos_x >> 1) + (pos_y & ~1) * decoder->stride;		      \
-    table[xy_half] (decoder->dest[0] + decoder->offset,			      \
-		    ref[0] + offset, 2 * decoder->stride, 8);		      \
-    table[xy_half] (decoder->dest[0] + decoder->stride + decoder->offset,     \
-		    ref[0] + decoder->stride + offset,			      \
-		    2 * decoder->stride, 8);				      \
+    offset = TILE_X (pos_x >> 1, 0) + (pos_y & ~1) * decoder->stride;	      \
+    MC_CALL (table, xy_half) (decoder->dest[0] + decoder->dest_x[0],	      \
+			      ref[0] + offset, 2 * decoder->stride, 8);	      \
+    MC_CALL (table, xy_half) (decoder->dest[0] + decoder->stride +	      \
+			      decoder->dest_x[0],			      \
+			      ref[0] + decoder->stride + offset,	      \
+			      2 * decoder->stride, 8);			      \
     motion_x /= 2;	motion_y /= 2;					      \
     xy_half = ((motion_y & 1) << 1) | (motion_x & 1);			      \
-    offset = (((decoder->offset + motion_x) >> 1) +			      \
+    offset = (TILE_X ((decoder->offset + motion_x) >> 1, 1) +		      \
 	      (((decoder->v_offset >> 1) + (motion_y & ~1)) *		      \
 	       decoder->uv_stride));					      \
-    table[4+xy_half] (decoder->dest[1] + (decoder->offset >> 1),	      \
-		      ref[1] + offset, 2 * decoder->uv_stride, 4);	      \
-    table[4+xy_half] (decoder->dest[1] + decoder->uv_stride +		      \
-		      (decoder->offset >> 1),				      \
-		      ref[1] + decoder->uv_stride + offset,		      \
-		      2 * decoder->uv_stride, 4);			      \
-    table[4+xy_half] (decoder->dest[2] + (decoder->offset >> 1),	      \
-		      ref[2] + offset, 2 * decoder->uv_stride, 4);	      \
-    table[4+xy_half] (decoder->dest[2] + decoder->uv_stride +		      \
-		      (decoder->offset >> 1),				      \
-		      ref[2] + decoder->uv_stride + offset,		      \
-		      2 * decoder->uv_stride, 4)
+    MC_CALL (table, 4+xy_half) (decoder->dest[1] + decoder->dest_x[1],	      \
+				ref[1] + offset, 2 * decoder->uv_stride, 4);  \
+    MC_CALL (table, 4+xy_half) (decoder->dest[1] + decoder->uv_stride +	      \
+				decoder->dest_x[1],			      \
+				ref[1] + decoder->uv_stride + offset,	      \
+				2 * decoder->uv_stride, 4);		      \
+    MC_CALL (table, 4+xy_half) (decoder->dest[2] + decoder->dest_x[1],	      \
+				ref[2] + offset, 2 * decoder->uv_stride, 4);  \
+    MC_CALL (table, 4+xy_half) (decoder->dest[2] + decoder->uv_stride +	      \
+				decoder->dest_x[1],			      \
+				ref[2] + decoder->uv_stride + offset,	      \
+				2 * decoder->uv_stride, 4)
 
 #define MOTION_ZERO_420(table,ref)					      \
-    table[0] (decoder->dest[0] + decoder->offset,			      \
-	      (ref[0] + decoder->offset +				      \
-	       decoder->v_offset * decoder->stride), decoder->stride, 16);    \
-    offset = ((decoder->offset >> 1) +					      \
+    MC_CALL (table, 0) (decoder->dest[0] + decoder->dest_x[0],		      \
+			(ref[0] + decoder->dest_x[0] +			      \
+			 decoder->v_offset * decoder->stride),		      \
+			decoder->stride, 16);				      \
+    offset = (decoder->dest_x[1] +					      \
 	      (decoder->v_offset >> 1) * decoder->uv_stride);		      \
-    table[4] (decoder->dest[1] + (decoder->offset >> 1),		      \
-	      ref[1] + offset, decoder->uv_stride, 8);			      \
-    table[4] (decoder->dest[2] + (decoder->offset >> 1),		      \
-	      ref[2] + offset, decoder->uv_stride, 8)
+    MC_CALL (table, 4) (decoder->dest[1] + decoder->dest_x[1],		      \
+			ref[1] + offset, decoder->uv_stride, 8);	      \
+    MC_CALL (table, 4) (decoder->dest[2] + decoder->dest_x[1],		      \
+			ref[2] + offset, decoder->uv_stride, 8)
 
 #define MOTION_422(table,ref,motion_x,motion_y,size,y)			      \
     pos_x = 2 * decoder->offset + motion_x;				      \
     pos_y = 2 * decoder->v_offset + motion_y + 2 * y;			      \
-    if (unlikely (pos_x > decoder->limit_x)) {				      \
-	pos_x = ((int)pos_x < 0) ? 0 : decoder->limit_x;		      \
+    if (unlikely ((unsigned) (pos_x + decoder->pad_x) > decoder->limit_x)) {  \
+	pos_x = ((pos_x < 0) ? 0 : (int) decoder->limit_x) - decoder->pad_x;  \
 	motion_x = pos_x - 2 * decoder->offset;				      \
     }									      \
-    if (unlikely (pos_y > decoder->limit_y_ ## size)) {			      \
-	pos_y = ((int)pos_y < 0) ? 0 : decoder->limit_y_ ## size;	      \
+    if (unlikely ((unsigned) (pos_y + decoder->pad_y) >			      \
+		  decoder->limit_y_ ## size)) {				      \
+	pos_y = (((pos_y < 0) ? 0 : (int) decoder->limit_y_ ## size) -	      \
+		 decoder->pad_y);					      \
 	motion_y = pos_y - 2 * decoder->v_offset - 2 * y;		      \
     }									      \
     xy_half = ((pos_y & 1) << 1) | (pos_x & 1);				      \
-    offset = (pos_x >> 1) + (pos_y >> 1) * decoder->stride;		      \
-    table[xy_half] (decoder->dest[0] + y * decoder->stride + decoder->offset, \
-		    ref[0] + offset, decoder->stride, size);		      \
-    offset = (offset + (motion_x & (motion_x < 0))) >> 1;		      \
+    offset = TILE_X (pos_x >> 1, 0) + (pos_y >> 1) * decoder->stride;	      \
+    MC_CALL (table, xy_half) (decoder->dest[0] + y * decoder->stride +	      \
+			      decoder->dest_x[0],			      \
+			      ref[0] + offset, decoder->stride, size);	      \
     motion_x /= 2;							      \
+    offset = (TILE_X ((decoder->offset + motion_x) >> 1, 1) +		      \
+	      (pos_y >> 1) * decoder->uv_stride);			      \
     xy_half = ((pos_y & 1) << 1) | (motion_x & 1);			      \
-    table[4+xy_half] (decoder->dest[1] + y * decoder->uv_stride +	      \
-		      (decoder->offset >> 1), ref[1] + offset,		      \
-		      decoder->uv_stride, size);			      \
-    table[4+xy_half] (decoder->dest[2] + y * decoder->uv_stride +	      \
-		      (decoder->offset >> 1), ref[2] + offset,		      \
-		      decoder->uv_stride, size)
+    MC_CALL (table, 4+xy_half) (decoder->dest[1] + y * decoder->uv_stride +   \
+				decoder->dest_x[1], ref[1] + offset,	      \
+				decoder->uv_stride, size);		      \
+    MC_CALL (table, 4+xy_half) (decoder->dest[2] + y * decoder->uv_stride +   \
+				decoder->dest_x[1], ref[2] + offset,	      \
+				decoder->uv_stride, size)
 
 #define MOTION_FIELD_422(table,ref,motion_x,motion_y,dest_field,op,src_field) \
     pos_x = 2 * decoder->offset + motion_x;				      \
     pos_y = decoder->v_offset + motion_y;				      \
-    if (unlikely (pos_x > decoder->limit_x)) {				      \
-	pos_x = ((int)pos_x < 0) ? 0 : decoder->limit_x;		      \
+    if (unlikely ((unsigned) (pos_x + decoder->pad_x) > decoder->limit_x)) {  \
+	pos_x = ((pos_x < 0) ? 0 : (int) decoder->limit_x) - decoder->pad_x;  \
 	motion_x = pos_x - 2 * decoder->offset;				      \
     }									      \
-    if (unlikely (pos_y > decoder->limit_y)) {				      \
-	pos_y = ((int)pos_y < 0) ? 0 : decoder->limit_y;		      \
+    if (unlikely ((unsigned) (pos_y + decoder->pad_y_field) >		      \
+		  decoder->limit_y_field)) {				      \
+	pos_y = (((pos_y < 0) ? 0 : (int) decoder->limit_y_field) -	      \
+		 decoder->pad_y_field);					      \
 	motion_y = pos_y - decoder->v_offset;				      \
     }									      \
     xy_half = ((pos_y & 1) << 1) | (pos_x & 1);				      \
-    offset = (pos_x >> 1) + ((pos_y op) + src_field) * decoder->stride;	      \
-    table[xy_half] (decoder->dest[0] + dest_field * decoder->stride +	      \
-		    decoder->offset, ref[0] + offset,			      \
-		    2 * decoder->stride, 8);				      \
-    offset = (offset + (motion_x & (motion_x < 0))) >> 1;		      \
+    offset = (TILE_X (pos_x >> 1, 0) +					      \
+	      ((pos_y op) + src_field) * decoder->stride);		      \
+    MC_CALL (table, xy_half) (decoder->dest[0] +			      \
+			      dest_field * decoder->stride +		      \
+			      decoder->dest_x[0], ref[0] + offset,	      \
+			      2 * decoder->stride, 8);			      \
     motion_x /= 2;							      \
+    offset = (TILE_X ((decoder->offset + motion_x) >> 1, 1) +		      \
+	      ((pos_y op) + src_field) * decoder->uv_stride);		      \
     xy_half = ((pos_y & 1) << 1) | (motion_x & 1);			      \
-    table[4+xy_half] (decoder->dest[1] + dest_field * decoder->uv_stride +    \
-		      (decoder->offset >> 1), ref[1] + offset,		      \
-		      2 * decoder->uv_stride, 8);			      \
-    table[4+xy_half] (decoder->dest[2] + dest_field * decoder->uv_stride +    \
-		      (decoder->offset >> 1), ref[2] + offset,		      \
-		      2 * decoder->uv_stride, 8)
+    MC_CALL (table, 4+xy_half) (decoder->dest[1] +			      \
+				dest_field * decoder->uv_stride +	      \
+				decoder->dest_x[1], ref[1] + offset,	      \
+				2 * decoder->uv_stride, 8);		      \
+    MC_CALL (table, 4+xy_half) (decoder->dest[2] +			      \
+				dest_field * decoder->uv_stride +	      \
+				decoder->dest_x[1], ref[2] + offset,	      \
+				2 * decoder->uv_stride, 8)
 
 #define MOTION_DMV_422(table,ref,motion_x,motion_y)			      \
     pos_x = 2 * decoder->offset + motion_x;				      \
     pos_y = decoder->v_offset + motion_y;				      \
-    if (unlikely (pos_x > decoder->limit_x)) {				      \
-	pos_x = ((int)pos_x < 0) ? 0 : decoder->limit_x;		      \
+    if (unlikely ((unsigned) (pos_x + decoder->pad_x) > decoder->limit_x)) {  \
+	pos_x = ((pos_x < 0) ? 0 : (int) decoder->limit_x) - decoder->pad_x;  \
 	motion_x = pos_x - 2 * decoder->offset;				      \
     }									      \
-    if (unlikely (pos_y > decoder->limit_y)) {				      \
-	pos_y = ((int)pos_y < 0) ? 0 : decoder->limit_y;		      \
+    if (unlikely ((unsigned) (pos_y + decoder->pad_y_field) >		      \
+		  decoder->limit_y_field)) {				      \
+	pos_y = (((pos_y < 0) ? 0 : (int) decoder->limit_y_field) -	      \
+		 decoder->pad_y_field);					      \
 	motion_y = pos_y - decoder->v_offset;				      \
     }									      \
     xy_half = ((pos_y & 1) << 1) | (pos_x & 1);				      \
-    offset = (pos_x >> 1) + (pos_y & ~1) * decoder->stride;		      \
-    table[xy_half] (decoder->dest[0] + decoder->offset,			      \
-		    ref[0] + offset, 2 * decoder->stride, 8);		      \
-    table[xy_half] (decoder->dest[0] + decoder->stride + decoder->offset,     \
-		    ref[0] + decoder->stride + offset,			      \
-		    2 * decoder->stride, 8);				      \
-    offset = (offset + (motion_x & (motion_x < 0))) >> 1;		      \
+    offset = TILE_X (pos_x >> 1, 0) + (pos_y & ~1) * decoder->stride;	      \
+    MC_CALL (table, xy_half) (decoder->dest[0] + decoder->dest_x[0],	      \
+			      ref[0] + offset, 2 * decoder->stride, 8);	      \
+    MC_CALL (table, xy_half) (decoder->dest[0] + decoder->stride +	      \
+			      decoder->dest_x[0],			      \
+			      ref[0] + decoder->stride + offset,	      \
+			      2 * decoder->stride, 8);			      \
     motion_x /= 2;							      \
+    offset = (TILE_X ((decoder->offset + motion_x) >> 1, 1) +		      \
+	      (pos_y & ~1) * decoder->uv_stride);			      \
     xy_half = ((pos_y & 1) << 1) | (motion_x & 1);			      \
-    table[4+xy_half] (decoder->dest[1] + (decoder->offset >> 1),	      \
-		      ref[1] + offset, 2 * decoder->uv_stride, 8);	      \
-    table[4+xy_half] (decoder->dest[1] + decoder->uv_stride +		      \
-		      (decoder->offset >> 1),				      \
-		      ref[1] + decoder->uv_stride + offset,		      \
-		      2 * decoder->uv_stride, 8);			      \
-    table[4+xy_half] (decoder->dest[2] + (decoder->offset >> 1),	      \
-		      ref[2] + offset, 2 * decoder->uv_stride, 8);	      \
-    table[4+xy_half] (decoder->dest[2] + decoder->uv_stride +		      \
-		      (decoder->offset >> 1),				      \
-		      ref[2] + decoder->uv_stride + offset,		      \
-		      2 * decoder->uv_stride, 8)
+    MC_CALL (table, 4+xy_half) (decoder->dest[1] + decoder->dest_x[1],	      \
+				ref[1] + offset, 2 * decoder->uv_stride, 8);  \
+    MC_CALL (table, 4+xy_half) (decoder->dest[1] + decoder->uv_stride +	      \
+				decoder->dest_x[1],			      \
+				ref[1] + decoder->uv_stride + offset,	      \
+				2 * decoder->uv_stride, 8);		      \
+    MC_CALL (table, 4+xy_half) (decoder->dest[2] + decoder->dest_x[1],	      \
+				ref[2] + offset, 2 * decoder->uv_stride, 8);  \
+    MC_CALL (table, 4+xy_half) (decoder->dest[2] + decoder->uv_stride +	      \
+				decoder->dest_x[1],			      \
+				ref[2] + decoder->uv_stride + offset,	      \
+				2 * decoder->uv_stride, 8)
 
 #define MOTION_ZERO_422(table,ref)					      \
-    offset = decoder->offset + decoder->v_offset * decoder->stride;	      \
-    table[0] (decoder->dest[0] + decoder->offset,			      \
-	      ref[0] + offset, decoder->stride, 16);			      \
-    offset >>= 1;							      \
-    table[4] (decoder->dest[1] + (decoder->offset >> 1),		      \
-	      ref[1] + offset, decoder->uv_stride, 16);			      \
-    table[4] (decoder->dest[2] + (decoder->offset >> 1),		      \
-	      ref[2] + offset, decoder->uv_stride, 16)
+    offset = decoder->dest_x[0] + decoder->v_offset * decoder->stride;	      \
+    MC_CALL (table, 0) (decoder->dest[0] + decoder->dest_x[0],		      \
+			ref[0] + offset, decoder->stride, 16);		      \
+    offset = decoder->dest_x[1] + decoder->v_offset * decoder->uv_stride;     \
+    MC_CALL (table, 4) (decoder->dest[1] + decoder->dest_x[1],		      \
+			ref[1] + offset, decoder->uv_stride, 16);	      \
+    MC_CALL (table, 4) (decoder->dest[2] + decoder->dest_x[1],		      \
+			ref[2] + offset, decoder->uv_stride, 16)
 
 #define MOTION_444(table,ref,motion_x,motion_y,size,y)			      \
     pos_x = 2 * decoder->offset + motion_x;				      \
     pos_y = 2 * decoder->v_offset + motion_y + 2 * y;			      \
-    if (unlikely (pos_x > decoder->limit_x)) {				      \
-	pos_x = ((int)pos_x < 0) ? 0 : decoder->limit_x;		      \
+    if (unlikely ((unsigned) (pos_x + decoder->pad_x) > decoder->limit_x)) {  \
+	pos_x = ((pos_x < 0) ? 0 : (int) decoder->limit_x) - decoder->pad_x;  \
 	motion_x = pos_x - 2 * decoder->offset;				      \
     }									      \
-    if (unlikely (pos_y > decoder->limit_y_ ## size)) {			      \
-	pos_y = ((int)pos_y < 0) ? 0 : decoder->limit_y_ ## size;	      \
+    if (unlikely ((unsigned) (pos_y + decoder->pad_y) >			      \
+		  decoder->limit_y_ ## size)) {				      \
+	pos_y = (((pos_y < 0) ? 0 : (int) decoder->limit_y_ ## size) -	      \
+		 decoder->pad_y);					      \
 	motion_y = pos_y - 2 * decoder->v_offset - 2 * y;		      \
     }									      \
     xy_half = ((pos_y & 1) << 1) | (pos_x & 1);				      \
-    offset = (pos_x >> 1) + (pos_y >> 1) * decoder->stride;		      \
-    table[xy_half] (decoder->dest[0] + y * decoder->stride + decoder->offset, \
-		    ref[0] + offset, decoder->stride, size);		      \
-    table[xy_half] (decoder->dest[1] + y * decoder->stride + decoder->offset, \
-		    ref[1] + offset, decoder->stride, size);		      \
-    table[xy_half] (decoder->dest[2] + y * decoder->stride + decoder->offset, \
-		    ref[2] + offset, decoder->stride, size)
+    offset = TILE_X (pos_x >> 1, 0) + (pos_y >> 1) * decoder->stride;	      \
+    MC_CALL (table, xy_half) (decoder->dest[0] + y * decoder->stride +	      \
+			      decoder->dest_x[0],			      \
+			      ref[0] + offset, decoder->stride, size);	      \
+    MC_CALL (table, xy_half) (decoder->dest[1] + y * decoder->stride +	      \
+			      decoder->dest_x[1],			      \
+			      ref[1] + offset, decoder->stride, size);	      \
+    MC_CALL (table, xy_half) (decoder->dest[2] + y * decoder->stride +	      \
+			      decoder->dest_x[1],			      \
+			      ref[2] + offset, decoder->stride, size)
 
 #define MOTION_FIELD_444(table,ref,motion_x,motion_y,dest_field,op,src_field) \
     pos_x = 2 * decoder->offset + motion_x;				      \
     pos_y = decoder->v_offset + motion_y;				      \
-    if (unlikely (pos_x > decoder->limit_x)) {				      \
-	pos_x = ((int)pos_x < 0) ? 0 : decoder->limit_x;		      \
+    if (unlikely ((unsigned) (pos_x + decoder->pad_x) > decoder->limit_x)) {  \
+	pos_x = ((pos_x < 0) ? 0 : (int) decoder->limit_x) - decoder->pad_x;  \
 	motion_x = pos_x - 2 * decoder->offset;				      \
     }									      \
-    if (unlikely (pos_y > decoder->limit_y)) {				      \
-	pos_y = ((int)pos_y < 0) ? 0 : decoder->limit_y;		      \
+    if (unlikely ((unsigned) (pos_y + decoder->pad_y_field) >		      \
+		  decoder->limit_y_field)) {				      \
+	pos_y = (((pos_y < 0) ? 0 : (int) decoder->limit_y_field) -	      \
+		 decoder->pad_y_field);					      \
 	motion_y = pos_y - decoder->v_offset;				      \
     }									      \
     xy_half = ((pos_y & 1) << 1) | (pos_x & 1);				      \
-    offset = (pos_x >> 1) + ((pos_y op) + src_field) * decoder->stride;	      \
-    table[xy_half] (decoder->dest[0] + dest_field * decoder->stride +	      \
-		    decoder->offset, ref[0] + offset,			      \
-		    2 * decoder->stride, 8);				      \
-    table[xy_half] (decoder->dest[1] + dest_field * decoder->stride +	      \
-		    decoder->offset, ref[1] + offset,			      \
-		    2 * decoder->stride, 8);				      \
-    table[xy_half] (decoder->dest[2] + dest_field * decoder->stride +	      \
-		    decoder->offset, ref[2] + offset,			      \
-		    2 * decoder->stride, 8)
+    offset = (TILE_X (pos_x >> 1, 0) +					      \
+	      ((pos_y op) + src_field) * decoder->stride);		      \
+    MC_CALL (table, xy_half) (decoder->dest[0] +			      \
+			      dest_field * decoder->stride +		      \
+			      decoder->dest_x[0], ref[0] + offset,	      \
+			      2 * decoder->stride, 8);			      \
+    MC_CALL (table, xy_half) (decoder->dest[1] +			      \
+			      dest_field * decoder->stride +		      \
+			      decoder->dest_x[1], ref[1] + offset,	      \
+			      2 * decoder->stride, 8);			      \
+    MC_CALL (table, xy_half) (decoder->dest[2] +			      \
+			      dest_field * decoder->stride +		      \
+			      decoder->dest_x[1], ref[2] + offset,	      \
+			      2 * decoder->stride, 8)
 
 #define MOTION_DMV_444(table,ref,motion_x,motion_y)			      \
     pos_x = 2 * decoder->offset + motion_x;				      \
     pos_y = decoder->v_offset + motion_y;				      \
-    if (unlikely (pos_x > decoder->limit_x)) {				      \
-	pos_x = ((int)pos_x < 0) ? 0 : decoder->limit_x;		      \
+    if (unlikely ((unsigned) (pos_x + decoder->pad_x) > decoder->limit_x)) {  \
+	pos_x = ((pos_x < 0) ? 0 : (int) decoder->limit_x) - decoder->pad_x;  \
 	motion_x = pos_x - 2 * decoder->offset;				      \
     }									      \
-    if (unlikely (pos_y > decoder->limit_y)) {				      \
-	pos_y = ((int)pos_y < 0) ? 0 : decoder->limit_y;		      \
+    if (unlikely ((unsigned) (pos_y + decoder->pad_y_field) >		      \
+		  decoder->limit_y_field)) {				      \
+	pos_y = (((pos_y < 0) ? 0 : (int) decoder->limit_y_field) -	      \
+		 decoder->pad_y_field);					      \
 	motion_y = pos_y - decoder->v_offset;				      \
     }									      \
     xy_half = ((pos_y & 1) << 1) | (pos_x & 1);				      \
-    offset = (pos_x >> 1) + (pos_y & ~1) * decoder->stride;		      \
-    table[xy_half] (decoder->dest[0] + decoder->offset,			      \
-		    ref[0] + offset, 2 * decoder->stride, 8);		      \
-    table[xy_half] (decoder->dest[0] + decoder->stride + decoder->offset,     \
-		    ref[0] + decoder->stride + offset,			      \
-		    2 * decoder->stride, 8);				      \
-    table[xy_half] (decoder->dest[1] + decoder->offset,			      \
-		    ref[1] + offset, 2 * decoder->stride, 8);		      \
-    table[xy_half] (decoder->dest[1] + decoder->stride + decoder->offset,     \
-		    ref[1] + decoder->stride + offset,			      \
-		    2 * decoder->stride, 8);				      \
-    table[xy_half] (decoder->dest[2] + decoder->offset,			      \
-		    ref[2] + offset, 2 * decoder->stride, 8);		      \
-    table[xy_half] (decoder->dest[2] + decoder->stride + decoder->offset,     \
-		    ref[2] + decoder->stride + offset,			      \
-		    2 * decoder->stride, 8)
+    offset = TILE_X (pos_x >> 1, 0) + (pos_y & ~1) * decoder->stride;	      \
+    MC_CALL (table, xy_half) (decoder->dest[0] + decoder->dest_x[0],	      \
+			      ref[0] + offset, 2 * decoder->stride, 8);	      \
+    MC_CALL (table, xy_half) (decoder->dest[0] + decoder->stride +	      \
+			      decoder->dest_x[0],			      \
+			      ref[0] + decoder->stride + offset,	      \
+			      2 * decoder->stride, 8);			      \
+    MC_CALL (table, xy_half) (decoder->dest[1] + decoder->dest_x[1],	      \
+			      ref[1] + offset, 2 * decoder->stride, 8);	      \
+    MC_CALL (table, xy_half) (decoder->dest[1] + decoder->stride +	      \
+			      decoder->dest_x[1],			      \
+			      ref[1] + decoder->stride + offset,	      \
+			      2 * decoder->stride, 8);			      \
+    MC_CALL (table, xy_half) (decoder->dest[2] + decoder->dest_x[1],	      \
+			      ref[2] + offset, 2 * decoder->stride, 8);	      \
+    MC_CALL (table, xy_half) (decoder->dest[2] + decoder->stride +	      \
+			      decoder->dest_x[1],			      \
+			      ref[2] + decoder->stride + offset,	      \
+			      2 * decoder->stride, 8)
 
 #define MOTION_ZERO_444(table,ref)					      \
-    offset = decoder->offset + decoder->v_offset * decoder->stride;	      \
-    table[0] (decoder->dest[0] + decoder->offset,			      \
-	      ref[0] + offset, decoder->stride, 16);			      \
-    table[4] (decoder->dest[1] + decoder->offset,			      \
-	      ref[1] + offset, decoder->stride, 16);			      \
-    table[4] (decoder->dest[2] + decoder->offset,			      \
-	      ref[2] + offset, decoder->stride, 16)
-
-#define bit_buf (decoder->bitstream_buf)
-#define bits (decoder->bitstream_bits)
-#define bit_ptr (decoder->bitstream_ptr)
-
-static void motion_mp1 (mpeg2_decoder_t * const decoder,
-			motion_t * const motion,
-			mpeg2_mc_fct * const * const table)
-{
-    int motion_x, motion_y;
-    unsigned int pos_x, pos_y, xy_half, offset;
-
-    NEEDBITS (bit_buf, bits, bit_ptr);
-    motion_x = (motion->pmv[0][0] +
-		(get_motion_delta (decoder,
-				   motion->f_code[0]) << motion->f_code[1]));
-    motion_x = bound_motion_vector (motion_x,
-				    motion->f_code[0] + motion->f_code[1]);
-    motion->pmv[0][0] = motion_x;
-
-    NEEDBITS (bit_buf, bits, bit_ptr);
-    motion_y = (motion->pmv[0][1] +
-		(get_motion_delta (decoder,
-				   motion->f_code[0]) << motion->f_code[1]));
-    motion_y = bound_motion_vector (motion_y,
-				    motion->f_code[0] + motion->f_code[1]);
-    motion->pmv[0][1] = motion_y;
-
-    MOTION_420 (table, motion->ref[0], motion_x, motion_y, 16, 0);
+    offset = decoder->dest_x[0] + decoder->v_offset * decoder->stride;	      \
+    MC_CALL (table, 0) (decoder->dest[0] + decoder->dest_x[0],		      \
+			ref[0] + offset, decoder->stride, 16);		      \
+    MC_CALL (table, 4) (decoder->dest[1] + decoder->dest_x[1],		      \
+			ref[1] + offset, decoder->stride, 16);		      \
+    MC_CALL (table, 4) (decoder->dest[2] + decoder->dest_x[1],		      \
+			ref[2] + offset, decoder->stride, 16)
+
+#define bit_buf (bs->buf)
+#define bits (bs->bits)
+#define bit_ptr (bs->ptr)
+
+#define MOTION_MP1(NAME,TILED)						      \
+									      \
+static void motion_##NAME (mpeg2_decoder_t * const decoder,		      \
+			  bitstream_t * const bs, motion_t * const motion,    \
+			  mpeg2_mc_fct * const * const table)		      \
+{									      \
+    const int tiled = TILED;						      \
+    int motion_x, motion_y;						      \
+    int pos_x, pos_y, xy_half, offset;					      \
+									      \
+    NEEDBITS (bit_buf, bits, bit_ptr);					      \
+    motion_x = (motion->pmv[0][0] +					      \
+		(get_motion_delta (bs,					      \
+				   motion->f_code[0]) << motion->f_code[1])); \
+    motion_x = bound_motion_vector (motion_x,				      \
+				    motion->f_code[0] + motion->f_code[1]);   \
+    motion->pmv[0][0] = motion_x;					      \
+									      \
+    NEEDBITS (bit_buf, bits, bit_ptr);					      \
+    motion_y = (motion->pmv[0][1] +					      \
+		(get_motion_delta (bs,					      \
+				   motion->f_code[0]) << motion->f_code[1])); \
+    motion_y = bound_motion_vector (motion_y,				      \
+				    motion->f_code[0] + motion->f_code[1]);   \
+    motion->pmv[0][1] = motion_y;					      \
+									      \
+    MOTION_420 (table, motion->ref[0], motion_x, motion_y, 16, 0);	      \
 }
 
-#define MOTION_FUNCTIONS(FORMAT,MOTION,MOTION_FIELD,MOTION_DMV,MOTION_ZERO)   \
+MOTION_MP1 (mp1, 0)
+MOTION_MP1 (mp1_tiled, 1)
+
+#define MOTION_FUNCTIONS(FORMAT,TILED,MOTION,MOTION_FIELD,MOTION_DMV,	      \
+			 MOTION_ZERO)					      \
 									      \
 static void motion_fr_frame_##FORMAT (mpeg2_decoder_t * const decoder,	      \
+				      bitstream_t * const bs,		      \
 				      motion_t * const motion,		      \
 				      mpeg2_mc_fct * const * const table)     \
 {									      \
+    const int tiled = TILED;						      \
     int motion_x, motion_y;						      \
-    unsigned int pos_x, pos_y, xy_half, offset;				      \
+    int pos_x, pos_y, xy_half, offset;					      \
 									      \
     NEEDBITS (bit_buf, bits, bit_ptr);					      \
-    motion_x = motion->pmv[0][0] + get_motion_delta (decoder,		      \
-						     motion->f_code[0]);      \
+    motion_x = motion->pmv[0][0] + get_motion_delta (bs, motion->f_code[0]); \
     motion_x = bound_motion_vector (motion_x, motion->f_code[0]);	      \
     motion->pmv[1][0] = motion->pmv[0][0] = motion_x;			      \
 									      \
     NEEDBITS (bit_buf, bits, bit_ptr);					      \
-    motion_y = motion->pmv[0][1] + get_motion_delta (decoder,		      \
-						     motion->f_code[1]);      \
+    motion_y = motion->pmv[0][1] + get_motion_delta (bs, motion->f_code[1]); \
     motion_y = bound_motion_vector (motion_y, motion->f_code[1]);	      \
     motion->pmv[1][1] = motion->pmv[0][1] = motion_y;			      \
 									      \
@@ -1305,24 +1639,25 @@ static void motion_fr_frame_##FORMAT (mpeg2_decoder_t * const decoder,	      \
 }									      \
 									      \
 static void motion_fr_field_##FORMAT (mpeg2_decoder_t * const decoder,	      \
+				      bitstream_t * const bs,		      \
 				      motion_t * const motion,		      \
 				      mpeg2_mc_fct * const * const table)     \
 {									      \
+    const int tiled = TILED;						      \
     int motion_x, motion_y, field;					      \
-    unsigned int pos_x, pos_y, xy_half, offset;				      \
+    int pos_x, pos_y, xy_half, offset;					      \
 									      \
     NEEDBITS (bit_buf, bits, bit_ptr);					      \
     field = UBITS (bit_buf, 1);						      \
     DUMPBITS (bit_buf, bits, 1);					      \
 									      \
-    motion_x = motion->pmv[0][0] + get_motion_delta (decoder,		      \
-						     motion->f_code[0]);      \
+    motion_x = motion->pmv[0][0] + get_motion_delta (bs, motion->f_code[0]); \
     motion_x = bound_motion_vector (motion_x, motion->f_code[0]);	      \
     motion->pmv[0][0] = motion_x;					      \
 									      \
     NEEDBITS (bit_buf, bits, bit_ptr);					      \
     motion_y = ((motion->pmv[0][1] >> 1) +				      \
-		get_motion_delta (decoder, motion->f_code[1]));		      \
+		get_motion_delta (bs, motion->f_code[1]));		      \
     /* motion_y = bound_motion_vector (motion_y, motion->f_code[1]); */	      \
     motion->pmv[0][1] = motion_y << 1;					      \
 									      \
@@ -1332,14 +1667,13 @@ static void motion_fr_field_##FORMAT (mpeg2_decoder_t * const decoder,	      \
     field = UBITS (bit_buf, 1);						      \
     DUMPBITS (bit_buf, bits, 1);					      \
 									      \
-    motion_x = motion->pmv[1][0] + get_motion_delta (decoder,		      \
-						     motion->f_code[0]);      \
+    motion_x = motion->pmv[1][0] + get_motion_delta (bs, motion->f_code[0]); \
     motion_x = bound_motion_vector (motion_x, motion->f_code[0]);	      \
     motion->pmv[1][0] = motion_x;					      \
 									      \
     NEEDBITS (bit_buf, bits, bit_ptr);					      \
     motion_y = ((motion->pmv[1][1] >> 1) +				      \
-		get_motion_delta (decoder, motion->f_code[1]));		      \
+		get_motion_delta (bs, motion->f_code[1]));		      \
     /* motion_y = bound_motion_vector (motion_y, motion->f_code[1]); */	      \
     motion->pmv[1][1] = motion_y << 1;					      \
 									      \
@@ -1347,25 +1681,26 @@ static void motion_fr_field_##FORMAT (mpeg2_decoder_t * const decoder,	      \
 }									      \
 									      \
 static void motion_fr_dmv_##FORMAT (mpeg2_decoder_t * const decoder,	      \
+				    bitstream_t * const bs,		      \
 				    motion_t * const motion,		      \
 				    mpeg2_mc_fct * const * const table)	      \
 {									      \
+    const int tiled = TILED;						      \
     int motion_x, motion_y, dmv_x, dmv_y, m, other_x, other_y;		      \
-    unsigned int pos_x, pos_y, xy_half, offset;				      \
+    int pos_x, pos_y, xy_half, offset;					      \
 									      \
     NEEDBITS (bit_buf, bits, bit_ptr);					      \
-    motion_x = motion->pmv[0][0] + get_motion_delta (decoder,		      \
-						     motion->f_code[0]);      \
+    motion_x = motion->pmv[0][0] + get_motion_delta (bs, motion->f_code[0]); \
     motion_x = bound_motion_vector (motion_x, motion->f_code[0]);	      \
     motion->pmv[1][0] = motion->pmv[0][0] = motion_x;			      \
     NEEDBITS (bit_buf, bits, bit_ptr);					      \
-    dmv_x = get_dmv (decoder);						      \
+    dmv_x = get_dmv (bs);						      \
 									      \
     motion_y = ((motion->pmv[0][1] >> 1) +				      \
-		get_motion_delta (decoder, motion->f_code[1]));		      \
+		get_motion_delta (bs, motion->f_code[1]));		      \
     /* motion_y = bound_motion_vector (motion_y, motion->f_code[1]); */	      \
     motion->pmv[1][1] = motion->pmv[0][1] = motion_y << 1;		      \
-    dmv_y = get_dmv (decoder);						      \
+    dmv_y = get_dmv (bs);						      \
 									      \
     m = decoder->top_field_first ? 1 : 3;				      \
     other_x = ((motion_x * m + (motion_x > 0)) >> 1) + dmv_x;		      \
@@ -1381,11 +1716,13 @@ static void motion_fr_dmv_##FORMAT (mpeg2_decoder_t * const decoder,	      \
 }									      \
 									      \
 static void motion_reuse_##FORMAT (mpeg2_decoder_t * const decoder,	      \
+				   bitstream_t * const bs,		      \
 				   motion_t * const motion,		      \
 				   mpeg2_mc_fct * const * const table)	      \
 {									      \
+    const int tiled = TILED;						      \
     int motion_x, motion_y;						      \
-    unsigned int pos_x, pos_y, xy_half, offset;				      \
+    int pos_x, pos_y, xy_half, offset;					      \
 									      \
     motion_x = motion->pmv[0][0];					      \
     motion_y = motion->pmv[0][1];					      \
@@ -1394,6 +1731,7 @@ static void motion_reuse_##FORMAT (mpeg2_decoder_t * const decoder,	      \
 }									      \
 									      \
 static void motion_zero_##FORMAT (mpeg2_decoder_t * const decoder,	      \
+				  bitstream_t * const bs,		      \
 				  motion_t * const motion,		      \
 				  mpeg2_mc_fct * const * const table)	      \
 {									      \
@@ -1406,25 +1744,25 @@ static void motion_zero_##FORMAT (mpeg2_decoder_t * const decoder,	      \
 }									      \
 									      \
 static void motion_fi_field_##FORMAT (mpeg2_decoder_t * const decoder,	      \
+				      bitstream_t * const bs,		      \
 				      motion_t * const motion,		      \
 				      mpeg2_mc_fct * const * const table)     \
 {									      \
+    const int tiled = TILED;						      \
     int motion_x, motion_y;						      \
     uint8_t ** ref_field;						      \
-    unsigned int pos_x, pos_y, xy_half, offset;				      \
+    int pos_x, pos_y, xy_half, offset;					      \
 									      \
     NEEDBITS (bit_buf, bits, bit_ptr);					      \
     ref_field = motion->ref2[UBITS (bit_buf, 1)];			      \
     DUMPBITS (bit_buf, bits, 1);					      \
 									      \
-    motion_x = motion->pmv[0][0] + get_motion_delta (decoder,		      \
-						     motion->f_code[0]);      \
+    motion_x = motion->pmv[0][0] + get_motion_delta (bs, motion->f_code[0]); \
     motion_x = bound_motion_vector (motion_x, motion->f_code[0]);	      \
     motion->pmv[1][0] = motion->pmv[0][0] = motion_x;			      \
 									      \
     NEEDBITS (bit_buf, bits, bit_ptr);					      \
-    motion_y = motion->pmv[0][1] + get_motion_delta (decoder,		      \
-						     motion->f_code[1]);      \
+    motion_y = motion->pmv[0][1] + get_motion_delta (bs, motion->f_code[1]); \
     motion_y = bound_motion_vector (motion_y, motion->f_code[1]);	      \
     motion->pmv[1][1] = motion->pmv[0][1] = motion_y;			      \
 									      \
@@ -1432,25 +1770,25 @@ static void motion_fi_field_##FORMAT (mpeg2_decoder_t * const decoder,	      \
 }									      \
 									      \
 static void motion_fi_16x8_##FORMAT (mpeg2_decoder_t * const decoder,	      \
+				     bitstream_t * const bs,		      \
 				     motion_t * const motion,		      \
 				     mpeg2_mc_fct * const * const table)      \
 {									      \
+    const int tiled = TILED;						      \
     int motion_x, motion_y;						      \
     uint8_t ** ref_field;						      \
-    unsigned int pos_x, pos_y, xy_half, offset;				      \
+    int pos_x, pos_y, xy_half, offset;					      \
 									      \
     NEEDBITS (bit_buf, bits, bit_ptr);					      \
     ref_field = motion->ref2[UBITS (bit_buf, 1)];			      \
     DUMPBITS (bit_buf, bits, 1);					      \
 									      \
-    motion_x = motion->pmv[0][0] + get_motion_delta (decoder,		      \
-						     motion->f_code[0]);      \
+    motion_x = motion->pmv[0][0] + get_motion_delta (bs, motion->f_code[0]); \
     motion_x = bound_motion_vector (motion_x, motion->f_code[0]);	      \
     motion->pmv[0][0] = motion_x;					      \
 									      \
     NEEDBITS (bit_buf, bits, bit_ptr);					      \
-    motion_y = motion->pmv[0][1] + get_motion_delta (decoder,		      \
-						     motion->f_code[1]);      \
+    motion_y = motion->pmv[0][1] + get_motion_delta (bs, motion->f_code[1]); \
     motion_y = bound_motion_vector (motion_y, motion->f_code[1]);	      \
     motion->pmv[0][1] = motion_y;					      \
 									      \
@@ -1460,14 +1798,12 @@ static void motion_fi_16x8_##FORMAT (mpeg2_decoder_t * const decoder,	      \
     ref_field = motion->ref2[UBITS (bit_buf, 1)];			      \
     DUMPBITS (bit_buf, bits, 1);					      \
 									      \
-    motion_x = motion->pmv[1][0] + get_motion_delta (decoder,		      \
-						     motion->f_code[0]);      \
+    motion_x = motion->pmv[1][0] + get_motion_delta (bs, motion->f_code[0]); \
     motion_x = bound_motion_vector (motion_x, motion->f_code[0]);	      \
     motion->pmv[1][0] = motion_x;					      \
 									      \
     NEEDBITS (bit_buf, bits, bit_ptr);					      \
-    motion_y = motion->pmv[1][1] + get_motion_delta (decoder,		      \
-						     motion->f_code[1]);      \
+    motion_y = motion->pmv[1][1] + get_motion_delta (bs, motion->f_code[1]); \
     motion_y = bound_motion_vector (motion_y, motion->f_code[1]);	      \
     motion->pmv[1][1] = motion_y;					      \
 									      \
@@ -1475,59 +1811,67 @@ static void motion_fi_16x8_##FORMAT (mpeg2_decoder_t * const decoder,	      \
 }									      \
 									      \
 static void motion_fi_dmv_##FORMAT (mpeg2_decoder_t * const decoder,	      \
+				    bitstream_t * const bs,		      \
 				    motion_t * const motion,		      \
 				    mpeg2_mc_fct * const * const table)	      \
 {									      \
+    const int tiled = TILED;						      \
     int motion_x, motion_y, other_x, other_y;				      \
-    unsigned int pos_x, pos_y, xy_half, offset;				      \
+    int pos_x, pos_y, xy_half, offset;					      \
 									      \
     NEEDBITS (bit_buf, bits, bit_ptr);					      \
-    motion_x = motion->pmv[0][0] + get_motion_delta (decoder,		      \
-						     motion->f_code[0]);      \
+    motion_x = motion->pmv[0][0] + get_motion_delta (bs, motion->f_code[0]); \
     motion_x = bound_motion_vector (motion_x, motion->f_code[0]);	      \
     motion->pmv[1][0] = motion->pmv[0][0] = motion_x;			      \
     NEEDBITS (bit_buf, bits, bit_ptr);					      \
-    other_x = ((motion_x + (motion_x > 0)) >> 1) + get_dmv (decoder);	      \
+    other_x = ((motion_x + (motion_x > 0)) >> 1) + get_dmv (bs);	      \
 									      \
-    motion_y = motion->pmv[0][1] + get_motion_delta (decoder,		      \
-						     motion->f_code[1]);      \
+    motion_y = motion->pmv[0][1] + get_motion_delta (bs, motion->f_code[1]); \
     motion_y = bound_motion_vector (motion_y, motion->f_code[1]);	      \
     motion->pmv[1][1] = motion->pmv[0][1] = motion_y;			      \
-    other_y = (((motion_y + (motion_y > 0)) >> 1) + get_dmv (decoder) +	      \
+    other_y = (((motion_y + (motion_y > 0)) >> 1) + get_dmv (bs) +	      \
 	       decoder->dmv_offset);					      \
 									      \
     MOTION (mpeg2_mc.put, motion->ref[0], motion_x, motion_y, 16, 0);	      \
     MOTION (mpeg2_mc.avg, motion->ref[1], other_x, other_y, 16, 0);	      \
 }									      \
 
-MOTION_FUNCTIONS (420, MOTION_420, MOTION_FIELD_420, MOTION_DMV_420,
+MOTION_FUNCTIONS (420, 0, MOTION_420, MOTION_FIELD_420, MOTION_DMV_420,
+		  MOTION_ZERO_420)
+MOTION_FUNCTIONS (422, 0, MOTION_422, MOTION_FIELD_422, MOTION_DMV_422,
+		  MOTION_ZERO_422)
+MOTION_FUNCTIONS (444, 0, MOTION_444, MOTION_FIELD_444, MOTION_DMV_444,
+		  MOTION_ZERO_444)
+MOTION_FUNCTIONS (420_tiled, 1, MOTION_420, MOTION_FIELD_420, MOTION_DMV_420,
 		  MOTION_ZERO_420)
-MOTION_FUNCTIONS (422, MOTION_422, MOTION_FIELD_422, MOTION_DMV_422,
+MOTION_FUNCTIONS (422_tiled, 1, MOTION_422, MOTION_FIELD_422, MOTION_DMV_422,
 		  MOTION_ZERO_422)
-MOTION_FUNCTIONS (444, MOTION_444, MOTION_FIELD_444, MOTION_DMV_444,
+MOTION_FUNCTIONS (444_tiled, 1, MOTION_444, MOTION_FIELD_444, MOTION_DMV_444,
 		  MOTION_ZERO_444)
 
 /* like motion_frame, but parsing without actual motion compensation */
-static void motion_fr_conceal (mpeg2_decoder_t * const decoder)
+static void motion_fr_conceal (mpeg2_decoder_t * const decoder,
+			       bitstream_t * const bs)
 {
     int tmp;
 
     NEEDBITS (bit_buf, bits, bit_ptr);
     tmp = (decoder->f_motion.pmv[0][0] +
-	   get_motion_delta (decoder, decoder->f_motion.f_code[0]));
+	   get_motion_delta (bs, decoder->f_motion.f_code[0]));
     tmp = bound_motion_vector (tmp, decoder->f_motion.f_code[0]);
     decoder->f_motion.pmv[1][0] = decoder->f_motion.pmv[0][0] = tmp;
 
     NEEDBITS (bit_buf, bits, bit_ptr);
     tmp = (decoder->f_motion.pmv[0][1] +
-	   get_motion_delta (decoder, decoder->f_motion.f_code[1]));
+	   get_motion_delta (bs, decoder->f_motion.f_code[1]));
     tmp = bound_motion_vector (tmp, decoder->f_motion.f_code[1]);
     decoder->f_motion.pmv[1][1] = decoder->f_motion.pmv[0][1] = tmp;
 
     DUMPBITS (bit_buf, bits, 1); /* remove marker_bit */
 }
 
-static void motion_fi_conceal (mpeg2_decoder_t * const decoder)
+static void motion_fi_conceal (mpeg2_decoder_t * const decoder,
+			       bitstream_t * const bs)
 {
     int tmp;
 
@@ -1535,13 +1879,13 @@ static void motion_fi_conceal (mpeg2_decoder_t * const decoder)
     DUMPBITS (bit_buf, bits, 1); /* remove field_select */
 
     tmp = (decoder->f_motion.pmv[0][0] +
-	   get_motion_delta (decoder, decoder->f_motion.f_code[0]));
+	   get_motion_delta (bs, decoder->f_motion.f_code[0]));
     tmp = bound_motion_vector (tmp, decoder->f_motion.f_code[0]);
     decoder->f_motion.pmv[1][0] = decoder->f_motion.pmv[0][0] = tmp;
 
     NEEDBITS (bit_buf, bits, bit_ptr);
     tmp = (decoder->f_motion.pmv[0][1] +
-	   get_motion_delta (decoder, decoder->f_motion.f_code[1]));
+	   get_motion_delta (bs, decoder->f_motion.f_code[1]));
     tmp = bound_motion_vector (tmp, decoder->f_motion.f_code[1]);
     decoder->f_motion.pmv[1][1] = decoder->f_motion.pmv[0][1] = tmp;
 
@@ -1552,24 +1896,152 @@ static void motion_fi_conceal (mpeg2_decoder_t * const decoder)
 #undef bits
 #undef bit_ptr
 
-#define MOTION_CALL(routine,direction)				\
-do {								\
-    if ((direction) & MACROBLOCK_MOTION_FORWARD)		\
-	routine (decoder, &(decoder->f_motion), mpeg2_mc.put);	\
-    if ((direction) & MACROBLOCK_MOTION_BACKWARD)		\
-	routine (decoder, &(decoder->b_motion),			\
-		 ((direction) & MACROBLOCK_MOTION_FORWARD ?	\
-		  mpeg2_mc.avg : mpeg2_mc.put));		\
+#define MOTION_CALL(routine,direction)					\
+do {									\
+    STATS (uint64_t stats_start = stats_clock ();)			\
+    if ((direction) & MACROBLOCK_MOTION_FORWARD)			\
+	routine (decoder, &bs, &(decoder->f_motion), mpeg2_mc.put);	\
+    if ((direction) & MACROBLOCK_MOTION_BACKWARD)			\
+	routine (decoder, &bs, &(decoder->b_motion),			\
+		 ((direction) & MACROBLOCK_MOTION_FORWARD ?		\
+		  mpeg2_mc.avg : mpeg2_mc.put));			\
+    STATS (decoder->stats.mc_time +=					\
+	   stats_clock () - stats_start;)				\
 } while (0)
 
+/*
+ * Replicate the edges of the macroblock row that was just decoded into
+ * the border of the frame buffer, and above or below it for the first
+ * and last rows. Each field is extended from its own lines, so that
+ * field predictions reaching into the border stay within their field.
+ */
+static void extend_row (mpeg2_decoder_t * const decoder)
+{
+    int i, j, k, width, lines, border_x, border_y, stride, fields;
+    uint8_t * row;
+    uint8_t * line;
+
+    fields = (decoder->picture_structure == FRAME_PICTURE) ? 2 : 1;
+    for (i = 0; i < 3; i++) {
+	row = decoder->dest[i];
+	width = decoder->width;
+	lines = 16;
+	border_x = border_y = decoder->border;
+	stride = decoder->stride;
+	if (i && decoder->chroma_format != 2) {
+	    width >>= 1;
+	    border_x >>= 1;
+	    stride = decoder->uv_stride;
+	}
+	if (i && decoder->chroma_format == 0) {
+	    lines >>= 1;
+	    border_y >>= 1;
+	}
+
+	for (j = 0; j < lines; j++) {
+	    line = row + j * stride;
+	    memset (line - border_x, line[0], border_x);
+	    memset (line + width, line[width - 1], border_x);
+	}
+
+	/* border_y frame lines hold border_y / 2 lines of each field */
+	if (decoder->v_offset == 0)
+	    for (j = 0; j < fields; j++) {
+		line = row + j * stride - border_x;
+		for (k = 1; k <= border_y >> 1; k++)
+		    memcpy (line - k * fields * stride, line,
+			    width + 2 * border_x);
+	    }
+	if (decoder->v_offset == decoder->limit_y)
+	    for (j = 0; j < fields; j++) {
+		line = row + (lines - fields + j) * stride - border_x;
+		for (k = 1; k <= border_y >> 1; k++)
+		    memcpy (line + k * fields * stride, line,
+			    width + 2 * border_x);
+	    }
+    }
+}
+
+/*
+ * Finish a macroblock row of a tiled picture. Each tile gets the copy
+ * of the next column that half-pel predictions from it will read, and
+ * the row is written out to the raster frame buffer for display. The
+ * copies are skipped in B pictures, which nothing is predicted from.
+ */
+static void tile_row (mpeg2_decoder_t * const decoder, const int row)
+{
+    int i, j, k, x_shift, width, tile_width, copy, lines, step, stride;
+    int out_stride, copies;
+    uint8_t * tile;
+    uint8_t * out;
+
+    copies = (decoder->coding_type != B_TYPE);
+    for (i = 0; i < 3; i++) {
+	x_shift = (i && decoder->chroma_format != 2);
+	width = decoder->width >> x_shift;
+	tile_width = (1 << TILE_SHIFT) >> x_shift;
+	lines = 16 >> (i && decoder->chroma_format == 0);
+	step = decoder->tile_size[i != 0];
+	stride = x_shift ? decoder->uv_stride : decoder->stride;
+	out_stride = decoder->tiled_out_stride >> x_shift;
+	tile = decoder->picture_dest[i] + row * lines * stride;
+	out = decoder->tiled_out[i] + row * lines * out_stride;
+
+	/* the lines of a tile row follow each other, one tile at a time */
+	for (k = 0; k < width; k += tile_width) {
+	    copy = (width - k < tile_width) ? width - k : tile_width;
+	    for (j = 0; j < lines; j++) {
+		if (k && copies)
+		    memcpy (tile + j * stride - step + tile_width,
+			    tile + j * stride, 16 >> x_shift);
+		memcpy (out + k + j * out_stride, tile + j * stride, copy);
+	    }
+	    tile += step;
+	}
+    }
+    if (decoder->tiled_rows == row)
+	decoder->tiled_rows++;
+    else
+	decoder->tiled_rows = -1;
+}
+
+/*
+ * Called once the slices of a picture are done. When its rows did not
+ * all come out in order, as happens with damaged streams, copy the
+ * whole picture again so that the frame buffer matches the tiles.
+ */
+void mpeg2_tile_picture (mpeg2_decoder_t * decoder)
+{
+    int row, rows;
+
+    rows = (decoder->limit_y >> 4) + 1;
+    if (decoder->tiled_rows != rows)
+	for (row = 0; row < rows; row++)
+	    tile_row (decoder, row);
+    decoder->tiled_rows = rows;
+}
+
 #define NEXT_MACROBLOCK							\
 do {									\
     decoder->offset += 16;						\
+    decoder->dest_x[0] = TILE_X (decoder->offset, 0);			\
+    decoder->dest_x[1] =						\
+	TILE_X (decoder->offset >> (decoder->chroma_format != 2), 1);	\
+    decoder->mb_budget--;						\
     if (decoder->offset == decoder->width) {				\
+	if (decoder->border && decoder->coding_type != B_TYPE)		\
+	    extend_row (decoder);					\
+	if (tiled)							\
+	    tile_row (decoder, decoder->v_offset >> 4);			\
 	do { /* just so we can use the break statement */		\
 	    if (decoder->convert) {					\
+		STATS (uint64_t stats_start = stats_clock ();)		\
+									\
 		decoder->convert (decoder->convert_id, decoder->dest,	\
 				  decoder->v_offset);			\
+		STATS (decoder->stats.convert_time +=			\
+		       stats_clock () - stats_start;)			\
+		STATS (decoder->stats.convert_calls++;)			\
 		if (decoder->coding_type == B_TYPE)			\
 		    break;						\
 	    }								\
@@ -1578,201 +2050,30 @@ do {									\
 	    decoder->dest[2] += decoder->slice_uv_stride;		\
 	} while (0);							\
 	decoder->v_offset += 16;					\
-	if (decoder->v_offset > decoder->limit_y) {			\
+	if (decoder->v_offset > decoder->limit_y ||			\
+	    decoder->mb_budget <= 0) {					\
 	    if (mpeg2_cpu_state_restore)				\
 		mpeg2_cpu_state_restore (&cpu_state);			\
 	    return;							\
 	}								\
 	decoder->offset = 0;						\
+	decoder->dest_x[0] = decoder->dest_x[1] = 0;			\
     }									\
 } while (0)
 
-/**
- * Dummy motion decoding function, to avoid calling NULL in
- * case of malformed streams.
- */
-static void motion_dummy (mpeg2_decoder_t * const decoder,
-                          motion_t * const motion,
-                          mpeg2_mc_fct * const * const table)
-{
-}
-
-static void prescale (mpeg2_decoder_t * decoder, coding_t * coding, int idx)
+static inline int slice_init (mpeg2_decoder_t * const decoder,
+			      bitstream_t * const bs, int code,
+			      const int tiled)
 {
-    static int non_linear_scale [] = {
-	 0,  1,  2,  3,  4,  5,   6,   7,
-	 8, 10, 12, 14, 16, 18,  20,  22,
-	24, 28, 32, 36, 40, 44,  48,  52,
-	56, 64, 72, 80, 88, 96, 104, 112
-    };
-    int i, j, k;
-
-    if ((coding->matrix_updates & (1 << idx)) != 0 ||
-	decoder->scaled[idx] != coding->q_scale_type) {
-	coding->matrix_updates &= ~(1 << idx);
-	decoder->scaled[idx] = coding->q_scale_type;
-	for (i = 0; i < 32; i++) {
-	    k = coding->q_scale_type ? non_linear_scale[i] : (i << 1);
-	    for (j = 0; j < 64; j++)
-		decoder->quantizer_prescale[idx][i][mpeg2_scan_norm[j]] =
-		    k * coding->quantizer_matrix[idx][j];
-	}
-    }
-}
-
-void mpeg2_init_fbuf (mpeg2_decoder_t * decoder, mpeg2_sequence_t * sequence,
-		      mpeg2_picture_t * picture, coding_t * coding,
-		      uint8_t * current_fbuf[3],
-		      uint8_t * forward_fbuf[3], uint8_t * backward_fbuf[3])
-{
-    int offset, stride, height, bottom_field;
-
-    decoder->mpeg1 = !(sequence->flags & SEQ_FLAG_MPEG2);
-    decoder->width = sequence->width;
-    height = sequence->height;
-    decoder->vertical_position_extension = (sequence->picture_height > 2800);
-
-    decoder->top_field_first =
-	((picture->flags & PIC_FLAG_TOP_FIELD_FIRST) != 0);
-    if (picture->nb_fields > 1)
-	decoder->picture_structure = FRAME_PICTURE;
-    else
-	decoder->picture_structure =
-	    decoder->top_field_first ? TOP_FIELD : BOTTOM_FIELD;
-
-    decoder->f_motion.f_code[0] = coding->f_code[0][0] - 1;
-    decoder->f_motion.f_code[1] = coding->f_code[0][1] - !(decoder->mpeg1);
-    decoder->b_motion.f_code[0] = coding->f_code[1][0] - 1;
-    decoder->b_motion.f_code[1] = coding->f_code[1][1] - !(decoder->mpeg1);
-    decoder->intra_dc_precision = 15 - coding->intra_dc_precision;
-    decoder->frame_pred_frame_dct = coding->frame_pred_frame_dct;
-    decoder->concealment_motion_vectors = coding->concealment_motion_vectors;
-    decoder->intra_vlc_format = coding->intra_vlc_format;
-    decoder->scan = coding->alternate_scan ? mpeg2_scan_alt : mpeg2_scan_norm;
-
-    if (coding->matrix_updates & 1)
-	decoder->chroma_quantizer[0] =
-	    decoder->quantizer_prescale[(coding->matrix_updates & 4) ? 2 : 0];
-    if (coding->matrix_updates & 1)
-	decoder->chroma_quantizer[1] =
-	    decoder->quantizer_prescale[(coding->matrix_updates & 8) ? 3 : 1];
-    if (decoder->coding_type != D_TYPE) {
-	prescale (decoder, coding, 0);
-	if (decoder->chroma_quantizer[0] == decoder->quantizer_prescale[2])
-	    prescale (decoder, coding, 2);
-	if (decoder->coding_type != I_TYPE) {
-	    prescale (decoder, coding, 1);
-	    if (decoder->chroma_quantizer[1] == decoder->quantizer_prescale[3])
-		prescale (decoder, coding, 3);
-	}
-    }
-
-    stride = decoder->stride_frame;
-    bottom_field = (decoder->picture_structure == BOTTOM_FIELD);
-    offset = bottom_field ? stride : 0;
-
-    decoder->picture_dest[0] = current_fbuf[0] + offset;
-    decoder->picture_dest[1] = current_fbuf[1] + (offset >> 1);
-    decoder->picture_dest[2] = current_fbuf[2] + (offset >> 1);
-
-    decoder->f_motion.ref[0][0] = forward_fbuf[0] + offset;
-    decoder->f_motion.ref[0][1] = forward_fbuf[1] + (offset >> 1);
-    decoder->f_motion.ref[0][2] = forward_fbuf[2] + (offset >> 1);
-
-    decoder->b_motion.ref[0][0] = backward_fbuf[0] + offset;
-    decoder->b_motion.ref[0][1] = backward_fbuf[1] + (offset >> 1);
-    decoder->b_motion.ref[0][2] = backward_fbuf[2] + (offset >> 1);
-
-    if (decoder->picture_structure != FRAME_PICTURE) {
-	decoder->dmv_offset = bottom_field ? 1 : -1;
-	decoder->f_motion.ref2[0] = decoder->f_motion.ref[bottom_field];
-	decoder->f_motion.ref2[1] = decoder->f_motion.ref[!bottom_field];
-	decoder->b_motion.ref2[0] = decoder->b_motion.ref[bottom_field];
-	decoder->b_motion.ref2[1] = decoder->b_motion.ref[!bottom_field];
-	offset = stride - offset;
-
-	if (decoder->second_field && (decoder->coding_type != B_TYPE))
-	    forward_fbuf = current_fbuf;
-
-	decoder->f_motion.ref[1][0] = forward_fbuf[0] + offset;
-	decoder->f_motion.ref[1][1] = forward_fbuf[1] + (offset >> 1);
-	decoder->f_motion.ref[1][2] = forward_fbuf[2] + (offset >> 1);
-
-	decoder->b_motion.ref[1][0] = backward_fbuf[0] + offset;
-	decoder->b_motion.ref[1][1] = backward_fbuf[1] + (offset >> 1);
-	decoder->b_motion.ref[1][2] = backward_fbuf[2] + (offset >> 1);
-
-	stride <<= 1;
-	height >>= 1;
-    }
-
-    decoder->stride = stride;
-    decoder->uv_stride = stride >> 1;
-    decoder->slice_stride = 16 * stride;
-    decoder->slice_uv_stride =
-	decoder->slice_stride >> (2 - decoder->chroma_format);
-    decoder->limit_x = 2 * decoder->width - 32;
-    decoder->limit_y_16 = 2 * height - 32;
-    decoder->limit_y_8 = 2 * height - 16;
-    decoder->limit_y = height - 16;
-
-    if (decoder->mpeg1) {
-	decoder->motion_parser[0] = motion_zero_420;
-        decoder->motion_parser[MC_FIELD] = motion_dummy;
- 	decoder->motion_parser[MC_FRAME] = motion_mp1;
-        decoder->motion_parser[MC_DMV] = motion_dummy;
-	decoder->motion_parser[4] = motion_reuse_420;
-    } else if (decoder->picture_structure == FRAME_PICTURE) {
-	if (decoder->chroma_format == 0) {
-	    decoder->motion_parser[0] = motion_zero_420;
-	    decoder->motion_parser[MC_FIELD] = motion_fr_field_420;
-	    decoder->motion_parser[MC_FRAME] = motion_fr_frame_420;
-	    decoder->motion_parser[MC_DMV] = motion_fr_dmv_420;
-	    decoder->motion_parser[4] = motion_reuse_420;
-	} else if (decoder->chroma_format == 1) {
-	    decoder->motion_parser[0] = motion_zero_422;
-	    decoder->motion_parser[MC_FIELD] = motion_fr_field_422;
-	    decoder->motion_parser[MC_FRAME] = motion_fr_frame_422;
-	    decoder->motion_parser[MC_DMV] = motion_fr_dmv_422;
-	    decoder->motion_parser[4] = motion_reuse_422;
-	} else {
-	    decoder->motion_parser[0] = motion_zero_444;
-	    decoder->motion_parser[MC_FIELD] = motion_fr_field_444;
-	    decoder->motion_parser[MC_FRAME] = motion_fr_frame_444;
-	    decoder->motion_parser[MC_DMV] = motion_fr_dmv_444;
-	    decoder->motion_parser[4] = motion_reuse_444;
-	}
-    } else {
-	if (decoder->chroma_format == 0) {
-	    decoder->motion_parser[0] = motion_zero_420;
-	    decoder->motion_parser[MC_FIELD] = motion_fi_field_420;
-	    decoder->motion_parser[MC_16X8] = motion_fi_16x8_420;
-	    decoder->motion_parser[MC_DMV] = motion_fi_dmv_420;
-	    decoder->motion_parser[4] = motion_reuse_420;
-	} else if (decoder->chroma_format == 1) {
-	    decoder->motion_parser[0] = motion_zero_422;
-	    decoder->motion_parser[MC_FIELD] = motion_fi_field_422;
-	    decoder->motion_parser[MC_16X8] = motion_fi_16x8_422;
-	    decoder->motion_parser[MC_DMV] = motion_fi_dmv_422;
-	    decoder->motion_parser[4] = motion_reuse_422;
-	} else {
-	    decoder->motion_parser[0] = motion_zero_444;
-	    decoder->motion_parser[MC_FIELD] = motion_fi_field_444;
-	    decoder->motion_parser[MC_16X8] = motion_fi_16x8_444;
-	    decoder->motion_parser[MC_DMV] = motion_fi_dmv_444;
-	    decoder->motion_parser[4] = motion_reuse_444;
-	}
-    }
-}
-
-static inline int slice_init (mpeg2_decoder_t * const decoder, int code)
-{
-#define bit_buf (decoder->bitstream_buf)
-#define bits (decoder->bitstream_bits)
-#define bit_ptr (decoder->bitstream_ptr)
+#define bit_buf (bs->buf)
+#define bits (bs->bits)
+#define bit_ptr (bs->ptr)
     int offset;
     const MBAtab * mba;
 
+    if (decoder->mb_budget <= 0)
+	return 1;
+
     decoder->dc_dct_pred[0] = decoder->dc_dct_pred[1] =
 	decoder->dc_dct_pred[2] = 16384;
 
@@ -1795,7 +2096,7 @@ static inline int slice_init (mpeg2_decoder_t * const decoder, int code)
     decoder->dest[1] = decoder->picture_dest[1] + offset;
     decoder->dest[2] = decoder->picture_dest[2] + offset;
 
-    get_quantizer_scale (decoder);
+    get_quantizer_scale (decoder, bs);
 
     /* ignore intra_slice and all the extra data */
     while (bit_buf & 0x80000000) {
@@ -1815,6 +2116,8 @@ static inline int slice_init (mpeg2_decoder_t * const decoder, int code)
 	} else switch (UBITS (bit_buf, 12)) {
 	case 8:		/* macroblock_escape */
 	    offset += 33;
+	    if ((offset << 8) > decoder->width * (int) (decoder->limit_y + 16))
+		return 1;	/* past the end of the picture */
 	    DUMPBITS (bit_buf, bits, 11);
 	    NEEDBITS (bit_buf, bits, bit_ptr);
 	    continue;
@@ -1841,6 +2144,12 @@ static inline int slice_init (mpeg2_decoder_t * const decoder, int code)
     }
     if (decoder->v_offset > decoder->limit_y)
 	return 1;
+    /* rewriting a row already copied out */
+    if (tiled && (int) (decoder->v_offset >> 4) < decoder->tiled_rows)
+	decoder->tiled_rows = -1;
+    decoder->dest_x[0] = TILE_X (decoder->offset, 0);
+    decoder->dest_x[1] =
+	TILE_X (decoder->offset >> (decoder->chroma_format != 2), 1);
 
     return 0;
 #undef bit_buf
@@ -1848,295 +2157,527 @@ static inline int slice_init (mpeg2_decoder_t * const decoder, int code)
 #undef bit_ptr
 }
 
-void mpeg2_slice (mpeg2_decoder_t * const decoder, const int code,
-		  const uint8_t * const buffer)
+/*
+ * The macroblock loop, instantiated once per kind of picture so that
+ * the tests on the picture parameters fold away. The parameters are
+ * either constants or, for the less common kinds, the decoder fields.
+ */
+#define SLICE_FUNCTION(NAME,MPEG1,CHROMA_FORMAT,INTRA_VLC_FORMAT,FRAME,TILED) \
+									      \
+static void slice_##NAME (mpeg2_decoder_t * const decoder, const int code,    \
+			  const uint8_t * const buffer)			      \
+{									      \
+    const int tiled = TILED;						      \
+    bitstream_t bs;							      \
+    cpu_state_t cpu_state;						      \
+									      \
+    bitstream_init (&bs, buffer);					      \
+    if (slice_init (decoder, &bs, code, tiled))				      \
+	return;								      \
+									      \
+    if (mpeg2_cpu_state_save)						      \
+	mpeg2_cpu_state_save (&cpu_state);				      \
+									      \
+    while (1) {								      \
+	int macroblock_modes;						      \
+	int mba_inc;							      \
+	const MBAtab * mba;						      \
+									      \
+	NEEDBITS (bit_buf, bits, bit_ptr);				      \
+									      \
+	macroblock_modes = get_macroblock_modes (decoder, &bs);		      \
+									      \
+	/* maybe integrate MACROBLOCK_QUANT test into get_macroblock_modes */ \
+	if (macroblock_modes & MACROBLOCK_QUANT)			      \
+	    get_quantizer_scale (decoder, &bs);				      \
+									      \
+	if (macroblock_modes & MACROBLOCK_INTRA) {			      \
+									      \
+	    int DCT_offset, DCT_stride;					      \
+	    uint8_t * dest_y;						      \
+									      \
+	    if (decoder->concealment_motion_vectors) {			      \
+		if (FRAME)						      \
+		    motion_fr_conceal (decoder, &bs);			      \
+		else							      \
+		    motion_fi_conceal (decoder, &bs);			      \
+	    } else {							      \
+		decoder->f_motion.pmv[0][0] = decoder->f_motion.pmv[0][1] =   \
+		    decoder->f_motion.pmv[1][0] =			      \
+		    decoder->f_motion.pmv[1][1] = 0;			      \
+		decoder->b_motion.pmv[0][0] = decoder->b_motion.pmv[0][1] =   \
+		    decoder->b_motion.pmv[1][0] =			      \
+		    decoder->b_motion.pmv[1][1] = 0;			      \
+	    }								      \
+									      \
+	    if (macroblock_modes & DCT_TYPE_INTERLACED) {		      \
+		DCT_offset = decoder->stride;				      \
+		DCT_stride = decoder->stride * 2;			      \
+	    } else {							      \
+		DCT_offset = decoder->stride * 8;			      \
+		DCT_stride = decoder->stride;				      \
+	    }								      \
+									      \
+	    dest_y = decoder->dest[0] + decoder->dest_x[0];		      \
+	    slice_intra_DCT (decoder, &bs, MPEG1, INTRA_VLC_FORMAT, 0,	      \
+			     dest_y, DCT_stride);			      \
+	    slice_intra_DCT (decoder, &bs, MPEG1, INTRA_VLC_FORMAT, 0,	      \
+			     dest_y + 8, DCT_stride);			      \
+	    slice_intra_DCT (decoder, &bs, MPEG1, INTRA_VLC_FORMAT, 0,	      \
+			     dest_y + DCT_offset, DCT_stride);		      \
+	    slice_intra_DCT (decoder, &bs, MPEG1, INTRA_VLC_FORMAT, 0,	      \
+			     dest_y + DCT_offset + 8, DCT_stride);	      \
+	    if ((CHROMA_FORMAT) == 0) {					      \
+		slice_intra_DCT (decoder, &bs, MPEG1, INTRA_VLC_FORMAT,	      \
+				 1, decoder->dest[1] + decoder->dest_x[1],    \
+				 decoder->uv_stride);			      \
+		slice_intra_DCT (decoder, &bs, MPEG1, INTRA_VLC_FORMAT,	      \
+				 2, decoder->dest[2] + decoder->dest_x[1],    \
+				 decoder->uv_stride);			      \
+		if (decoder->coding_type == D_TYPE) {			      \
+		    NEEDBITS (bit_buf, bits, bit_ptr);			      \
+		    DUMPBITS (bit_buf, bits, 1);			      \
+		}							      \
+	    } else if ((CHROMA_FORMAT) == 1) {				      \
+		uint8_t * dest_u = decoder->dest[1] + decoder->dest_x[1];     \
+		uint8_t * dest_v = decoder->dest[2] + decoder->dest_x[1];     \
+		DCT_stride >>= 1;					      \
+		DCT_offset >>= 1;					      \
+		slice_intra_DCT (decoder, &bs, MPEG1, INTRA_VLC_FORMAT,	      \
+				 1, dest_u, DCT_stride);		      \
+		slice_intra_DCT (decoder, &bs, MPEG1, INTRA_VLC_FORMAT,	      \
+				 2, dest_v, DCT_stride);		      \
+		slice_intra_DCT (decoder, &bs, MPEG1, INTRA_VLC_FORMAT,	      \
+				 1, dest_u + DCT_offset, DCT_stride);	      \
+		slice_intra_DCT (decoder, &bs, MPEG1, INTRA_VLC_FORMAT,	      \
+				 2, dest_v + DCT_offset, DCT_stride);	      \
+	    } else {							      \
+		uint8_t * dest_u = decoder->dest[1] + decoder->dest_x[1];     \
+		uint8_t * dest_v = decoder->dest[2] + decoder->dest_x[1];     \
+		slice_intra_DCT (decoder, &bs, MPEG1, INTRA_VLC_FORMAT,	      \
+				 1, dest_u, DCT_stride);		      \
+		slice_intra_DCT (decoder, &bs, MPEG1, INTRA_VLC_FORMAT,	      \
+				 2, dest_v, DCT_stride);		      \
+		slice_intra_DCT (decoder, &bs, MPEG1, INTRA_VLC_FORMAT,	      \
+				 1, dest_u + DCT_offset, DCT_stride);	      \
+		slice_intra_DCT (decoder, &bs, MPEG1, INTRA_VLC_FORMAT,	      \
+				 2, dest_v + DCT_offset, DCT_stride);	      \
+		slice_intra_DCT (decoder, &bs, MPEG1, INTRA_VLC_FORMAT,	      \
+				 1, dest_u + 8, DCT_stride);		      \
+		slice_intra_DCT (decoder, &bs, MPEG1, INTRA_VLC_FORMAT,	      \
+				 2, dest_v + 8, DCT_stride);		      \
+		slice_intra_DCT (decoder, &bs, MPEG1, INTRA_VLC_FORMAT,	      \
+				 1, dest_u + DCT_offset + 8,		      \
+				 DCT_stride);				      \
+		slice_intra_DCT (decoder, &bs, MPEG1, INTRA_VLC_FORMAT,	      \
+				 2, dest_v + DCT_offset + 8,		      \
+				 DCT_stride);				      \
+	    }								      \
+	} else {							      \
+									      \
+	    motion_parser_t * parser;					      \
+									      \
+	    if ((macroblock_modes >> MOTION_TYPE_SHIFT) < 0 ||		      \
+		(macroblock_modes >> MOTION_TYPE_SHIFT) >=		      \
+		(int) (sizeof (decoder->motion_parser) /		      \
+		       sizeof (decoder->motion_parser[0])))		      \
+		break;	/* illegal */					      \
+									      \
+	    parser = decoder->motion_parser[macroblock_modes >>		      \
+					    MOTION_TYPE_SHIFT];		      \
+	    MOTION_CALL (parser, macroblock_modes);			      \
+									      \
+	    if (macroblock_modes & MACROBLOCK_PATTERN) {		      \
+		int coded_block_pattern;				      \
+		int DCT_offset, DCT_stride;				      \
+		uint8_t * dest_y;					      \
+									      \
+		if (macroblock_modes & DCT_TYPE_INTERLACED) {		      \
+		    DCT_offset = decoder->stride;			      \
+		    DCT_stride = decoder->stride * 2;			      \
+		} else {						      \
+		    DCT_offset = decoder->stride * 8;			      \
+		    DCT_stride = decoder->stride;			      \
+		}							      \
+									      \
+		coded_block_pattern = get_coded_block_pattern (&bs);	      \
+		if ((CHROMA_FORMAT) == 1) {				      \
+		    coded_block_pattern |= bit_buf & (3 << 30);		      \
+		    DUMPBITS (bit_buf, bits, 2);			      \
+		} else if ((CHROMA_FORMAT) == 2) {			      \
+		    coded_block_pattern |= bit_buf & (63 << 26);	      \
+		    DUMPBITS (bit_buf, bits, 6);			      \
+		}							      \
+									      \
+		dest_y = decoder->dest[0] + decoder->dest_x[0];		      \
+		if (coded_block_pattern & 1)				      \
+		    slice_non_intra_DCT (decoder, &bs, MPEG1, 0, dest_y,      \
+					 DCT_stride);			      \
+		if (coded_block_pattern & 2)				      \
+		    slice_non_intra_DCT (decoder, &bs, MPEG1, 0,	      \
+					 dest_y + 8, DCT_stride);	      \
+		if (coded_block_pattern & 4)				      \
+		    slice_non_intra_DCT (decoder, &bs, MPEG1, 0,	      \
+					 dest_y + DCT_offset,		      \
+					 DCT_stride);			      \
+		if (coded_block_pattern & 8)				      \
+		    slice_non_intra_DCT (decoder, &bs, MPEG1, 0,	      \
+					 dest_y + DCT_offset + 8,	      \
+					 DCT_stride);			      \
+									      \
+		if ((CHROMA_FORMAT) == 0) {				      \
+		    uint8_t * dest_u = decoder->dest[1] + decoder->dest_x[1]; \
+		    uint8_t * dest_v = decoder->dest[2] + decoder->dest_x[1]; \
+									      \
+		    if (coded_block_pattern & 16)			      \
+			slice_non_intra_DCT (decoder, &bs, MPEG1, 1,	      \
+					     dest_u,			      \
+					     decoder->uv_stride);	      \
+		    if (coded_block_pattern & 32)			      \
+			slice_non_intra_DCT (decoder, &bs, MPEG1, 2,	      \
+					     dest_v,			      \
+					     decoder->uv_stride);	      \
+		} else if ((CHROMA_FORMAT) == 1) {			      \
+		    uint8_t * dest_u = decoder->dest[1] + decoder->dest_x[1]; \
+		    uint8_t * dest_v = decoder->dest[2] + decoder->dest_x[1]; \
+									      \
+		    DCT_stride >>= 1;					      \
+		    DCT_offset >>= 1;					      \
+		    if (coded_block_pattern & 16)			      \
+			slice_non_intra_DCT (decoder, &bs, MPEG1, 1,	      \
+					     dest_u,			      \
+					     DCT_stride);		      \
+		    if (coded_block_pattern & 32)			      \
+			slice_non_intra_DCT (decoder, &bs, MPEG1, 2,	      \
+					     dest_v,			      \
+					     DCT_stride);		      \
+		    if (coded_block_pattern & (2 << 30))		      \
+			slice_non_intra_DCT (decoder, &bs, MPEG1, 1,	      \
+					     dest_u + DCT_offset,	      \
+					     DCT_stride);		      \
+		    if (coded_block_pattern & (1 << 30))		      \
+			slice_non_intra_DCT (decoder, &bs, MPEG1, 2,	      \
+					     dest_v + DCT_offset,	      \
+					     DCT_stride);		      \
+		} else {						      \
+		    uint8_t * dest_u = decoder->dest[1] + decoder->dest_x[1]; \
+		    uint8_t * dest_v = decoder->dest[2] + decoder->dest_x[1]; \
+									      \
+		    if (coded_block_pattern & 16)			      \
+			slice_non_intra_DCT (decoder, &bs, MPEG1, 1,	      \
+					     dest_u, DCT_stride);	      \
+		    if (coded_block_pattern & 32)			      \
+			slice_non_intra_DCT (decoder, &bs, MPEG1, 2,	      \
+					     dest_v, DCT_stride);	      \
+		    if (coded_block_pattern & (32 << 26))		      \
+			slice_non_intra_DCT (decoder, &bs, MPEG1, 1,	      \
+					     dest_u + DCT_offset,	      \
+					     DCT_stride);		      \
+		    if (coded_block_pattern & (16 << 26))		      \
+			slice_non_intra_DCT (decoder, &bs, MPEG1, 2,	      \
+					     dest_v + DCT_offset,	      \
+					     DCT_stride);		      \
+		    if (coded_block_pattern & (8 << 26))		      \
+			slice_non_intra_DCT (decoder, &bs, MPEG1, 1,	      \
+					     dest_u + 8, DCT_stride);	      \
+		    if (coded_block_pattern & (4 << 26))		      \
+			slice_non_intra_DCT (decoder, &bs, MPEG1, 2,	      \
+					     dest_v + 8, DCT_stride);	      \
+		    if (coded_block_pattern & (2 << 26))		      \
+			slice_non_intra_DCT (decoder, &bs, MPEG1, 1,	      \
+					     dest_u + DCT_offset + 8,	      \
+					     DCT_stride);		      \
+		    if (coded_block_pattern & (1 << 26))		      \
+			slice_non_intra_DCT (decoder, &bs, MPEG1, 2,	      \
+					     dest_v + DCT_offset + 8,	      \
+					     DCT_stride);		      \
+		}							      \
+	    }								      \
+									      \
+	    decoder->dc_dct_pred[0] = decoder->dc_dct_pred[1] =		      \
+		decoder->dc_dct_pred[2] = 16384;			      \
+	}								      \
+									      \
+	NEXT_MACROBLOCK;						      \
+									      \
+	NEEDBITS (bit_buf, bits, bit_ptr);				      \
+	mba_inc = 0;							      \
+	while (1) {							      \
+	    if (bit_buf >= 0x10000000) {				      \
+		mba = MBA_5 + (UBITS (bit_buf, 5) - 2);			      \
+		break;							      \
+	    } else if (bit_buf >= 0x03000000) {				      \
+		mba = MBA_11 + (UBITS (bit_buf, 11) - 24);		      \
+		break;							      \
+	    } else switch (UBITS (bit_buf, 11)) {			      \
+	    case 8:		/* macroblock_escape */			      \
+		mba_inc += 33;						      \
+		/* pass through */					      \
+	    case 15:	/* macroblock_stuffing (MPEG1 only) */		      \
+		DUMPBITS (bit_buf, bits, 11);				      \
+		NEEDBITS (bit_buf, bits, bit_ptr);			      \
+		continue;						      \
+	    default:	/* end of slice, or error */			      \
+		if (mpeg2_cpu_state_restore)				      \
+		    mpeg2_cpu_state_restore (&cpu_state);		      \
+		return;							      \
+	    }								      \
+	}								      \
+	DUMPBITS (bit_buf, bits, mba->len);				      \
+	mba_inc += mba->mba;						      \
+									      \
+	if (mba_inc) {							      \
+	    decoder->dc_dct_pred[0] = decoder->dc_dct_pred[1] =		      \
+		decoder->dc_dct_pred[2] = 16384;			      \
+									      \
+	    if (decoder->coding_type == P_TYPE) {			      \
+		do {							      \
+		    MOTION_CALL (decoder->motion_parser[0],		      \
+				 MACROBLOCK_MOTION_FORWARD);		      \
+		    NEXT_MACROBLOCK;					      \
+		} while (--mba_inc);					      \
+	    } else {							      \
+		do {							      \
+		    MOTION_CALL (decoder->motion_parser[4],		      \
+				 macroblock_modes);			      \
+		    NEXT_MACROBLOCK;					      \
+		} while (--mba_inc);					      \
+	    }								      \
+	}								      \
+    }									      \
+}
+
+#define bit_buf (bs.buf)
+#define bits (bs.bits)
+#define bit_ptr (bs.ptr)
+
+SLICE_FUNCTION (mpeg1, 1, 0, 0, 1, 0)
+SLICE_FUNCTION (420_fr_B14, 0, 0, 0, 1, 0)
+SLICE_FUNCTION (420_fr_B15, 0, 0, 1, 1, 0)
+SLICE_FUNCTION (420_fi, 0, 0, decoder->intra_vlc_format, 0, 0)
+SLICE_FUNCTION (422, 0, 1, decoder->intra_vlc_format,
+		decoder->picture_structure == FRAME_PICTURE, 0)
+SLICE_FUNCTION (444, 0, 2, decoder->intra_vlc_format,
+		decoder->picture_structure == FRAME_PICTURE, 0)
+SLICE_FUNCTION (mpeg1_tiled, 1, 0, 0, 1, 1)
+SLICE_FUNCTION (420_fr_B14_tiled, 0, 0, 0, 1, 1)
+SLICE_FUNCTION (420_fr_B15_tiled, 0, 0, 1, 1, 1)
+SLICE_FUNCTION (420_fi_tiled, 0, 0, decoder->intra_vlc_format, 0, 1)
+SLICE_FUNCTION (422_tiled, 0, 1, decoder->intra_vlc_format,
+		decoder->picture_structure == FRAME_PICTURE, 1)
+SLICE_FUNCTION (444_tiled, 0, 2, decoder->intra_vlc_format,
+		decoder->picture_structure == FRAME_PICTURE, 1)
+
+#undef bit_buf
+#undef bits
+#undef bit_ptr
+
+/**
+ * Dummy motion decoding function, to avoid calling NULL in
+ * case of malformed streams.
+ */
+static void motion_dummy (mpeg2_decoder_t * const decoder,
+                          bitstream_t * const bs, motion_t * const motion,
+                          mpeg2_mc_fct * const * const table)
 {
-#define bit_buf (decoder->bitstream_buf)
-#define bits (decoder->bitstream_bits)
-#define bit_ptr (decoder->bitstream_ptr)
-    cpu_state_t cpu_state;
+}
 
-    bitstream_init (decoder, buffer);
+/* the tiled instance of a parser when the picture is tiled */
+#define SLICE_PARSER(NAME) \
+    (decoder->tiled ? slice_##NAME##_tiled : slice_##NAME)
+#define MOTION_PARSER(NAME) \
+    (decoder->tiled ? motion_##NAME##_tiled : motion_##NAME)
 
-    if (slice_init (decoder, code))
-	return;
+void mpeg2_init_fbuf (mpeg2_decoder_t * decoder, mpeg2_sequence_t * sequence,
+		      mpeg2_picture_t * picture, coding_t * coding,
+		      uint8_t * current_fbuf[3],
+		      uint8_t * forward_fbuf[3], uint8_t * backward_fbuf[3])
+{
+    int offset, stride, height, bottom_field, used, x_shift;
 
-    if (mpeg2_cpu_state_save)
-	mpeg2_cpu_state_save (&cpu_state);
+    decoder->mpeg1 = !(sequence->flags & SEQ_FLAG_MPEG2);
+    decoder->width = sequence->width;
+    height = sequence->height;
+    decoder->vertical_position_extension = (sequence->picture_height > 2800);
 
-    while (1) {
-	int macroblock_modes;
-	int mba_inc;
-	const MBAtab * mba;
+    decoder->top_field_first =
+	((picture->flags & PIC_FLAG_TOP_FIELD_FIRST) != 0);
+    if (picture->nb_fields > 1)
+	decoder->picture_structure = FRAME_PICTURE;
+    else
+	decoder->picture_structure =
+	    decoder->top_field_first ? TOP_FIELD : BOTTOM_FIELD;
 
-	NEEDBITS (bit_buf, bits, bit_ptr);
+    decoder->f_motion.f_code[0] = coding->f_code[0][0] - 1;
+    decoder->f_motion.f_code[1] = coding->f_code[0][1] - !(decoder->mpeg1);
+    decoder->b_motion.f_code[0] = coding->f_code[1][0] - 1;
+    decoder->b_motion.f_code[1] = coding->f_code[1][1] - !(decoder->mpeg1);
+    decoder->intra_dc_precision = 15 - coding->intra_dc_precision;
+    decoder->frame_pred_frame_dct = coding->frame_pred_frame_dct;
+    decoder->concealment_motion_vectors = coding->concealment_motion_vectors;
+    decoder->intra_vlc_format = coding->intra_vlc_format;
+    decoder->scan = coding->alternate_scan ? mpeg2_scan_alt : mpeg2_scan_norm;
 
-	macroblock_modes = get_macroblock_modes (decoder);
+    if (coding->matrix_updates & 1) {
+	decoder->chroma_quantizer[0] = (coding->matrix_updates & 4) ? 2 : 0;
+	decoder->chroma_quantizer[1] = (coding->matrix_updates & 8) ? 3 : 1;
+    }
+    /* the matrices this picture uses, as matrix_updates bits */
+    used = (3 | ((decoder->chroma_quantizer[0] == 2) << 2) |
+	    ((decoder->chroma_quantizer[1] == 3) << 3));
+    /* the rows are rebuilt lazily, by get_quantizer_scale() */
+    if ((coding->matrix_updates & used) ||
+	decoder->q_scale_type != coding->q_scale_type) {
+	coding->matrix_updates &= ~used;
+	decoder->prescaled = 0;
+	decoder->q_scale_type = coding->q_scale_type;
+    }
 
-	/* maybe integrate MACROBLOCK_QUANT test into get_macroblock_modes ? */
-	if (macroblock_modes & MACROBLOCK_QUANT)
-	    get_quantizer_scale (decoder);
+    /* the tiles of a tiled picture are TILE_STRIDE luma pixels wide */
+    x_shift = (decoder->chroma_format != 2);
+    if (decoder->tiled) {
+	decoder->tile_shift[0] = TILE_SHIFT;
+	decoder->tile_mask[0] = (1 << TILE_SHIFT) - 1;
+	decoder->tile_size[0] = TILE_STRIDE * height;
+	decoder->tile_shift[1] = TILE_SHIFT - x_shift;
+	decoder->tile_mask[1] = decoder->tile_mask[0] >> x_shift;
+	decoder->tile_size[1] = ((TILE_STRIDE >> x_shift) *
+				 (height >> (decoder->chroma_format == 0)));
+    }
 
-	if (macroblock_modes & MACROBLOCK_INTRA) {
+    stride = decoder->tiled ? TILE_STRIDE : decoder->stride_frame;
+    bottom_field = (decoder->picture_structure == BOTTOM_FIELD);
+    offset = bottom_field ? stride : 0;
 
-	    int DCT_offset, DCT_stride;
-	    int offset;
-	    uint8_t * dest_y;
+    decoder->picture_dest[0] = current_fbuf[0] + offset;
+    decoder->picture_dest[1] = current_fbuf[1] + (offset >> x_shift);
+    decoder->picture_dest[2] = current_fbuf[2] + (offset >> x_shift);
 
-	    if (decoder->concealment_motion_vectors) {
-		if (decoder->picture_structure == FRAME_PICTURE)
-		    motion_fr_conceal (decoder);
-		else
-		    motion_fi_conceal (decoder);
-	    } else {
-		decoder->f_motion.pmv[0][0] = decoder->f_motion.pmv[0][1] = 0;
-		decoder->f_motion.pmv[1][0] = decoder->f_motion.pmv[1][1] = 0;
-		decoder->b_motion.pmv[0][0] = decoder->b_motion.pmv[0][1] = 0;
-		decoder->b_motion.pmv[1][0] = decoder->b_motion.pmv[1][1] = 0;
-	    }
+    decoder->f_motion.ref[0][0] = forward_fbuf[0] + offset;
+    decoder->f_motion.ref[0][1] = forward_fbuf[1] + (offset >> x_shift);
+    decoder->f_motion.ref[0][2] = forward_fbuf[2] + (offset >> x_shift);
 
-	    if (macroblock_modes & DCT_TYPE_INTERLACED) {
-		DCT_offset = decoder->stride;
-		DCT_stride = decoder->stride * 2;
-	    } else {
-		DCT_offset = decoder->stride * 8;
-		DCT_stride = decoder->stride;
-	    }
+    decoder->b_motion.ref[0][0] = backward_fbuf[0] + offset;
+    decoder->b_motion.ref[0][1] = backward_fbuf[1] + (offset >> x_shift);
+    decoder->b_motion.ref[0][2] = backward_fbuf[2] + (offset >> x_shift);
 
-	    offset = decoder->offset;
-	    dest_y = decoder->dest[0] + offset;
-	    slice_intra_DCT (decoder, 0, dest_y, DCT_stride);
-	    slice_intra_DCT (decoder, 0, dest_y + 8, DCT_stride);
-	    slice_intra_DCT (decoder, 0, dest_y + DCT_offset, DCT_stride);
-	    slice_intra_DCT (decoder, 0, dest_y + DCT_offset + 8, DCT_stride);
-	    if (likely (decoder->chroma_format == 0)) {
-		slice_intra_DCT (decoder, 1, decoder->dest[1] + (offset >> 1),
-				 decoder->uv_stride);
-		slice_intra_DCT (decoder, 2, decoder->dest[2] + (offset >> 1),
-				 decoder->uv_stride);
-		if (decoder->coding_type == D_TYPE) {
-		    NEEDBITS (bit_buf, bits, bit_ptr);
-		    DUMPBITS (bit_buf, bits, 1);
-		}
-	    } else if (likely (decoder->chroma_format == 1)) {
-		uint8_t * dest_u = decoder->dest[1] + (offset >> 1);
-		uint8_t * dest_v = decoder->dest[2] + (offset >> 1);
-		DCT_stride >>= 1;
-		DCT_offset >>= 1;
-		slice_intra_DCT (decoder, 1, dest_u, DCT_stride);
-		slice_intra_DCT (decoder, 2, dest_v, DCT_stride);
-		slice_intra_DCT (decoder, 1, dest_u + DCT_offset, DCT_stride);
-		slice_intra_DCT (decoder, 2, dest_v + DCT_offset, DCT_stride);
-	    } else {
-		uint8_t * dest_u = decoder->dest[1] + offset;
-		uint8_t * dest_v = decoder->dest[2] + offset;
-		slice_intra_DCT (decoder, 1, dest_u, DCT_stride);
-		slice_intra_DCT (decoder, 2, dest_v, DCT_stride);
-		slice_intra_DCT (decoder, 1, dest_u + DCT_offset, DCT_stride);
-		slice_intra_DCT (decoder, 2, dest_v + DCT_offset, DCT_stride);
-		slice_intra_DCT (decoder, 1, dest_u + 8, DCT_stride);
-		slice_intra_DCT (decoder, 2, dest_v + 8, DCT_stride);
-		slice_intra_DCT (decoder, 1, dest_u + DCT_offset + 8,
-				 DCT_stride);
-		slice_intra_DCT (decoder, 2, dest_v + DCT_offset + 8,
-				 DCT_stride);
-	    }
-	} else {
+    if (decoder->picture_structure != FRAME_PICTURE) {
+	decoder->dmv_offset = bottom_field ? 1 : -1;
+	decoder->f_motion.ref2[0] = decoder->f_motion.ref[bottom_field];
+	decoder->f_motion.ref2[1] = decoder->f_motion.ref[!bottom_field];
+	decoder->b_motion.ref2[0] = decoder->b_motion.ref[bottom_field];
+	decoder->b_motion.ref2[1] = decoder->b_motion.ref[!bottom_field];
+	offset = stride - offset;
 
-	    motion_parser_t * parser;
+	if (decoder->second_field && (decoder->coding_type != B_TYPE))
+	    forward_fbuf = current_fbuf;
 
-	    if (   ((macroblock_modes >> MOTION_TYPE_SHIFT) < 0)
-                || ((macroblock_modes >> MOTION_TYPE_SHIFT) >=
-                    (int)(sizeof(decoder->motion_parser) 
-                          / sizeof(decoder->motion_parser[0])))
-	       ) {
-		break; // Illegal !
-	    }
+	decoder->f_motion.ref[1][0] = forward_fbuf[0] + offset;
+	decoder->f_motion.ref[1][1] = forward_fbuf[1] + (offset >> x_shift);
+	decoder->f_motion.ref[1][2] = forward_fbuf[2] + (offset >> x_shift);
 
-	    parser =
-		decoder->motion_parser[macroblock_modes >> MOTION_TYPE_SHIFT];
-	    MOTION_CALL (parser, macroblock_modes);
-
-	    if (macroblock_modes & MACROBLOCK_PATTERN) {
-		int coded_block_pattern;
-		int DCT_offset, DCT_stride;
-
-		if (macroblock_modes & DCT_TYPE_INTERLACED) {
-		    DCT_offset = decoder->stride;
-		    DCT_stride = decoder->stride * 2;
-		} else {
-		    DCT_offset = decoder->stride * 8;
-		    DCT_stride = decoder->stride;
-		}
-
-		coded_block_pattern = get_coded_block_pattern (decoder);
-
-		if (likely (decoder->chroma_format == 0)) {
-		    int offset = decoder->offset;
-		    uint8_t * dest_y = decoder->dest[0] + offset;
-		    if (coded_block_pattern & 1)
-			slice_non_intra_DCT (decoder, 0, dest_y, DCT_stride);
-		    if (coded_block_pattern & 2)
-			slice_non_intra_DCT (decoder, 0, dest_y + 8,
-					     DCT_stride);
-		    if (coded_block_pattern & 4)
-			slice_non_intra_DCT (decoder, 0, dest_y + DCT_offset,
-					     DCT_stride);
-		    if (coded_block_pattern & 8)
-			slice_non_intra_DCT (decoder, 0,
-					     dest_y + DCT_offset + 8,
-					     DCT_stride);
-		    if (coded_block_pattern & 16)
-			slice_non_intra_DCT (decoder, 1,
-					     decoder->dest[1] + (offset >> 1),
-					     decoder->uv_stride);
-		    if (coded_block_pattern & 32)
-			slice_non_intra_DCT (decoder, 2,
-					     decoder->dest[2] + (offset >> 1),
-					     decoder->uv_stride);
-		} else if (likely (decoder->chroma_format == 1)) {
-		    int offset;
-		    uint8_t * dest_y;
-
-		    coded_block_pattern |= bit_buf & (3 << 30);
-		    DUMPBITS (bit_buf, bits, 2);
-
-		    offset = decoder->offset;
-		    dest_y = decoder->dest[0] + offset;
-		    if (coded_block_pattern & 1)
-			slice_non_intra_DCT (decoder, 0, dest_y, DCT_stride);
-		    if (coded_block_pattern & 2)
-			slice_non_intra_DCT (decoder, 0, dest_y + 8,
-					     DCT_stride);
-		    if (coded_block_pattern & 4)
-			slice_non_intra_DCT (decoder, 0, dest_y + DCT_offset,
-					     DCT_stride);
-		    if (coded_block_pattern & 8)
-			slice_non_intra_DCT (decoder, 0,
-					     dest_y + DCT_offset + 8,
-					     DCT_stride);
-
-		    DCT_stride >>= 1;
-		    DCT_offset = (DCT_offset + offset) >> 1;
-		    if (coded_block_pattern & 16)
-			slice_non_intra_DCT (decoder, 1,
-					     decoder->dest[1] + (offset >> 1),
-					     DCT_stride);
-		    if (coded_block_pattern & 32)
-			slice_non_intra_DCT (decoder, 2,
-					     decoder->dest[2] + (offset >> 1),
-					     DCT_stride);
-		    if (coded_block_pattern & (2 << 30))
-			slice_non_intra_DCT (decoder, 1,
-					     decoder->dest[1] + DCT_offset,
-					     DCT_stride);
-		    if (coded_block_pattern & (1 << 30))
-			slice_non_intra_DCT (decoder, 2,
-					     decoder->dest[2] + DCT_offset,
-					     DCT_stride);
-		} else {
-		    int offset;
-		    uint8_t * dest_y, * dest_u, * dest_v;
-
-		    coded_block_pattern |= bit_buf & (63 << 26);
-		    DUMPBITS (bit_buf, bits, 6);
-
-		    offset = decoder->offset;
-		    dest_y = decoder->dest[0] + offset;
-		    dest_u = decoder->dest[1] + offset;
-		    dest_v = decoder->dest[2] + offset;
-
-		    if (coded_block_pattern & 1)
-			slice_non_intra_DCT (decoder, 0, dest_y, DCT_stride);
-		    if (coded_block_pattern & 2)
-			slice_non_intra_DCT (decoder, 0, dest_y + 8,
-					     DCT_stride);
-		    if (coded_block_pattern & 4)
-			slice_non_intra_DCT (decoder, 0, dest_y + DCT_offset,
-					     DCT_stride);
-		    if (coded_block_pattern & 8)
-			slice_non_intra_DCT (decoder, 0,
-					     dest_y + DCT_offset + 8,
-					     DCT_stride);
-
-		    if (coded_block_pattern & 16)
-			slice_non_intra_DCT (decoder, 1, dest_u, DCT_stride);
-		    if (coded_block_pattern & 32)
-			slice_non_intra_DCT (decoder, 2, dest_v, DCT_stride);
-		    if (coded_block_pattern & (32 << 26))
-			slice_non_intra_DCT (decoder, 1, dest_u + DCT_offset,
-					     DCT_stride);
-		    if (coded_block_pattern & (16 << 26))
-			slice_non_intra_DCT (decoder, 2, dest_v + DCT_offset,
-					     DCT_stride);
-		    if (coded_block_pattern & (8 << 26))
-			slice_non_intra_DCT (decoder, 1, dest_u + 8,
-					     DCT_stride);
-		    if (coded_block_pattern & (4 << 26))
-			slice_non_intra_DCT (decoder, 2, dest_v + 8,
-					     DCT_stride);
-		    if (coded_block_pattern & (2 << 26))
-			slice_non_intra_DCT (decoder, 1,
-					     dest_u + DCT_offset + 8,
-					     DCT_stride);
-		    if (coded_block_pattern & (1 << 26))
-			slice_non_intra_DCT (decoder, 2,
-					     dest_v + DCT_offset + 8,
-					     DCT_stride);
-		}
-	    }
+	decoder->b_motion.ref[1][0] = backward_fbuf[0] + offset;
+	decoder->b_motion.ref[1][1] = backward_fbuf[1] + (offset >> x_shift);
+	decoder->b_motion.ref[1][2] = backward_fbuf[2] + (offset >> x_shift);
+
+	stride <<= 1;
+	height >>= 1;
+    }
 
-	    decoder->dc_dct_pred[0] = decoder->dc_dct_pred[1] =
-		decoder->dc_dct_pred[2] = 16384;
+    /* decoder->tiled_out is the raster frame the rows are copied to */
+    if (decoder->tiled) {
+	decoder->tiled_out_stride = decoder->stride_frame;
+	if (bottom_field) {
+	    decoder->tiled_out[0] += decoder->stride_frame;
+	    decoder->tiled_out[1] += decoder->stride_frame >> x_shift;
+	    decoder->tiled_out[2] += decoder->stride_frame >> x_shift;
 	}
+	if (decoder->picture_structure != FRAME_PICTURE)
+	    decoder->tiled_out_stride <<= 1;
+    }
+    decoder->tiled_rows = 0;
 
-	NEXT_MACROBLOCK;
+    decoder->stride = stride;
+    decoder->uv_stride = stride >> 1;
+    decoder->slice_stride = 16 * stride;
+    decoder->slice_uv_stride =
+	decoder->slice_stride >> (2 - decoder->chroma_format);
+    /* with a border, let the motion vectors reach into it */
+    decoder->pad_x = 2 * decoder->border;
+    decoder->pad_y =
+	decoder->pad_x >> (decoder->picture_structure != FRAME_PICTURE);
+    decoder->pad_y_field = decoder->border;
+    decoder->limit_x = 2 * decoder->width - 32 + 2 * decoder->pad_x;
+    decoder->limit_y_16 = 2 * height - 32 + 2 * decoder->pad_y;
+    decoder->limit_y_8 = 2 * height - 16 + 2 * decoder->pad_y;
+    decoder->limit_y_field = height - 16 + 2 * decoder->pad_y_field;
+    decoder->limit_y = height - 16;
+    decoder->mb_budget = MB_BUDGET * (decoder->width >> 4) * (height >> 4);
 
-	NEEDBITS (bit_buf, bits, bit_ptr);
-	mba_inc = 0;
-	while (1) {
-	    if (bit_buf >= 0x10000000) {
-		mba = MBA_5 + (UBITS (bit_buf, 5) - 2);
-		break;
-	    } else if (bit_buf >= 0x03000000) {
-		mba = MBA_11 + (UBITS (bit_buf, 11) - 24);
-		break;
-	    } else switch (UBITS (bit_buf, 11)) {
-	    case 8:		/* macroblock_escape */
-		mba_inc += 33;
-		/* pass through */
-	    case 15:	/* macroblock_stuffing (MPEG1 only) */
-		DUMPBITS (bit_buf, bits, 11);
-		NEEDBITS (bit_buf, bits, bit_ptr);
-		continue;
-	    default:	/* end of slice, or error */
-		if (mpeg2_cpu_state_restore)
-		    mpeg2_cpu_state_restore (&cpu_state);
-		return;
-	    }
+    if (decoder->mpeg1)
+	decoder->slice_parser = SLICE_PARSER (mpeg1);
+    else if (decoder->chroma_format == 1)
+	decoder->slice_parser = SLICE_PARSER (422);
+    else if (decoder->chroma_format == 2)
+	decoder->slice_parser = SLICE_PARSER (444);
+    else if (decoder->picture_structure != FRAME_PICTURE)
+	decoder->slice_parser = SLICE_PARSER (420_fi);
+    else if (decoder->intra_vlc_format)
+	decoder->slice_parser = SLICE_PARSER (420_fr_B15);
+    else
+	decoder->slice_parser = SLICE_PARSER (420_fr_B14);
+
+    if (decoder->mpeg1) {
+	decoder->motion_parser[0] = MOTION_PARSER (zero_420);
+        decoder->motion_parser[MC_FIELD] = motion_dummy;
+ 	decoder->motion_parser[MC_FRAME] = MOTION_PARSER (mp1);
+        decoder->motion_parser[MC_DMV] = motion_dummy;
+	decoder->motion_parser[4] = MOTION_PARSER (reuse_420);
+    } else if (decoder->picture_structure == FRAME_PICTURE) {
+	if (decoder->chroma_format == 0) {
+	    decoder->motion_parser[0] = MOTION_PARSER (zero_420);
+	    decoder->motion_parser[MC_FIELD] = MOTION_PARSER (fr_field_420);
+	    decoder->motion_parser[MC_FRAME] = MOTION_PARSER (fr_frame_420);
+	    decoder->motion_parser[MC_DMV] = MOTION_PARSER (fr_dmv_420);
+	    decoder->motion_parser[4] = MOTION_PARSER (reuse_420);
+	} else if (decoder->chroma_format == 1) {
+	    decoder->motion_parser[0] = MOTION_PARSER (zero_422);
+	    decoder->motion_parser[MC_FIELD] = MOTION_PARSER (fr_field_422);
+	    decoder->motion_parser[MC_FRAME] = MOTION_PARSER (fr_frame_422);
+	    decoder->motion_parser[MC_DMV] = MOTION_PARSER (fr_dmv_422);
+	    decoder->motion_parser[4] = MOTION_PARSER (reuse_422);
+	} else {
+	    decoder->motion_parser[0] = MOTION_PARSER (zero_444);
+	    decoder->motion_parser[MC_FIELD] = MOTION_PARSER (fr_field_444);
+	    decoder->motion_parser[MC_FRAME] = MOTION_PARSER (fr_frame_444);
+	    decoder->motion_parser[MC_DMV] = MOTION_PARSER (fr_dmv_444);
+	    decoder->motion_parser[4] = MOTION_PARSER (reuse_444);
 	}
-	DUMPBITS (bit_buf, bits, mba->len);
-	mba_inc += mba->mba;
-
-	if (mba_inc) {
-	    decoder->dc_dct_pred[0] = decoder->dc_dct_pred[1] =
-		decoder->dc_dct_pred[2] = 16384;
-
-	    if (decoder->coding_type == P_TYPE) {
-		do {
-		    MOTION_CALL (decoder->motion_parser[0],
-				 MACROBLOCK_MOTION_FORWARD);
-		    NEXT_MACROBLOCK;
-		} while (--mba_inc);
-	    } else {
-		do {
-		    MOTION_CALL (decoder->motion_parser[4], macroblock_modes);
-		    NEXT_MACROBLOCK;
-		} while (--mba_inc);
-	    }
+    } else {
+	if (decoder->chroma_format == 0) {
+	    decoder->motion_parser[0] = MOTION_PARSER (zero_420);
+	    decoder->motion_parser[MC_FIELD] = MOTION_PARSER (fi_field_420);
+	    decoder->motion_parser[MC_16X8] = MOTION_PARSER (fi_16x8_420);
+	    decoder->motion_parser[MC_DMV] = MOTION_PARSER (fi_dmv_420);
+	    decoder->motion_parser[4] = MOTION_PARSER (reuse_420);
+	} else if (decoder->chroma_format == 1) {
+	    decoder->motion_parser[0] = MOTION_PARSER (zero_422);
+	    decoder->motion_parser[MC_FIELD] = MOTION_PARSER (fi_field_422);
+	    decoder->motion_parser[MC_16X8] = MOTION_PARSER (fi_16x8_422);
+	    decoder->motion_parser[MC_DMV] = MOTION_PARSER (fi_dmv_422);
+	    decoder->motion_parser[4] = MOTION_PARSER (reuse_422);
+	} else {
+	    decoder->motion_parser[0] = MOTION_PARSER (zero_444);
+	    decoder->motion_parser[MC_FIELD] = MOTION_PARSER (fi_field_444);
+	    decoder->motion_parser[MC_16X8] = MOTION_PARSER (fi_16x8_444);
+	    decoder->motion_parser[MC_DMV] = MOTION_PARSER (fi_dmv_444);
+	    decoder->motion_parser[4] = MOTION_PARSER (reuse_444);
 	}
     }
-#undef bit_buf
-#undef bits
-#undef bit_ptr
+}
+
+void mpeg2_slice (mpeg2_decoder_t * const decoder, const int code,
+		  const uint8_t * const buffer)
+{
+    decoder->slice_parser (decoder, code, buffer);
 }
@@ -32,13 +32,11 @@ do {								\
     bit_ptr += 2;						\
 } while (0)
 
-static inline void bitstream_init (mpeg2_decoder_t * decoder,
-				   const uint8_t * start)
+static inline void bitstream_init (bitstream_t * bs, const uint8_t * start)
 {
-    decoder->bitstream_buf =
-	(start[0] << 24) | (start[1] << 16) | (start[2] << 8) | start[3];
-    decoder->bitstream_ptr = start + 4;
-    decoder->bitstream_bits = -16;
+    bs->buf = (start[0] << 24) | (start[1] << 16) | (start[2] << 8) | start[3];
+    bs->ptr = start + 4;
+    bs->bits = -16;
 }
 
 /* make sure that there are at least 16 valid bits in bit_buf */
@@ -94,6 +92,13 @@ typedef struct {
     uint8_t len;
 } DCTtab;
 
+typedef struct {
+    DCTtab tab[2];	/* the second one is all zero if there is none */
+    uint8_t run;	/* of both codes, 255 if the first one is not plain */
+    uint8_t len;	/* of both codes, sign bits included */
+    int8_t mask;	/* -1 if there is a second code, 0 if not */
+} DCTpair;
+
 typedef struct {
     uint8_t mba;
     uint8_t len;
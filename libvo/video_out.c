@@ -54,6 +54,9 @@ static vo_driver_t video_out_drivers[] = {
     {"pgm", vo_pgm_open},
     {"pgmpipe", vo_pgmpipe_open},
     {"md5", vo_md5_open},
+#ifdef LIBVO_SHM
+    {"shm", vo_shm_open},
+#endif
     {NULL, NULL}
 };
 
@@ -0,0 +1,255 @@
+/*
+ * video_out_shm.c
+ * Copyright (C) 2000-2003 Michel Lespinasse <walken@zoy.org>
+ * Copyright (C) 1999-2000 Aaron Holtzman <aholtzma@ess.engr.uvic.ca>
+ *
+ * This file is part of mpeg2dec, a free MPEG-2 video stream decoder.
+ * See http://libmpeg2.sourceforge.net/ for updates.
+ *
+ * mpeg2dec is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpeg2dec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpeg2dec; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+
+#ifdef LIBVO_SHM
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <inttypes.h>
+#ifdef HAVE_LINUX_FUTEX_H
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+
+#include "video_out.h"
+#include "vo_internal.h"
+#include "vo_shm.h"
+
+typedef struct {
+    vo_instance_t vo;
+    const char * name;
+    int fd;
+    uint8_t * base;
+    vo_shm_header_t * header;
+    int next;
+    struct {
+	int decoding;		/* between set_fbuf and discard */
+	uint32_t published;	/* seq right after its last draw */
+    } slot[VO_SHM_SLOTS];
+} shm_instance_t;
+
+#ifdef HAVE_LINUX_FUTEX_H
+static void shm_wake (volatile uint32_t * addr)
+{
+    syscall (SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+static int shm_wait (volatile uint32_t * addr, uint32_t value)
+{
+    struct timespec timeout = {1, 0};
+
+    if (syscall (SYS_futex, addr, FUTEX_WAIT, value, &timeout, NULL, 0) &&
+	errno == ETIMEDOUT)
+	return 1;
+    return 0;
+}
+#else
+static void shm_wake (volatile uint32_t * addr)
+{
+}
+
+static int shm_wait (volatile uint32_t * addr, uint32_t value)
+{
+    int i;
+
+    for (i = 0; i < 1000 && *addr == value; i++)
+	usleep (1000);
+    return *addr == value;
+}
+#endif
+
+static void shm_unmap (shm_instance_t * instance)
+{
+    if (instance->base == NULL)
+	return;
+    instance->header->eof = 1;
+    instance->header->magic = 0;
+    shm_wake (&instance->header->seq);
+    munmap (instance->base, instance->header->size);
+    close (instance->fd);
+    shm_unlink (instance->name);
+    instance->base = NULL;
+}
+
+static int shm_setup (vo_instance_t * _instance, unsigned int width,
+		      unsigned int height, unsigned int chroma_width,
+		      unsigned int chroma_height, vo_setup_result_t * result)
+{
+    shm_instance_t * instance = (shm_instance_t *) _instance;
+    vo_shm_header_t * header = instance->header;
+    uint32_t y_size, uv_size, slot_size, size;
+    int i;
+
+    result->convert = NULL;
+    for (i = 0; i < VO_SHM_SLOTS; i++)
+	instance->slot[i].decoding = 0;
+    if (instance->base != NULL && header->width == width &&
+	header->height == height && header->chroma_width == chroma_width &&
+	header->chroma_height == chroma_height)
+	return 0;
+    shm_unmap (instance);
+
+    y_size = (width * height + 63) & ~63;
+    uv_size = (chroma_width * chroma_height + 63) & ~63;
+    slot_size = (y_size + 2 * uv_size + 4095) & ~4095;
+    size = 4096 + VO_SHM_SLOTS * slot_size;
+
+    instance->fd = shm_open (instance->name, O_RDWR | O_CREAT | O_TRUNC,
+			     0600);
+    if (instance->fd < 0) {
+	fprintf (stderr, "shm_open %s: %s\n", instance->name,
+		 strerror (errno));
+	return 1;
+    }
+    if (ftruncate (instance->fd, size) ||
+	(instance->base = (uint8_t *) mmap (NULL, size,
+					    PROT_READ | PROT_WRITE,
+					    MAP_SHARED, instance->fd, 0)) ==
+	MAP_FAILED) {
+	fprintf (stderr, "shm mapping failed: %s\n", strerror (errno));
+	close (instance->fd);
+	shm_unlink (instance->name);
+	instance->base = NULL;
+	return 1;
+    }
+
+    header = instance->header = (vo_shm_header_t *) instance->base;
+    memset (header, 0, sizeof (vo_shm_header_t));
+    header->size = size;
+    header->width = width;
+    header->height = height;
+    header->chroma_width = chroma_width;
+    header->chroma_height = chroma_height;
+    header->nb_slots = VO_SHM_SLOTS;
+    header->slot_offset = 4096;
+    header->slot_size = slot_size;
+    header->plane_offset[0] = 0;
+    header->plane_offset[1] = y_size;
+    header->plane_offset[2] = y_size + uv_size;
+    for (i = 0; i < VO_SHM_SLOTS; i++)
+	instance->slot[i].published = 0;
+    instance->next = 0;
+    __sync_synchronize ();
+    header->magic = VO_SHM_MAGIC;
+    return 0;
+}
+
+static void shm_set_fbuf (vo_instance_t * _instance,
+			  uint8_t ** buf, void ** id)
+{
+    shm_instance_t * instance = (shm_instance_t *) _instance;
+    vo_shm_header_t * header = instance->header;
+    uint8_t * slot;
+    uint32_t released;
+    int i, n;
+
+    while (1) {
+	released = header->released;
+	for (n = 0; n < VO_SHM_SLOTS; n++) {
+	    i = (instance->next + n) % VO_SHM_SLOTS;
+	    if (!instance->slot[i].decoding &&
+		(!header->consumer ||
+		 (int32_t) (released - instance->slot[i].published) >= 0))
+		goto found;
+	}
+	/* all slots are still being read - wait for the consumer */
+	if (shm_wait (&header->released, released)) {
+	    fprintf (stderr, "shm consumer stalled, detaching it\n");
+	    header->consumer = 0;
+	}
+    }
+found:
+    instance->next = (i + 1) % VO_SHM_SLOTS;
+    instance->slot[i].decoding = 1;
+    slot = instance->base + header->slot_offset + i * header->slot_size;
+    buf[0] = slot + header->plane_offset[0];
+    buf[1] = slot + header->plane_offset[1];
+    buf[2] = slot + header->plane_offset[2];
+    *id = (void *) (intptr_t) i;
+}
+
+static void shm_draw_frame (vo_instance_t * _instance,
+			    uint8_t * const * buf, void * id)
+{
+    shm_instance_t * instance = (shm_instance_t *) _instance;
+    vo_shm_header_t * header = instance->header;
+    int i = (intptr_t) id;
+    uint32_t seq = header->seq;
+
+    header->ring[seq % VO_SHM_RING] = i;
+    __sync_synchronize ();
+    header->seq = ++seq;
+    instance->slot[i].published = seq;
+    shm_wake (&header->seq);
+}
+
+static void shm_discard (vo_instance_t * _instance,
+			 uint8_t * const * buf, void * id)
+{
+    shm_instance_t * instance = (shm_instance_t *) _instance;
+
+    instance->slot[(intptr_t) id].decoding = 0;
+}
+
+static void shm_close (vo_instance_t * _instance)
+{
+    shm_instance_t * instance = (shm_instance_t *) _instance;
+
+    shm_unmap (instance);
+    free (instance);
+}
+
+vo_instance_t * vo_shm_open (void)
+{
+    shm_instance_t * instance;
+
+    instance = (shm_instance_t *) malloc (sizeof (shm_instance_t));
+    if (instance == NULL)
+	return NULL;
+
+    instance->vo.setup = shm_setup;
+    instance->vo.setup_fbuf = NULL;
+    instance->vo.set_fbuf = shm_set_fbuf;
+    instance->vo.start_fbuf = NULL;
+    instance->vo.draw = shm_draw_frame;
+    instance->vo.discard = shm_discard;
+    instance->vo.close = shm_close;
+    instance->name = getenv ("MPEG2DEC_SHM");
+    if (instance->name == NULL)
+	instance->name = VO_SHM_NAME;
+    instance->base = NULL;
+    instance->header = NULL;
+
+    return (vo_instance_t *) instance;
+}
+#endif
@@ -35,4 +35,5 @@ extern vo_open_t vo_nullrgb32_open;
 extern vo_open_t vo_pgm_open;
 extern vo_open_t vo_pgmpipe_open;
 extern vo_open_t vo_md5_open;
+extern vo_open_t vo_shm_open;
 
@@ -396,6 +396,14 @@ void dump_state (FILE * f, mpeg2_state_t state, const mpeg2_info_t * info,
 		     pic->display_offset[i].x, pic->display_offset[i].y);
 	fprintf (f, "\n");
 	break;
+    case STATE_SLICE:
+    case STATE_END:
+    case STATE_INVALID_END:
+	pic = info->display_picture;
+	if (pic && (pic->flags & PIC_FLAG_PTS))
+	    fprintf (f, " display pts %lld", (long long) pic->pts);
+	fprintf (f, "\n");
+	break;
     default:
 	fprintf (f, "\n");
     }
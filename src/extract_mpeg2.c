@@ -21,6 +21,7 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#define _GNU_SOURCE	/* splice, copy_file_range */
 #include "config.h"
 
 #include <stdio.h>
@@ -32,13 +33,24 @@
 #include <fcntl.h>
 #include <io.h>
 #endif
+#ifdef HAVE_WRITEV
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 #include <inttypes.h>
 
-#define BUFFER_SIZE 4096
+#include "ts_scan.h"
+#include "ts_psi.h"
+
+#define BUFFER_SIZE 65536
 static uint8_t buffer[BUFFER_SIZE];
 static FILE * in_file;
 static int demux_track = 0xe0;
 static int demux_pid = 0;
+static int demux_pid_auto = 0;
 static int demux_pva = 0;
 
 static void print_usage (char ** argv)
@@ -47,6 +59,7 @@ static void print_usage (char ** argv)
 	     "\t-h\tdisplay help\n"
 	     "\t-s\tset track number (0-15 or 0xe0-0xef)\n"
 	     "\t-t\tuse transport stream demultiplexer, pid 0x10-0x1ffe\n"
+	     "\t\tor auto to find the video pid from the PAT/PMT\n"
 	     "\t-p\tuse pva demultiplexer\n",
 	     argv[0]);
 
@@ -71,6 +84,12 @@ static void handle_args (int argc, char ** argv)
 	    break;
 
 	case 't':
+	    if (!strcmp (optarg, "auto")) {
+		/* not a valid pid, until the PMT tells us which one to use */
+		demux_pid = 0x2000;
+		demux_pid_auto = 1;
+		break;
+	    }
 	    demux_pid = strtol (optarg, &s, 0);
 	    if (demux_pid < 0x10 || demux_pid > 0x1ffe || *s) {
 		fprintf (stderr, "Invalid pid: %s\n", optarg);
@@ -97,7 +116,161 @@ static void handle_args (int argc, char ** argv)
 	in_file = stdin;
 }
 
+/*
+ * Payload output. Rather than going through stdio, the payload ranges
+ * are queued and written with a single writev () before the buffer
+ * they point into is refilled. Long runs are instead copied from the
+ * input file by the kernel: with copy_file_range () when stdout is a
+ * regular file, or splice () when it is a pipe.
+ */
+#ifdef HAVE_WRITEV
+
+#define OUT_IOV 256
+#define OUT_COPY_MIN 16384
+
+static off_t buffer_pos = 0;	/* input file offset of buffer[0] */
+static struct iovec out_iov[OUT_IOV];
+static int out_count = 0;
+static enum {OUT_WRITE, OUT_SPLICE, OUT_COPY_FILE_RANGE} out_mode = OUT_WRITE;
+
+static void out_init (void)
+{
+    struct stat st;
+
+    buffer_pos = lseek (fileno (in_file), 0, SEEK_CUR);
+    if (buffer_pos < 0 || fstat (fileno (in_file), &st) ||
+	!S_ISREG (st.st_mode) || fstat (1, &st))
+	return;
+#ifdef HAVE_SPLICE
+    if (S_ISFIFO (st.st_mode))
+	out_mode = OUT_SPLICE;
+#endif
+#ifdef HAVE_COPY_FILE_RANGE
+    if (S_ISREG (st.st_mode))
+	out_mode = OUT_COPY_FILE_RANGE;
+#endif
+}
+
+static void out_flush (void)
+{
+    struct iovec * iov = out_iov;
+    int count = out_count;
+    ssize_t bytes;
+
+    out_count = 0;
+    while (count) {
+	bytes = writev (1, iov, count);
+	if (bytes < 0) {
+	    if (errno == EINTR)
+		continue;
+	    fprintf (stderr, "%s - could not write output\n", strerror (errno));
+	    exit (1);
+	}
+	for (; count && (size_t) bytes >= iov->iov_len; iov++, count--)
+	    bytes -= iov->iov_len;
+	if (count) {
+	    iov->iov_base = (uint8_t *) iov->iov_base + bytes;
+	    iov->iov_len -= bytes;
+	}
+    }
+}
+
+/* let the kernel copy a payload run, returns how many bytes it did */
+static int out_copy (uint8_t * buf, int len)
+{
+    off_t pos = buffer_pos + (buf - buffer);
+    ssize_t bytes;
+    int done;
+
+    out_flush ();
+    for (done = 0; done < len; done += bytes) {
+#ifdef HAVE_SPLICE
+	if (out_mode == OUT_SPLICE)
+	    bytes = splice (fileno (in_file), &pos, 1, NULL, len - done,
+			    SPLICE_F_MORE);
+	else
+#endif
+#ifdef HAVE_COPY_FILE_RANGE
+	if (out_mode == OUT_COPY_FILE_RANGE)
+	    bytes = copy_file_range (fileno (in_file), &pos, 1, NULL,
+				     len - done, 0);
+	else
+#endif
+	    bytes = -1;
+	if (bytes <= 0) {
+	    if (bytes < 0 && errno == EINTR) {
+		bytes = 0;
+		continue;
+	    }
+	    out_mode = OUT_WRITE;	/* not supported here, stop trying */
+	    break;
+	}
+    }
+    return done;
+}
+
+static void out_write (uint8_t * buf, int len)
+{
+    struct iovec * last = out_iov + out_count - 1;
+
+    if (len >= OUT_COPY_MIN && out_mode != OUT_WRITE) {
+	int done = out_copy (buf, len);
+	buf += done;
+	len -= done;
+    }
+    if (len <= 0)
+	return;
+    if (out_count && (uint8_t *) last->iov_base + last->iov_len == buf) {
+	last->iov_len += len;
+	return;
+    }
+    if (out_count == OUT_IOV)
+	out_flush ();
+    out_iov[out_count].iov_base = buf;
+    out_iov[out_count++].iov_len = len;
+}
+
+#else
+
+static void out_init (void)
+{
+}
+
+static void out_flush (void)
+{
+    if (fflush (stdout)) {
+	fprintf (stderr, "%s - could not write output\n", strerror (errno));
+	exit (1);
+    }
+}
+
+static void out_write (uint8_t * buf, int len)
+{
+    if (fwrite (buf, 1, len, stdout) != (size_t) len) {
+	fprintf (stderr, "%s - could not write output\n", strerror (errno));
+	exit (1);
+    }
+}
+
+#endif
+
+/*
+ * Refill the buffer, keeping the unparsed bytes from keep to end at its
+ * start. Returns the new end of data.
+ */
+static uint8_t * read_buffer (uint8_t * keep, uint8_t * end)
+{
+    out_flush ();
+#ifdef HAVE_WRITEV
+    buffer_pos += keep - buffer;
+#endif
+    memmove (buffer, keep, end - keep);
+    end = buffer + (end - keep);
+    return end + fread (end, 1, buffer + BUFFER_SIZE - end, in_file);
+}
+
 #define DEMUX_PAYLOAD_START 1
+#define DEMUX_RESET 2
 static int demux (uint8_t * buf, uint8_t * end, int flags)
 {
     static int mpeg1_skip_table[16] = {
@@ -162,6 +335,11 @@ static int demux (uint8_t * buf, uint8_t * end, int flags)
 	    buf = header + (x);	\
     } while (0)
 
+    if (flags & DEMUX_RESET) {	/* drop any PES packet in progress */
+	state = DEMUX_SKIP;
+	state_bytes = 0;
+	return 0;
+    }
     if (flags & DEMUX_PAYLOAD_START)
 	goto payload_start;
     switch (state) {
@@ -174,11 +352,11 @@ static int demux (uint8_t * buf, uint8_t * end, int flags)
 	break;
     case DEMUX_DATA:
 	if (demux_pid || (state_bytes > end - buf)) {
-	    fwrite (buf, end - buf, 1, stdout);
+	    out_write (buf, end - buf);
 	    state_bytes -= end - buf;
 	    return 0;
 	}
-	fwrite (buf, state_bytes, 1, stdout);
+	out_write (buf, state_bytes);
 	buf += state_bytes;
 	break;
     case DEMUX_SKIP:
@@ -273,13 +451,13 @@ static int demux (uint8_t * buf, uint8_t * end, int flags)
 		DONEBYTES (len);
 		bytes = 6 + (header[4] << 8) + header[5] - len;
 		if (demux_pid || (bytes > end - buf)) {
-		    fwrite (buf, end - buf, 1, stdout);
+		    out_write (buf, end - buf);
 		    state = DEMUX_DATA;
 		    state_bytes = bytes - (end - buf);
 		    return 0;
 		} else if (bytes <= 0)
 		    continue;
-		fwrite (buf, bytes, 1, stdout);
+		out_write (buf, bytes);
 		buf += bytes;
 	    } else if (header[3] < 0xb9) {
 		fprintf (stderr,
@@ -302,10 +480,10 @@ static int demux (uint8_t * buf, uint8_t * end, int flags)
 
 static void ps_loop (void)
 {
-    uint8_t * end;
+    uint8_t * end = buffer;
 
     do {
-	end = buffer + fread (buffer, 1, BUFFER_SIZE, in_file);
+	end = read_buffer (end, end);
 	if (demux (buffer, end, 0))
 	    break;	/* hit program_end_code */
     } while (end == buffer + BUFFER_SIZE);
@@ -331,11 +509,11 @@ static int pva_demux (uint8_t * buf, uint8_t * end)
         break;
     case DEMUX_DATA:
         if (state_bytes > end - buf) {
-            fwrite (buf, end - buf, 1, stdout);
+            out_write (buf, end - buf);
             state_bytes -= end - buf;
             return 0;
         }
-        fwrite (buf, state_bytes, 1, stdout);
+        out_write (buf, state_bytes);
         buf += state_bytes;
         break;
     case DEMUX_SKIP:
@@ -382,12 +560,12 @@ static int pva_demux (uint8_t * buf, uint8_t * end)
 	    DONEBYTES (len);
 	    bytes = (header[6] << 8) + header[7] + 8 - len;
 	    if (bytes > end - buf) {
-		fwrite (buf, end - buf, 1, stdout);
+		out_write (buf, end - buf);
 		state = DEMUX_DATA;
 		state_bytes = bytes - (end - buf);
 		return 0;
 	    } else if (bytes > 0) {
-		fwrite (buf, bytes, 1, stdout);
+		out_write (buf, bytes);
 		buf += bytes;
 	    }
 	}
@@ -396,49 +574,78 @@ static int pva_demux (uint8_t * buf, uint8_t * end)
 
 static void pva_loop (void)
 {
-    uint8_t * end;
+    uint8_t * end = buffer;
 
     do {
-	end = buffer + fread (buffer, 1, BUFFER_SIZE, in_file);
+	end = read_buffer (end, end);
 	pva_demux (buffer, end);
     } while (end == buffer + BUFFER_SIZE);
 }
 
+static psi_t pat = {0, -1, 0, 0};
+static psi_t pmt = {-1, -1, 0, 0};
+
 static void ts_loop (void)
 {
     uint8_t * buf;
     uint8_t * nextbuf;
     uint8_t * data;
     uint8_t * end;
-    int pid;
+    uint8_t * section;
+    int pid[TS_SCAN_PACKETS];
+    int packet_size = 0;
+    int i, n, video, last;
 
-    buf = buffer;
+    buf = end = buffer;
     while (1) {
-	end = buf + fread (buf, 1, buffer + BUFFER_SIZE - buf, in_file);
+	end = read_buffer (buf, end);
+	last = (end != buffer + BUFFER_SIZE);
 	buf = buffer;
-	for (; (nextbuf = buf + 188) <= end; buf = nextbuf) {
-	    if (*buf != 0x47) {
-		fprintf (stderr, "bad sync byte\n");
-		nextbuf = buf + 1;
-		continue;
-	    }
-	    pid = ((buf[1] << 8) + buf[2]) & 0x1fff;
-	    if (pid != demux_pid)
-		continue;
-	    data = buf + 4;
-	    if (buf[3] & 0x20) {	/* buf contains an adaptation field */
-		data = buf + 5 + buf[4];
-		if (data > nextbuf)
+	while (1) {
+	    n = packet_size ? ts_scan (buf, end, packet_size, last, pid) : 0;
+	    for (i = 0; i < n; i++, buf += packet_size) {
+		nextbuf = buf + 188;
+		if (pid[i] != demux_pid &&
+		    !(demux_pid_auto && (pid[i] == pat.pid || pid[i] == pmt.pid)))
+		    continue;
+		data = buf + 4;
+		if (buf[3] & 0x20) {	/* buf contains an adaptation field */
+		    data = buf + 5 + buf[4];
+		    if (data > nextbuf)
+			continue;
+		}
+		if (!(buf[3] & 0x10))
 		    continue;
+		if (pid[i] == demux_pid)
+		    demux (data, nextbuf,
+			   (buf[1] & 0x40) ? DEMUX_PAYLOAD_START : 0);
+		else if (pid[i] == pat.pid) {
+		    section = psi_section (&pat, data, nextbuf, buf[1] & 0x40);
+		    if (section)
+			ts_pat (section, &pmt);
+		} else {
+		    section = psi_section (&pmt, data, nextbuf, buf[1] & 0x40);
+		    video = section ? ts_pmt (section, &pmt) : -1;
+		    if (video >= 0 && video != demux_pid) {
+			fprintf (stderr, "using video pid 0x%x\n", video);
+			demux_pid = video;
+			demux (NULL, NULL, DEMUX_RESET);
+		    }
+		}
 	    }
-	    if (buf[3] & 0x10)
-		demux (data, nextbuf,
-		       (buf[1] & 0x40) ? DEMUX_PAYLOAD_START : 0);
+	    if (n == TS_SCAN_PACKETS)
+		continue;
+	    /* wait until the packet at buf can be judged */
+	    if (buf + (last ? 188 : TS_SCAN_AHEAD) > end)
+		break;
+	    if (packet_size)
+		fprintf (stderr, "bad sync byte\n");
+	    buf = ts_sync (buf, end, last, &packet_size);
+	    if (!packet_size)
+		break;
 	}
-	if (end != buffer + BUFFER_SIZE)
+	if (last)
 	    break;
-	memcpy (buffer, buf, end - buf);
-	buf = buffer + (end - buf);
     }
 }
 
@@ -450,6 +657,7 @@ int main (int argc, char ** argv)
 #endif
 
     handle_args (argc, argv);
+    out_init ();
 
     if (demux_pva)
 	pva_loop ();
@@ -457,6 +665,7 @@ int main (int argc, char ** argv)
 	ts_loop ();
     else
 	ps_loop ();
+    out_flush ();
 
     return 0;
 }
@@ -41,11 +41,15 @@
 #include "mpeg2.h"
 #include "video_out.h"
 #include "gettimeofday.h"
+#include "ts_scan.h"
+#include "ts_psi.h"
+#include "perf_counters.h"
 
 static int buffer_size = 4096;
 static FILE * in_file;
 static int demux_track = 0;
 static int demux_pid = 0;
+static int demux_pid_auto = 0;
 static int demux_pva = 0;
 static mpeg2dec_t * mpeg2dec;
 static vo_open_t * output_open = NULL;
@@ -53,10 +57,30 @@ static vo_instance_t * output;
 static int sigint = 0;
 static int total_offset = 0;
 static int verbose = 0;
+#define REPORT_JSON 1
+#define REPORT_CSV 2
+static int report_format = 0;
+static int report_interval = 0;
+static FILE * report_file;
+static int perf = 0;
+static int tiled = 0;
 
 void dump_state (FILE * f, mpeg2_state_t state, const mpeg2_info_t * info,
 		 int offset, int verbose);
 
+/* 0, 1, 2 for I, P, B pictures, D pictures count as I */
+static int picture_type (const mpeg2_info_t * info)
+{
+    switch (info->current_picture->flags & PIC_MASK_CODING_TYPE) {
+    case PIC_FLAG_CODING_TYPE_P:
+	return 1;
+    case PIC_FLAG_CODING_TYPE_B:
+	return 2;
+    default:
+	return 0;
+    }
+}
+
 #ifdef HAVE_GETTIMEOFDAY
 
 static RETSIGTYPE signal_handler (int sig)
@@ -121,13 +145,397 @@ static void print_fps (int final)
     last_count = frame_counter;
 }
 
+/*
+ * Per-picture decode times for -r, kept in log-linear histograms:
+ * 64 buckets per power of two, so percentiles are within 1.6%.
+ * Times are in microseconds and only count time spent in mpeg2_parse.
+ */
+#define LATENCY_BUCKETS ((32 - 6 + 1) << 6)
+
+typedef struct {
+    unsigned int count;
+    uint64_t bytes;
+    unsigned int max;
+    unsigned int bucket[LATENCY_BUCKETS];
+} latency_t;
+
+typedef struct {
+    struct timeval start;
+    latency_t latency[4];	/* I, P, B, all */
+    unsigned int queue_max;
+    uint64_t queue_sum;
+} report_t;
+
+static report_t report_total, report_last;
+
+static double seconds (const struct timeval * start,
+		       const struct timeval * end)
+{
+    return ((end->tv_sec - start->tv_sec) +
+	    (end->tv_usec - start->tv_usec) * 1e-6);
+}
+
+static int latency_bucket (unsigned int usec)
+{
+    int shift;
+
+    for (shift = 0; (usec >> shift) >= 128; shift++);
+    return (shift << 6) + (usec >> shift);
+}
+
+static unsigned int latency_percentile (const latency_t * latency, int p)
+{
+    unsigned int target, seen;
+    int i, shift;
+
+    target = ((uint64_t) latency->count * p + 99) / 100;
+    seen = 0;
+    for (i = 0; i < LATENCY_BUCKETS; i++) {
+	seen += latency->bucket[i];
+	if (seen >= target && seen)
+	    break;
+    }
+    if (i < 128)
+	return i;
+    shift = (i >> 6) - 1;
+    i = (i - (shift << 6)) << shift;
+    return ((unsigned int) i < latency->max) ? (unsigned int) i : latency->max;
+}
+
+static void latency_add (latency_t * latency, unsigned int usec, int bytes)
+{
+    latency->count++;
+    latency->bytes += bytes;
+    if (usec > latency->max)
+	latency->max = usec;
+    latency->bucket[latency_bucket (usec)]++;
+}
+
+static void print_report (const report_t * report, const struct timeval * now,
+			  int final)
+{
+    static const char * const type[4] = {"I", "P", "B", "all"};
+    static int header = 0;
+    const latency_t * all;
+    double elapsed, fps, mbps, queue;
+    int i;
+
+    elapsed = seconds (&report->start, now);
+    all = report->latency + 3;
+    fps = mbps = queue = 0;
+    if (elapsed > 0) {
+	fps = all->count / elapsed;
+	mbps = all->bytes * 8 / elapsed * 1e-6;
+    }
+    if (all->count)
+	queue = (double) report->queue_sum / all->count;
+
+    if (report_format == REPORT_CSV) {
+	if (!header)
+	    fprintf (report_file, "time,final,type,count,bytes,p50_us,p90_us,"
+		     "p99_us,max_us,fps,mbps,queue_max,queue_mean\n");
+	header = 1;
+	for (i = 0; i < 4; i++)
+	    fprintf (report_file, "%ld.%06ld,%d,%s,%u,%" PRIu64 ",%u,%u,%u,"
+		     "%u,%.2f,%.3f,%u,%.2f\n", (long) now->tv_sec,
+		     (long) now->tv_usec, final, type[i],
+		     report->latency[i].count, report->latency[i].bytes,
+		     latency_percentile (report->latency + i, 50),
+		     latency_percentile (report->latency + i, 90),
+		     latency_percentile (report->latency + i, 99),
+		     report->latency[i].max, fps, mbps,
+		     report->queue_max, queue);
+    } else {
+	fprintf (report_file, "{\"time\": %ld.%06ld, \"final\": %s, "
+		 "\"elapsed\": %.3f, \"fps\": %.2f, \"mbps\": %.3f, "
+		 "\"queue_max\": %u, \"queue_mean\": %.2f",
+		 (long) now->tv_sec, (long) now->tv_usec,
+		 final ? "true" : "false", elapsed,
+		 fps, mbps, report->queue_max, queue);
+	for (i = 0; i < 4; i++)
+	    fprintf (report_file, ", \"%s\": {\"count\": %u, "
+		     "\"bytes\": %" PRIu64 ", \"p50_us\": %u, "
+		     "\"p90_us\": %u, \"p99_us\": %u, \"max_us\": %u}",
+		     type[i], report->latency[i].count,
+		     report->latency[i].bytes,
+		     latency_percentile (report->latency + i, 50),
+		     latency_percentile (report->latency + i, 90),
+		     latency_percentile (report->latency + i, 99),
+		     report->latency[i].max);
+	fprintf (report_file, "}\n");
+    }
+    fflush (report_file);
+}
+
+static void report_picture (report_t * report, int type, unsigned int usec,
+			    int bytes, unsigned int queue)
+{
+    latency_add (report->latency + type, usec, bytes);
+    latency_add (report->latency + 3, usec, bytes);
+    if (queue > report->queue_max)
+	report->queue_max = queue;
+    report->queue_sum += queue;
+}
+
+static void report_parse (mpeg2_state_t state, const mpeg2_info_t * info,
+			  struct timeval * start)
+{
+    static unsigned int usec, decoded, displayed;
+    static int picture_offset, type = -1;
+    struct timeval now;
+    int offset;
+
+    gettimeofday (&now, NULL);
+    if (!report_total.start.tv_sec)
+	report_total.start = report_last.start = *start;
+    if (state == STATE_PICTURE)
+	usec = 0;
+    usec += ((now.tv_sec - start->tv_sec) * 1000000 +
+	     now.tv_usec - start->tv_usec);
+    offset = total_offset - mpeg2_getpos (mpeg2dec);
+
+    switch (state) {
+    case STATE_PICTURE:
+	picture_offset = offset;
+	type = picture_type (info);
+	break;
+    case STATE_SLICE:
+    case STATE_END:
+    case STATE_INVALID_END:
+	if (type >= 0) {
+	    decoded++;
+	    if (info->display_fbuf)
+		displayed++;
+	    report_picture (&report_total, type, usec,
+			    offset - picture_offset, decoded - displayed);
+	    report_picture (&report_last, type, usec,
+			    offset - picture_offset, decoded - displayed);
+	    type = -1;
+	} else if (info->display_fbuf)
+	    displayed++;
+	break;
+    default:
+	break;
+    }
+
+    if (report_interval &&
+	seconds (&report_last.start, &now) >= report_interval) {
+	print_report (&report_last, &now, 0);
+	memset (&report_last, 0, sizeof (report_t));
+	report_last.start = now;
+    }
+}
+
+static void print_final_report (void)
+{
+    struct timeval now;
+
+    if (!report_format || !report_total.start.tv_sec)
+	return;
+    gettimeofday (&now, NULL);
+    print_report (&report_total, &now, 1);
+    if (report_file != stderr)
+	fclose (report_file);
+}
+
 #else /* !HAVE_GETTIMEOFDAY */
 
 static void print_fps (int final)
 {
 }
 
+static void print_final_report (void)
+{
+}
+
+#endif
+
+/*
+ * Hardware counters for -P, by picture type for the mpeg2_parse calls
+ * that decode a picture, then for the other mpeg2_parse calls, for the
+ * output driver and for the whole decode loop.
+ */
+#define PERF_HEADERS 3
+#define PERF_DRAW 4
+#define PERF_TOTAL 5
+#define PERF_STAGES 6
+
+static int perf_mask = 0;
+static unsigned int perf_pictures[3];
+static uint64_t perf_stage[PERF_STAGES][PERF_VALUES];
+
+static void perf_add (int stage, const uint64_t * start)
+{
+    uint64_t now[PERF_VALUES];
+    int i;
+
+    perf_read (now);
+    for (i = 0; i < PERF_VALUES; i++)
+	perf_stage[stage][i] += now[i] - start[i];
+}
+
+static void perf_parse (mpeg2_state_t state, const mpeg2_info_t * info,
+			const uint64_t * start)
+{
+    static int type = -1;
+
+    if (state == STATE_PICTURE)
+	type = picture_type (info);
+    perf_add ((type < 0) ? PERF_HEADERS : type, start);
+    if (type >= 0 && (state == STATE_SLICE || state == STATE_END ||
+		      state == STATE_INVALID_END)) {
+	perf_pictures[type]++;
+	type = -1;
+    }
+}
+
+static void print_perf (void)
+{
+    static const char * const stage_name[PERF_STAGES] = {
+	"I", "P", "B", "headers", "draw", "total"
+    };
+    uint64_t enabled, running;
+    double count;
+    int stage, i, multiplexed;
+
+    if (!perf_mask)
+	return;
+    multiplexed = 0;
+    fprintf (stderr, "\nperf counters, per picture for I, P and B:\n%-12s",
+	     "");
+    for (i = 0; i < PERF_COUNTERS; i++)
+	fprintf (stderr, (i == 2) ? "    ipc %13s" : " %13s",
+		 perf_counter_name[i]);
+    fprintf (stderr, "\n");
+    for (stage = 0; stage < PERF_STAGES; stage++) {
+	count = 1;
+	if (stage < PERF_HEADERS) {
+	    if (!perf_pictures[stage])
+		continue;
+	    count = perf_pictures[stage];
+	    fprintf (stderr, "%-3s %8u", stage_name[stage], perf_pictures[stage]);
+	} else
+	    fprintf (stderr, "%-12s", stage_name[stage]);
+	/* extrapolate the counts when they did not run the whole time */
+	enabled = perf_stage[stage][PERF_TIME_ENABLED];
+	running = perf_stage[stage][PERF_TIME_RUNNING];
+	if (running < enabled) {
+	    multiplexed = 1;
+	    count = running ? count * running / enabled : 0;
+	}
+	for (i = 0; i < PERF_COUNTERS; i++) {
+	    if (i == 2) {
+		if ((perf_mask & 3) == 3 && perf_stage[stage][0])
+		    fprintf (stderr, " %6.2f", ((double) perf_stage[stage][1] /
+						perf_stage[stage][0]));
+		else
+		    fprintf (stderr, " %6s", "-");
+	    }
+	    if ((perf_mask & (1 << i)) && count)
+		fprintf (stderr, " %13.0f", perf_stage[stage][i] / count);
+	    else
+		fprintf (stderr, " %13s", "-");
+	}
+	fprintf (stderr, (running < enabled) ? " *\n" : "\n");
+    }
+    if (multiplexed)
+	fprintf (stderr, "* multiplexed with other counter users, "
+		 "counts scaled up from part of the time\n");
+}
+
+static mpeg2_state_t parse (const mpeg2_info_t * info)
+{
+#ifdef HAVE_GETTIMEOFDAY
+    struct timeval start;
+#endif
+    uint64_t counters[PERF_VALUES];
+    mpeg2_state_t state;
+
+    if (!report_format && !perf_mask)
+	return mpeg2_parse (mpeg2dec);
+#ifdef HAVE_GETTIMEOFDAY
+    gettimeofday (&start, NULL);
+#endif
+    if (perf_mask)
+	perf_read (counters);
+    state = mpeg2_parse (mpeg2dec);
+    if (perf_mask)
+	perf_parse (state, info, counters);
+#ifdef HAVE_GETTIMEOFDAY
+    if (report_format)
+	report_parse (state, info, &start);
 #endif
+    return state;
+}
+
+static void draw (const mpeg2_fbuf_t * fbuf)
+{
+    uint64_t counters[PERF_VALUES];
+
+    if (perf_mask)
+	perf_read (counters);
+    output->draw (output, fbuf->buf, fbuf->id);
+    if (perf_mask)
+	perf_add (PERF_DRAW, counters);
+}
+
+static void print_stats (void)
+{
+    const mpeg2_stats_t * stats;
+    const char * unit;
+    uint64_t vlc;
+    int i;
+
+    stats = mpeg2_get_stats (mpeg2dec);
+    if (stats == NULL)
+	return;
+
+    unit = (stats->flags & MPEG2_STATS_NANOSECONDS) ? "ns" : "cycles";
+    vlc = (stats->slice_time - stats->idct_time - stats->mc_time -
+	   stats->convert_time);
+    fprintf (stderr, "\nstatistics (%s):\n", unit);
+    fprintf (stderr, "chunk   %14" PRIu64 " %12" PRIu64 " bytes\n",
+	     stats->chunk_time, stats->chunk_bytes);
+    fprintf (stderr, "slice   %14" PRIu64 " %12" PRIu64 " slices\n",
+	     stats->slice_time, stats->slices);
+    fprintf (stderr, "vlc     %14" PRIu64 "\n", vlc);
+    fprintf (stderr, "idct    %14" PRIu64 " intra", stats->idct_time);
+    for (i = 0; i < 4; i++)
+	fprintf (stderr, " %" PRIu64, stats->idct_intra[i]);
+    fprintf (stderr, " non-intra");
+    for (i = 0; i < 4; i++)
+	fprintf (stderr, " %" PRIu64, stats->idct_non_intra[i]);
+    fprintf (stderr, "\nmc      %14" PRIu64 " put", stats->mc_time);
+    for (i = 0; i < 8; i++)
+	fprintf (stderr, " %" PRIu64, stats->mc_put[i]);
+    fprintf (stderr, " avg");
+    for (i = 0; i < 8; i++)
+	fprintf (stderr, " %" PRIu64, stats->mc_avg[i]);
+    fprintf (stderr, "\nconvert %14" PRIu64 " %12" PRIu64 " calls\n",
+	     stats->convert_time, stats->convert_calls);
+}
+
+static void print_memory (void)
+{
+    static const char * const reason_name[MPEG2_ALLOC_REASONS] = {
+	"mpeg2dec", "chunk", "yuv", "convert id", "converted",
+	"yuv reference", "yuv scratch"
+    };
+    const mpeg2_memory_t * memory;
+    int i;
+
+    memory = mpeg2_memory_usage (mpeg2dec);
+    fprintf (stderr, "\nmemory (bytes)        in use          peak\n");
+    for (i = 0; i < MPEG2_ALLOC_REASONS; i++)
+	if (memory->peak[i])
+	    fprintf (stderr, "%-14s %13lu %13lu\n", reason_name[i],
+		     memory->in_use[i], memory->peak[i]);
+    fprintf (stderr, "%-14s %13lu %13lu\n", "total", memory->total,
+	     memory->total_peak);
+    if (memory->untracked)
+	fprintf (stderr, "%lu buffers not accounted for\n",
+		 memory->untracked);
+}
 
 static void print_usage (char ** argv)
 {
@@ -136,15 +544,22 @@ static void print_usage (char ** argv)
 
     fprintf (stderr, "usage: "
 	     "%s [-h] [-o <mode>] [-s [<track>]] [-t <pid>] [-p] [-c] \\\n"
-	     "\t\t[-v] [-b <bufsize>] <file>\n"
+	     "\t\t[-v] [-b <bufsize>] [-r json|csv[,<sec>][,<file>]] [-P] [-T] \\\n"
+	     "\t\t<file>\n"
 	     "\t-h\tdisplay help and available video output modes\n"
 	     "\t-s\tuse program stream demultiplexer, "
 	     "track 0-15 or 0xe0-0xef\n"
 	     "\t-t\tuse transport stream demultiplexer, pid 0x10-0x1ffe\n"
+	     "\t\tor auto to find the video pid from the PAT/PMT\n"
 	     "\t-p\tuse pva demultiplexer\n"
 	     "\t-c\tuse c implementation, disables all accelerations\n"
-	     "\t-v\tverbose information about the MPEG stream\n"
+	     "\t-v\tverbose information about the MPEG stream, and the "
+	     "memory used\n"
 	     "\t-b\tset input buffer size, default 4096 bytes\n"
+	     "\t-r\treport decode times per picture type as json or csv,\n"
+	     "\t\tevery <sec> seconds and at exit, to stderr or <file>\n"
+	     "\t-P\treport hardware performance counters per picture type\n"
+	     "\t-T\tdecode into tiled reference frames\n"
 	     "\t-o\tvideo output mode\n", argv[0]);
 
     drivers = vo_drivers ();
@@ -162,7 +577,7 @@ static void handle_args (int argc, char ** argv)
     char * s;
 
     drivers = vo_drivers ();
-    while ((c = getopt (argc, argv, "hs::t:pco:vb::")) != -1)
+    while ((c = getopt (argc, argv, "hs::t:pco:vb::r:PT")) != -1)
 	switch (c) {
 	case 'o':
 	    for (i = 0; drivers[i].name != NULL; i++)
@@ -188,6 +603,12 @@ static void handle_args (int argc, char ** argv)
 	    break;
 
 	case 't':
+	    if (!strcmp (optarg, "auto")) {
+		/* not a valid pid, until the PMT tells us which one to use */
+		demux_pid = 0x2000;
+		demux_pid_auto = 1;
+		break;
+	    }
 	    demux_pid = strtol (optarg, &s, 0);
 	    if (demux_pid < 0x10 || demux_pid > 0x1ffe || *s) {
 		fprintf (stderr, "Invalid pid: %s\n", optarg);
@@ -219,6 +640,35 @@ static void handle_args (int argc, char ** argv)
 	    }
 	    break;
 
+	case 'P':
+	    perf = 1;
+	    break;
+
+	case 'T':
+	    tiled = 1;
+	    break;
+
+	case 'r':
+	    if (!strncmp (optarg, "json", 4))
+		report_format = REPORT_JSON;
+	    else if (!strncmp (optarg, "csv", 3))
+		report_format = REPORT_CSV;
+	    s = optarg + ((report_format == REPORT_JSON) ? 4 : 3);
+	    if (*s == ',' && s[1] >= '0' && s[1] <= '9')
+		report_interval = strtol (s + 1, &s, 0);
+	    if (!report_format || report_interval < 0 || (*s && *s != ',')) {
+		fprintf (stderr, "Invalid report: %s\n", optarg);
+		print_usage (argv);
+	    }
+	    /* not on stdout, where -o pgmpipe and friends write */
+	    report_file = stderr;
+	    if (*s && !(report_file = fopen (s + 1, "w"))) {
+		fprintf (stderr, "%s - could not open report file %s\n",
+			 strerror (errno), s + 1);
+		exit (1);
+	    }
+	    break;
+
 	default:
 	    print_usage (argv);
 	}
@@ -276,7 +726,7 @@ static void decode_mpeg2 (uint8_t * current, uint8_t * end)
 
     info = mpeg2_info (mpeg2dec);
     while (1) {
-	state = mpeg2_parse (mpeg2dec);
+	state = parse (info);
 	if (verbose)
 	    dump_state (stderr, state, info,
 			total_offset - mpeg2_getpos (mpeg2dec), verbose);
@@ -341,8 +791,7 @@ static void decode_mpeg2 (uint8_t * current, uint8_t * end)
 	    /* might free frame buffer */
 	    if (info->display_fbuf) {
 		if (output->draw)
-		    output->draw (output, info->display_fbuf->buf,
-				  info->display_fbuf->id);
+		    draw (info->display_fbuf);
 		print_fps (0);
 	    }
 	    if (output->discard && info->discard_fbuf)
@@ -355,7 +804,16 @@ static void decode_mpeg2 (uint8_t * current, uint8_t * end)
     }
 }
 
+/* 33-bit timestamp from a PES header, without its marker bits */
+static int64_t pes_timestamp (uint8_t * buf)
+{
+    return ((((int64_t) (buf[0] & 0x0e)) << 29) |
+	    (buf[1] << 22) | ((buf[2] >> 1) << 15) |
+	    (buf[3] << 7) | (buf[4] >> 1));
+}
+
 #define DEMUX_PAYLOAD_START 1
+#define DEMUX_RESET 2
 static int demux (uint8_t * buf, uint8_t * end, int flags)
 {
     static int mpeg1_skip_table[16] = {
@@ -420,6 +878,11 @@ static int demux (uint8_t * buf, uint8_t * end, int flags)
 	    buf = header + (x);	\
     } while (0)
 
+    if (flags & DEMUX_RESET) {	/* drop any PES packet in progress */
+	state = DEMUX_SKIP;
+	state_bytes = 0;
+	return 0;
+    }
     if (flags & DEMUX_PAYLOAD_START)
 	goto payload_start;
     switch (state) {
@@ -511,17 +974,12 @@ static int demux (uint8_t * buf, uint8_t * end, int flags)
 		    NEEDBYTES (len);
 		    /* header points to the mpeg2 pes header */
 		    if (header[7] & 0x80) {
-			uint32_t pts, dts;
-
-			pts = (((header[9] >> 1) << 30) |
-			       (header[10] << 22) | ((header[11] >> 1) << 15) |
-			       (header[12] << 7) | (header[13] >> 1));
-			dts = (!(header[7] & 0x40) ? pts :
-			       (uint32_t)(((header[14] >> 1) << 30) |
-				(header[15] << 22) |
-				((header[16] >> 1) << 15) |
-				(header[17] << 7) | (header[18] >> 1)));
-			mpeg2_tag_picture (mpeg2dec, pts, dts);
+			int64_t pts, dts;
+
+			pts = pes_timestamp (header + 9);
+			dts = (header[7] & 0x40) ? pes_timestamp (header + 14) : -1;
+			mpeg2_tag_picture (mpeg2dec, pts, (dts < 0) ? pts : dts);
+			mpeg2_tag_timestamps (mpeg2dec, pts, dts);
 		    }
 		} else {	/* mpeg1 */
 		    int len_skip;
@@ -546,16 +1004,13 @@ static int demux (uint8_t * buf, uint8_t * end, int flags)
 		    /* header points to the mpeg1 pes header */
 		    ptsbuf = header + len_skip;
 		    if ((ptsbuf[-1] & 0xe0) == 0x20) {
-			uint32_t pts, dts;
-
-			pts = (((ptsbuf[-1] >> 1) << 30) |
-			       (ptsbuf[0] << 22) | ((ptsbuf[1] >> 1) << 15) |
-			       (ptsbuf[2] << 7) | (ptsbuf[3] >> 1));
-			dts = (((ptsbuf[-1] & 0xf0) != 0x30) ? pts :
-			       (uint32_t)(((ptsbuf[4] >> 1) << 30) |
-				(ptsbuf[5] << 22) | ((ptsbuf[6] >> 1) << 15) |
-				(ptsbuf[7] << 7) | (ptsbuf[18] >> 1)));
-			mpeg2_tag_picture (mpeg2dec, pts, dts);
+			int64_t pts, dts;
+
+			pts = pes_timestamp (ptsbuf - 1);
+			dts = (((ptsbuf[-1] & 0xf0) == 0x30) ?
+			       pes_timestamp (ptsbuf + 4) : -1);
+			mpeg2_tag_picture (mpeg2dec, pts, (dts < 0) ? pts : dts);
+			mpeg2_tag_timestamps (mpeg2dec, pts, dts);
 		    }
 		}
 		DONEBYTES (len);
@@ -612,6 +1067,7 @@ static int pva_demux (uint8_t * buf, uint8_t * end)
     uint8_t * header;
     int bytes;
     int len;
+    uint32_t pts;
 
     switch (state) {
     case DEMUX_HEADER:
@@ -671,9 +1127,10 @@ static int pva_demux (uint8_t * buf, uint8_t * end)
 		len = 12 + (header[5] & 3);
 		NEEDBYTES (len);
 		decode_mpeg2 (header + 12, header + len);
-		mpeg2_tag_picture (mpeg2dec,
-				   ((header[8] << 24) | (header[9] << 16) |
-				    (header[10] << 8) | header[11]), 0);
+		pts = ((header[8] << 24) | (header[9] << 16) |
+		       (header[10] << 8) | header[11]);
+		mpeg2_tag_picture (mpeg2dec, pts, 0);
+		mpeg2_tag_timestamps (mpeg2dec, pts, -1);
 	    }
 	    DONEBYTES (len);
 	    bytes = (header[6] << 8) + header[7] + 8 - len;
@@ -704,6 +1161,9 @@ static void pva_loop (void)
     free (buffer);
 }
 
+static psi_t pat = {0, -1, 0, 0};
+static psi_t pmt = {-1, -1, 0, 0};
+
 static void ts_loop (void)
 {
     uint8_t * buffer = (uint8_t *) malloc (buffer_size);
@@ -711,36 +1171,64 @@ static void ts_loop (void)
     uint8_t * nextbuf;
     uint8_t * data;
     uint8_t * end;
-    int pid;
+    uint8_t * section;
+    int pid[TS_SCAN_PACKETS];
+    int packet_size = 0;
+    int i, n, video, last;
 
-    if (buffer == NULL || buffer_size < 188)
+    if (buffer == NULL || buffer_size < TS_BUFFER_MIN)
 	exit (1);
     buf = buffer;
     do {
 	end = buf + fread (buf, 1, buffer + buffer_size - buf, in_file);
+	last = (end != buffer + buffer_size);
 	buf = buffer;
-	for (; (nextbuf = buf + 188) <= end; buf = nextbuf) {
-	    if (*buf != 0x47) {
-		fprintf (stderr, "bad sync byte\n");
-		nextbuf = buf + 1;
-		continue;
-	    }
-	    pid = ((buf[1] << 8) + buf[2]) & 0x1fff;
-	    if (pid != demux_pid)
-		continue;
-	    data = buf + 4;
-	    if (buf[3] & 0x20) {	/* buf contains an adaptation field */
-		data = buf + 5 + buf[4];
-		if (data > nextbuf)
+	while (1) {
+	    n = packet_size ? ts_scan (buf, end, packet_size, last, pid) : 0;
+	    for (i = 0; i < n; i++, buf += packet_size) {
+		nextbuf = buf + 188;
+		if (pid[i] != demux_pid &&
+		    !(demux_pid_auto && (pid[i] == pat.pid || pid[i] == pmt.pid)))
+		    continue;
+		data = buf + 4;
+		if (buf[3] & 0x20) {	/* buf contains an adaptation field */
+		    data = buf + 5 + buf[4];
+		    if (data > nextbuf)
+			continue;
+		}
+		if (!(buf[3] & 0x10))
 		    continue;
+		if (pid[i] == demux_pid)
+		    demux (data, nextbuf,
+			   (buf[1] & 0x40) ? DEMUX_PAYLOAD_START : 0);
+		else if (pid[i] == pat.pid) {
+		    section = psi_section (&pat, data, nextbuf, buf[1] & 0x40);
+		    if (section)
+			ts_pat (section, &pmt);
+		} else {
+		    section = psi_section (&pmt, data, nextbuf, buf[1] & 0x40);
+		    video = section ? ts_pmt (section, &pmt) : -1;
+		    if (video >= 0 && video != demux_pid) {
+			fprintf (stderr, "using video pid 0x%x\n", video);
+			demux_pid = video;
+			demux (NULL, NULL, DEMUX_RESET);
+		    }
+		}
 	    }
-	    if (buf[3] & 0x10)
-		demux (data, nextbuf,
-		       (buf[1] & 0x40) ? DEMUX_PAYLOAD_START : 0);
+	    if (n == TS_SCAN_PACKETS)
+		continue;
+	    /* wait until the packet at buf can be judged */
+	    if (buf + (last ? 188 : TS_SCAN_AHEAD) > end)
+		break;
+	    if (packet_size)
+		fprintf (stderr, "bad sync byte\n");
+	    buf = ts_sync (buf, end, last, &packet_size);
+	    if (!packet_size)
+		break;
 	}
-	if (end != buffer + buffer_size)
+	if (last)
 	    break;
-	memcpy (buffer, buf, end - buf);
+	memmove (buffer, buf, end - buf);
 	buf = buffer + (end - buf);
     } while (!sigint);
     free (buffer);
@@ -762,6 +1250,8 @@ static void es_loop (void)
 
 int main (int argc, char ** argv)
 {
+    uint64_t perf_start[PERF_COUNTERS];
+
 #ifdef HAVE_IO_H
     setmode (fileno (stdin), O_BINARY);
     setmode (fileno (stdout), O_BINARY);
@@ -780,8 +1270,11 @@ int main (int argc, char ** argv)
     mpeg2dec = mpeg2_init ();
     if (mpeg2dec == NULL)
 	exit (1);
+    mpeg2_tiled (mpeg2dec, tiled);
     mpeg2_malloc_hooks (malloc_hook, NULL);
 
+    if (perf && (perf_mask = perf_open ()))
+	perf_read (perf_start);
     if (demux_pva)
 	pva_loop ();
     else if (demux_pid)
@@ -791,10 +1284,20 @@ int main (int argc, char ** argv)
     else
 	es_loop ();
 
+    if (perf_mask) {
+	perf_add (PERF_TOTAL, perf_start);
+	perf_close ();
+    }
+    if (verbose) {
+	print_stats ();
+	print_memory ();
+    }
     mpeg2_close (mpeg2dec);
     if (output->close)
 	output->close (output);
     print_fps (1);
+    print_final_report ();
+    print_perf ();
     fclose (in_file);
     return 0;
 }
@@ -0,0 +1,146 @@
+/*
+ * perf_counters.c
+ * Copyright (C) 2000-2003 Michel Lespinasse <walken@zoy.org>
+ * Copyright (C) 1999-2000 Aaron Holtzman <aholtzma@ess.engr.uvic.ca>
+ *
+ * This file is part of mpeg2dec, a free MPEG-2 video stream decoder.
+ * See http://libmpeg2.sourceforge.net/ for updates.
+ *
+ * mpeg2dec is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpeg2dec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpeg2dec; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "perf_counters.h"
+
+const char * const perf_counter_name[PERF_COUNTERS] = {
+    "cycles", "instructions", "l1d-miss", "llc-miss", "branch-miss"
+};
+
+#ifdef HAVE_LINUX_PERF_EVENT_H
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} events[PERF_COUNTERS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, (PERF_COUNT_HW_CACHE_L1D |
+			  (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+			  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}
+};
+
+/* all counters are in one group, so one read () gets them together */
+static int fd[PERF_COUNTERS];
+static int leader = -1;
+static int slot[PERF_COUNTERS];
+static int nr = 0;
+
+static int perf_event_open (int i, int group_fd)
+{
+    struct perf_event_attr attr;
+
+    memset (&attr, 0, sizeof (attr));
+    attr.size = sizeof (attr);
+    attr.type = events[i].type;
+    attr.config = events[i].config;
+    attr.read_format = (PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+			PERF_FORMAT_TOTAL_TIME_RUNNING);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall (__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+int perf_open (void)
+{
+    int i, mask, error;
+
+    mask = error = 0;
+    for (i = 0; i < PERF_COUNTERS; i++) {
+	fd[i] = perf_event_open (i, leader);
+	if (fd[i] < 0) {
+	    error = errno;
+	    continue;
+	}
+	if (leader < 0)
+	    leader = fd[i];
+	slot[i] = nr++;
+	mask |= 1 << i;
+    }
+    if (!mask)
+	fprintf (stderr, "perf counters unavailable: %s%s\n",
+		 strerror (error), (error == EACCES || error == EPERM) ?
+		 ", see /proc/sys/kernel/perf_event_paranoid" : "");
+    return mask;
+}
+
+void perf_read (uint64_t * counters)
+{
+    /* nr, time enabled, time running, then the values in group order */
+    uint64_t buf[3 + PERF_COUNTERS];
+    int i;
+
+    memset (counters, 0, PERF_VALUES * sizeof (uint64_t));
+    if (leader < 0 ||
+	read (leader, buf, sizeof (buf)) < (int) ((3 + nr) * sizeof (uint64_t)))
+	return;
+    for (i = 0; i < PERF_COUNTERS; i++)
+	if (fd[i] >= 0)
+	    counters[i] = buf[3 + slot[i]];
+    counters[PERF_TIME_ENABLED] = buf[1];
+    counters[PERF_TIME_RUNNING] = buf[2];
+}
+
+void perf_close (void)
+{
+    int i;
+
+    if (leader < 0)
+	return;
+    for (i = 0; i < PERF_COUNTERS; i++)
+	if (fd[i] >= 0)
+	    close (fd[i]);
+    leader = -1;
+}
+
+#else /* !HAVE_LINUX_PERF_EVENT_H */
+
+int perf_open (void)
+{
+    fprintf (stderr, "perf counters are only available on linux\n");
+    return 0;
+}
+
+void perf_read (uint64_t * counters)
+{
+    memset (counters, 0, PERF_VALUES * sizeof (uint64_t));
+}
+
+void perf_close (void)
+{
+}
+
+#endif
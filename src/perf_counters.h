@@ -0,0 +1,54 @@
+/*
+ * perf_counters.h
+ * Copyright (C) 2000-2003 Michel Lespinasse <walken@zoy.org>
+ * Copyright (C) 1999-2000 Aaron Holtzman <aholtzma@ess.engr.uvic.ca>
+ *
+ * This file is part of mpeg2dec, a free MPEG-2 video stream decoder.
+ * See http://libmpeg2.sourceforge.net/ for updates.
+ *
+ * mpeg2dec is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpeg2dec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpeg2dec; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef LIBMPEG2_PERF_COUNTERS_H
+#define LIBMPEG2_PERF_COUNTERS_H
+
+/* cycles, instructions, L1D read misses, LLC misses, branch misses */
+#define PERF_COUNTERS 5
+
+extern const char * const perf_counter_name[PERF_COUNTERS];
+
+/*
+ * perf_read () also gets the time the counters were enabled and the time
+ * they were actually counting, after the PERF_COUNTERS values. The two
+ * differ when the kernel had to multiplex the counters with other users,
+ * and then the counts only cover a running / enabled share of the time.
+ */
+#define PERF_TIME_ENABLED PERF_COUNTERS
+#define PERF_TIME_RUNNING (PERF_COUNTERS + 1)
+#define PERF_VALUES (PERF_COUNTERS + 2)
+
+/*
+ * perf_open () opens the hardware counters for the calling process, in
+ * user mode only, and returns a mask of the ones available. It returns
+ * 0 and prints why when there are none, e.g. on other systems than
+ * Linux or when perf_event_paranoid forbids it. perf_read () gets the
+ * current PERF_VALUES values, with 0 for the counters that are not
+ * available.
+ */
+int perf_open (void);
+void perf_read (uint64_t * counters);
+void perf_close (void);
+
+#endif /* LIBMPEG2_PERF_COUNTERS_H */
@@ -0,0 +1,125 @@
+/*
+ * ts_psi.c
+ * Copyright (C) 2000-2003 Michel Lespinasse <walken@zoy.org>
+ * Copyright (C) 1999-2000 Aaron Holtzman <aholtzma@ess.engr.uvic.ca>
+ *
+ * This file is part of mpeg2dec, a free MPEG-2 video stream decoder.
+ * See http://libmpeg2.sourceforge.net/ for updates.
+ *
+ * mpeg2dec is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpeg2dec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpeg2dec; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <inttypes.h>
+
+#include "ts_psi.h"
+
+static uint32_t psi_crc32 (uint8_t * buf, int len)
+{
+    uint32_t crc = 0xffffffff;
+    int i;
+
+    while (len--) {
+	crc ^= *buf++ << 24;
+	for (i = 0; i < 8; i++)
+	    crc = (crc << 1) ^ ((crc & 0x80000000) ? 0x04c11db7 : 0);
+    }
+    return crc;
+}
+
+uint8_t * psi_section (psi_t * psi, uint8_t * data, uint8_t * end,
+		       int payload_start)
+{
+    int len;
+
+    if (data >= end)
+	return NULL;
+    if (payload_start) {
+	data += 1 + data[0];	/* pointer_field */
+	psi->bytes = 0;
+	if (data >= end)
+	    return NULL;
+    } else if (!psi->bytes)
+	return NULL;
+    len = end - data;
+    if (len > (int) sizeof (psi->buf) - psi->bytes)
+	len = sizeof (psi->buf) - psi->bytes;
+    memcpy (psi->buf + psi->bytes, data, len);
+    psi->bytes += len;
+    if (psi->bytes < 3)
+	return NULL;
+    len = 3 + (((psi->buf[1] << 8) | psi->buf[2]) & 0xfff);
+    if (len > (int) sizeof (psi->buf) || len < 16) {
+	psi->bytes = 0;
+	return NULL;
+    }
+    if (psi->bytes < len)
+	return NULL;
+    psi->bytes = 0;
+    if (!(psi->buf[5] & 1) || psi_crc32 (psi->buf, len))
+	return NULL;	/* not current_next, or corrupted */
+    return psi->buf;
+}
+
+/* point pmt at the first program of a PAT section */
+void ts_pat (uint8_t * section, psi_t * pmt)
+{
+    uint8_t * entry;
+    uint8_t * end;
+
+    if (section[0] != 0x00)
+	return;
+    end = section + 3 + (((section[1] << 8) | section[2]) & 0xfff) - 4;
+    for (entry = section + 8; entry + 4 <= end; entry += 4)
+	if (entry[0] || entry[1]) {	/* skip the network_PID entry */
+	    int program = (entry[0] << 8) | entry[1];
+	    int pid = ((entry[2] << 8) | entry[3]) & 0x1fff;
+
+	    if (pid != pmt->pid || program != pmt->program) {
+		pmt->pid = pid;
+		pmt->program = program;
+		pmt->version = -1;
+		pmt->bytes = 0;
+	    }
+	    return;
+	}
+}
+
+/*
+ * Returns the pid of the first MPEG-1 or MPEG-2 video stream of a PMT
+ * section, or -1 if there is none or the PMT version did not change.
+ * Sections for other programs sharing the pid are ignored.
+ */
+int ts_pmt (uint8_t * section, psi_t * pmt)
+{
+    uint8_t * entry;
+    uint8_t * end;
+    int version;
+
+    version = (section[5] >> 1) & 31;
+    if (section[0] != 0x02 || version == pmt->version ||
+	((section[3] << 8) | section[4]) != pmt->program)
+	return -1;
+    pmt->version = version;
+    end = section + 3 + (((section[1] << 8) | section[2]) & 0xfff) - 4;
+    entry = section + 12 + (((section[10] << 8) | section[11]) & 0xfff);
+    for (; entry + 5 <= end;
+	 entry += 5 + (((entry[3] << 8) | entry[4]) & 0xfff))
+	if (entry[0] == 0x01 || entry[0] == 0x02)	/* MPEG-1/2 video */
+	    return ((entry[1] << 8) | entry[2]) & 0x1fff;
+    return -1;
+}
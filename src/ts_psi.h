@@ -0,0 +1,48 @@
+/*
+ * ts_psi.h
+ * Copyright (C) 2000-2003 Michel Lespinasse <walken@zoy.org>
+ * Copyright (C) 1999-2000 Aaron Holtzman <aholtzma@ess.engr.uvic.ca>
+ *
+ * This file is part of mpeg2dec, a free MPEG-2 video stream decoder.
+ * See http://libmpeg2.sourceforge.net/ for updates.
+ *
+ * mpeg2dec is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpeg2dec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpeg2dec; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef LIBMPEG2_TS_PSI_H
+#define LIBMPEG2_TS_PSI_H
+
+#include <inttypes.h>
+
+/*
+ * PSI sections (PAT, PMT) may span several transport packets. Each
+ * pid we watch for tables gets a psi_t that accumulates the section
+ * that started in its last payload_unit_start packet. The PMT one also
+ * keeps the program_number the PAT gave for its pid.
+ */
+typedef struct {
+    int pid;
+    int version;
+    int bytes;
+    int program;
+    uint8_t buf[1024 + 3];
+} psi_t;
+
+uint8_t * psi_section (psi_t * psi, uint8_t * data, uint8_t * end,
+		       int payload_start);
+void ts_pat (uint8_t * section, psi_t * pmt);
+int ts_pmt (uint8_t * section, psi_t * pmt);
+
+#endif /* LIBMPEG2_TS_PSI_H */
@@ -0,0 +1,115 @@
+/*
+ * ts_scan.c
+ * Copyright (C) 2000-2003 Michel Lespinasse <walken@zoy.org>
+ * Copyright (C) 1999-2000 Aaron Holtzman <aholtzma@ess.engr.uvic.ca>
+ *
+ * This file is part of mpeg2dec, a free MPEG-2 video stream decoder.
+ * See http://libmpeg2.sourceforge.net/ for updates.
+ *
+ * mpeg2dec is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpeg2dec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpeg2dec; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <inttypes.h>
+
+#include "ts_scan.h"
+
+static const int packet_sizes[] = {188, 204, 192};
+
+/*
+ * Find the first packet at or after buf, that is a sync byte followed
+ * by TS_SYNC_PACKETS - 1 more at one of the known packet spacings. At
+ * the end of the stream fewer do, as long as the last one ends there.
+ * On success *packet_size is set and the packet returned. Otherwise
+ * *packet_size is cleared, and the returned pointer is where the search
+ * should resume once more data has been read after end.
+ */
+uint8_t * ts_sync (uint8_t * buf, uint8_t * end, int last, int * packet_size)
+{
+    int i, j, size, more;
+
+    for (; (buf = (uint8_t *) memchr (buf, 0x47, end - buf)) != NULL; buf++) {
+	more = 0;
+	for (i = 0; i < 3; i++) {
+	    size = packet_sizes[i];
+	    for (j = 1; j < TS_SYNC_PACKETS && buf + j * size < end; j++)
+		if (buf[j * size] != 0x47)
+		    break;
+	    /* 204 byte packets end with parity, 192 ones start with a timecode */
+	    if (j == TS_SYNC_PACKETS ||
+		(last && buf + (j - 1) * size +
+		 ((size == 204) ? 204 : 188) == end)) {
+		*packet_size = size;
+		return buf;
+	    }
+	    if (j < TS_SYNC_PACKETS && buf + j * size >= end)
+		more = 1;
+	}
+	if (more && !last) {
+	    *packet_size = 0;
+	    return buf;
+	}
+    }
+    *packet_size = 0;
+    return end;
+}
+
+/*
+ * Check the packets starting at buf, up to TS_SCAN_PACKETS of them, and
+ * store their pids. A packet counts when the sync byte of the next one
+ * follows it, and is only judged once TS_SCAN_AHEAD bytes from its start
+ * are in the buffer, or at the end of the stream. Returns the number of
+ * packets that count.
+ */
+int ts_scan (uint8_t * buf, uint8_t * end, int packet_size, int last,
+	     int * pid)
+{
+    uint8_t * next;
+    int i, n, checked, size;
+    uint8_t bad;
+
+    if (buf >= end || buf[0] != 0x47)
+	return 0;
+    i = last ? 188 : TS_SCAN_AHEAD;
+    n = (end - buf >= i) ? (end - buf - i) / packet_size + 1 : 0;
+    if (n > TS_SCAN_PACKETS)
+	n = TS_SCAN_PACKETS;
+    /* nothing follows the last packet of the stream */
+    checked = (buf + n * packet_size < end) ? n : n - 1;
+
+    /* test the whole batch at once, streams rarely lose sync */
+    bad = 0;
+    for (i = 1; i <= checked; i++)
+	bad |= buf[i * packet_size] ^ 0x47;
+    if (bad) {
+	for (i = 0; buf[(i + 1) * packet_size] == 0x47; i++);
+	/*
+	 * the packet before the bad sync byte may be garbage that starts
+	 * with 0x47 and overlaps the next real packet: keep it only when
+	 * no sync point starts inside it
+	 */
+	next = buf + (i + 1) * packet_size;
+	if (ts_sync (buf + i * packet_size + 1, end, last, &size) >= next ||
+	    !size)
+	    i++;
+    } else
+	i = n;
+
+    for (n = 0; n < i; n++, buf += packet_size)
+	pid[n] = ((buf[1] << 8) + buf[2]) & 0x1fff;
+    return i;
+}
@@ -0,0 +1,49 @@
+/*
+ * ts_scan.h
+ * Copyright (C) 2000-2003 Michel Lespinasse <walken@zoy.org>
+ * Copyright (C) 1999-2000 Aaron Holtzman <aholtzma@ess.engr.uvic.ca>
+ *
+ * This file is part of mpeg2dec, a free MPEG-2 video stream decoder.
+ * See http://libmpeg2.sourceforge.net/ for updates.
+ *
+ * mpeg2dec is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpeg2dec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpeg2dec; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef LIBMPEG2_TS_SCAN_H
+#define LIBMPEG2_TS_SCAN_H
+
+#include <inttypes.h>
+
+/* packets looked at per ts_scan () call */
+#define TS_SCAN_PACKETS 64
+/* consecutive sync bytes needed to lock onto a packet size */
+#define TS_SYNC_PACKETS 3
+/* bytes from the start of a packet that ts_scan () wants to judge it */
+#define TS_SCAN_AHEAD (TS_SYNC_PACKETS * 204)
+/* smallest read buffer the scanner can make progress with */
+#define TS_BUFFER_MIN (TS_SCAN_AHEAD + 188)
+
+/*
+ * Both functions work on pointers to the 0x47 sync byte of a packet.
+ * The packet_size is 188 for plain transport streams, 192 when each
+ * packet is preceded by a 4-byte timecode (M2TS) and 204 when it is
+ * followed by 16 bytes of Reed-Solomon parity. last tells ts_scan ()
+ * that end is the end of the stream.
+ */
+uint8_t * ts_sync (uint8_t * buf, uint8_t * end, int last, int * packet_size);
+int ts_scan (uint8_t * buf, uint8_t * end, int packet_size, int last,
+	     int * pid);
+
+#endif /* LIBMPEG2_TS_SCAN_H */
@@ -0,0 +1,560 @@
+/*
+ * conformance.c
+ * Copyright (C) 2000-2003 Michel Lespinasse <walken@zoy.org>
+ * Copyright (C) 1999-2000 Aaron Holtzman <aholtzma@ess.engr.uvic.ca>
+ *
+ * This file is part of mpeg2dec, a free MPEG-2 video stream decoder.
+ * See http://libmpeg2.sourceforge.net/ for updates.
+ *
+ * mpeg2dec is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpeg2dec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpeg2dec; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "mpeg2.h"
+#include "mpeg2convert.h"
+#include "attributes.h"
+#include "mpeg2_internal.h"
+
+extern void (* mpeg2_idct_copy) (int shape, int16_t * block,
+				 uint8_t * dest, int stride);
+extern void (* mpeg2_idct_add) (int shape, int16_t * block,
+				uint8_t * dest, int stride);
+extern void (* mpeg2_cpu_state_save) (cpu_state_t * state);
+extern void (* mpeg2_cpu_state_restore) (cpu_state_t * state);
+extern mpeg2_mc_t mpeg2_mc;
+
+#define MAX_LEVELS 32
+
+/*
+ * Everything the decoder takes from mpeg2_accel () for one accel level,
+ * so that decoders running at different levels can be interleaved in
+ * one process by switching these before each mpeg2_parse () call.
+ */
+typedef struct {
+    uint32_t accel;
+    const char * name;
+    uint8_t scan_norm[64], scan_alt[64];
+    uint8_t perm[64];		/* block position of each coefficient */
+    uint8_t idct_shape[64];
+    void (* idct_copy) (int shape, int16_t * block, uint8_t * dest,
+			int stride);
+    void (* idct_add) (int shape, int16_t * block, uint8_t * dest,
+		       int stride);
+    mpeg2_mc_t mc;
+    void (* state_save) (cpu_state_t * state);
+    void (* state_restore) (cpu_state_t * state);
+    /* idct blocks checked, blocks off by more than 1, largest error */
+    unsigned int idct_blocks, idct_errors, idct_skipped;
+    int idct_max;
+} level_t;
+
+static level_t levels[MAX_LEVELS];
+static int nb_levels;
+static level_t * level;
+
+static const struct {
+    const char * name;
+    mpeg2_convert_t * convert;
+    int bpp;
+} converters[] = {
+    {"rgb32", mpeg2convert_rgb32, 32}, {"rgb24", mpeg2convert_rgb24, 24},
+    {"rgb16", mpeg2convert_rgb16, 16}, {"rgb15", mpeg2convert_rgb15, 15},
+    {"rgb8", mpeg2convert_rgb8, 8}, {"bgr32", mpeg2convert_bgr32, 32},
+    {"bgr24", mpeg2convert_bgr24, 24}, {"bgr16", mpeg2convert_bgr16, 16},
+    {"bgr15", mpeg2convert_bgr15, 15}, {"bgr8", mpeg2convert_bgr8, 8},
+    {"uyvy", mpeg2convert_uyvy, 0}
+};
+#define CONVERTERS ((int) (sizeof (converters) / sizeof (converters[0])))
+
+static const char * accel_name (uint32_t accel)
+{
+    if (!accel)
+	return "c";
+#ifdef ARCH_X86
+    if (accel & MPEG2_ACCEL_X86_SSE3)
+	return "sse3";
+    if (accel & MPEG2_ACCEL_X86_SSE2)
+	return "sse2";
+    if (accel & MPEG2_ACCEL_X86_MMXEXT)
+	return "mmxext";
+    if (accel & MPEG2_ACCEL_X86_3DNOW)
+	return "3dnow";
+    if (accel & MPEG2_ACCEL_X86_MMX)
+	return "mmx";
+#endif
+#ifdef ARCH_PPC
+    if (accel & MPEG2_ACCEL_PPC_ALTIVEC)
+	return "altivec";
+#endif
+#ifdef ARCH_ALPHA
+    if (accel & MPEG2_ACCEL_ALPHA_MVI)
+	return "mvi";
+    if (accel & MPEG2_ACCEL_ALPHA)
+	return "alpha";
+#endif
+#ifdef ARCH_SPARC
+    if (accel & MPEG2_ACCEL_SPARC_VIS2)
+	return "vis2";
+    if (accel & MPEG2_ACCEL_SPARC_VIS)
+	return "vis";
+#endif
+#ifdef ARCH_ARM
+    if (accel & MPEG2_ACCEL_ARM)
+	return "arm";
+#endif
+    return "unknown";
+}
+
+/*
+ * The idct of an accelerated level is run next to the c one, on the
+ * same coefficients. It may differ from it by 1, as IEEE-1180 allows
+ * for the peak error of each, but only when the coefficients are in
+ * the IEEE-1180 input range: the 16-bit simd idcts overflow on blocks
+ * near the saturation limits, which only synthetic streams contain.
+ * Blocks outside that range (not counting the dc of intra blocks) are
+ * not checked at all, so a stream where more than three quarters of the
+ * blocks fall outside it fails as too weak a test of the idct. The
+ * c output is kept either way, so that idct differences do not drift
+ * through prediction and everything else can be checked bit-exact.
+ */
+#define IEEE1180_RANGE (300 << 4)
+static void check_idct (int add, int shape, int16_t * block, uint8_t * dest,
+			int stride)
+{
+    int16_t ref_block[64] ATTR_ALIGN(16);
+    uint8_t save[64], ref[64];
+    int i, j, diff, in_range;
+
+    in_range = 1;
+    for (i = 0; i < 64; i++) {
+	ref_block[levels[0].perm[i]] = block[level->perm[i]];
+	if ((i || add) && abs (block[level->perm[i]]) > IEEE1180_RANGE)
+	    in_range = 0;
+    }
+    for (i = 0; i < 8; i++)
+	memcpy (save + 8 * i, dest + i * stride, 8);
+    if (add)
+	levels[0].idct_add (shape, ref_block, dest, stride);
+    else
+	levels[0].idct_copy (shape, ref_block, dest, stride);
+    for (i = 0; i < 8; i++) {
+	memcpy (ref + 8 * i, dest + i * stride, 8);
+	memcpy (dest + i * stride, save + 8 * i, 8);
+    }
+    if (add)
+	level->idct_add (shape, block, dest, stride);
+    else
+	level->idct_copy (shape, block, dest, stride);
+
+    level->idct_blocks++;
+    diff = 0;
+    for (i = 0; i < 8; i++)
+	for (j = 0; j < 8; j++) {
+	    int d = dest[i * stride + j] - ref[8 * i + j];
+
+	    if (d < 0)
+		d = -d;
+	    if (d > diff)
+		diff = d;
+	}
+    if (!in_range)
+	level->idct_skipped++;
+    else {
+	if (diff > 1)
+	    level->idct_errors++;
+	if (diff > level->idct_max)
+	    level->idct_max = diff;
+    }
+    for (i = 0; i < 8; i++)
+	memcpy (dest + i * stride, ref + 8 * i, 8);
+}
+
+static void check_idct_copy (int shape, int16_t * block, uint8_t * dest,
+			     int stride)
+{
+    check_idct (0, shape, block, dest, stride);
+}
+
+static void check_idct_add (int shape, int16_t * block, uint8_t * dest,
+			    int stride)
+{
+    check_idct (1, shape, block, dest, stride);
+}
+
+static void use_level (int i)
+{
+    level = levels + i;
+    memcpy (mpeg2_scan_norm, level->scan_norm, 64);
+    memcpy (mpeg2_scan_alt, level->scan_alt, 64);
+    memcpy (mpeg2_idct_shape, level->idct_shape, 64);
+    mpeg2_idct_copy = i ? check_idct_copy : level->idct_copy;
+    mpeg2_idct_add = i ? check_idct_add : level->idct_add;
+    mpeg2_mc = level->mc;
+    mpeg2_cpu_state_save = level->state_save;
+    mpeg2_cpu_state_restore = level->state_restore;
+}
+
+/*
+ * Levels are the detected flags up to and including each of their bits
+ * in turn, as in bench/kernels.c, so every implementation of a kernel
+ * gets used by at least one level.
+ */
+static void init_levels (void)
+{
+    uint8_t scan_norm[64], scan_alt[64];
+    uint32_t detected, bit;
+    level_t * l;
+    int i;
+
+    memcpy (scan_norm, mpeg2_scan_norm, 64);
+    memcpy (scan_alt, mpeg2_scan_alt, 64);
+    detected = mpeg2_accel (MPEG2_ACCEL_DETECT);
+    for (bit = 0; bit < 32; bit++) {
+	if (bit && !(detected & (1 << (bit - 1))))
+	    continue;
+	l = levels + nb_levels++;
+	l->accel = bit ? detected & ((1 << bit) - 1) : 0;
+	l->name = accel_name (l->accel);
+
+	memcpy (mpeg2_scan_norm, scan_norm, 64);
+	memcpy (mpeg2_scan_alt, scan_alt, 64);
+	mpeg2_cpu_state_save = mpeg2_cpu_state_restore = NULL;
+	mpeg2_cpu_state_init (l->accel);
+	mpeg2_idct_init (l->accel);
+	mpeg2_mc_init (l->accel);
+
+	memcpy (l->scan_norm, mpeg2_scan_norm, 64);
+	memcpy (l->scan_alt, mpeg2_scan_alt, 64);
+	memcpy (l->idct_shape, mpeg2_idct_shape, 64);
+	for (i = 0; i < 64; i++)
+	    l->perm[scan_norm[i]] = mpeg2_scan_norm[i];
+	l->idct_copy = mpeg2_idct_copy;
+	l->idct_add = mpeg2_idct_add;
+	l->mc = mpeg2_mc;
+	l->state_save = mpeg2_cpu_state_save;
+	l->state_restore = mpeg2_cpu_state_restore;
+    }
+}
+
+static int compare (const char * name, int frame, const char * what,
+		    const uint8_t * ref, const uint8_t * buf,
+		    int width, int height)
+{
+    int x, y;
+
+    for (y = 0; y < height; y++)
+	for (x = 0; x < width; x++)
+	    if (buf[y * width + x] != ref[y * width + x]) {
+		printf ("%s: frame %d %s differs at %d,%d: %d instead of %d\n",
+			name, frame, what, x, y, buf[y * width + x],
+			ref[y * width + x]);
+		return 1;
+	    }
+    return 0;
+}
+
+static int convert (int i, uint32_t accel, const mpeg2_sequence_t * sequence,
+		    uint8_t * const * src, uint8_t ** dest, int * size)
+{
+    mpeg2_convert_init_t init;
+    mpeg2_picture_t picture;
+    mpeg2_fbuf_t fbuf;
+    uint8_t * row[3];
+    void * id;
+    int stride, y, shift;
+
+    if (converters[i].convert (MPEG2_CONVERT_SET, NULL, sequence, 0,
+			       accel, NULL, &init))
+	return 1;
+    stride = converters[i].convert (MPEG2_CONVERT_STRIDE, NULL, sequence, 0,
+				    accel, NULL, &init);
+    id = malloc (init.id_size);
+    converters[i].convert (MPEG2_CONVERT_START, id, sequence, stride,
+			   accel, NULL, &init);
+    *size = init.buf_size[0];
+    *dest = fbuf.buf[0] = (uint8_t *) calloc (1, init.buf_size[0]);
+    fbuf.buf[1] = fbuf.buf[2] = NULL;
+    fbuf.id = NULL;
+
+    /* whole frames in display order, as the decoder does for progressive
+       frame pictures */
+    memset (&picture, 0, sizeof (picture));
+    picture.nb_fields = 2;
+    picture.flags = PIC_FLAG_PROGRESSIVE_FRAME | PIC_FLAG_TOP_FIELD_FIRST;
+    shift = (sequence->chroma_height < sequence->height);
+    init.start (id, &fbuf, &picture, NULL);
+    for (y = 0; y < (int) sequence->height; y += 16) {
+	row[0] = src[0] + y * sequence->width;
+	row[1] = src[1] + (y >> shift) * sequence->chroma_width;
+	row[2] = src[2] + (y >> shift) * sequence->chroma_width;
+	init.copy (id, row, y);
+    }
+    free (id);
+    return 0;
+}
+
+/*
+ * Largest difference between two converted pictures, per colour
+ * component for the 15 to 32 bpp rgb formats. Anything else has to
+ * match exactly.
+ */
+static int convert_diff (int bpp, const uint8_t * ref, const uint8_t * buf,
+			 int size)
+{
+    const uint16_t * ref16 = (const uint16_t *) ref;
+    const uint16_t * buf16 = (const uint16_t *) buf;
+    int i, shift, bits, diff, d;
+
+    diff = 0;
+    switch (bpp) {
+    case 32:
+    case 24:
+	for (i = 0; i < size; i++) {
+	    d = abs (buf[i] - ref[i]);
+	    if (d > diff)
+		diff = d;
+	}
+	return diff;
+    case 16:
+    case 15:
+	for (i = 0; i < size / 2; i++)
+	    for (shift = 0; shift < 16; shift += bits) {
+		bits = (bpp == 16 && shift == 5) ? 6 : 5;
+		d = abs (((buf16[i] >> shift) & ((1 << bits) - 1)) -
+			 ((ref16[i] >> shift) & ((1 << bits) - 1)));
+		if (d > diff)
+		    diff = d;
+	    }
+	return diff;
+    default:
+	return memcmp (buf, ref, size) ? 255 : 0;
+    }
+}
+
+/*
+ * The accelerated yuv to rgb converters work at a lower precision than
+ * the c ones and clip luma below 16 where the c ones do not. They are
+ * compared on a copy of the picture clamped to the nominal ITU-R BT.601
+ * ranges, and allowed to be CONVERT_ERROR off on each colour component.
+ */
+#define CONVERT_ERROR 4
+
+static uint8_t * clamp_plane (const uint8_t * src, int size, int max)
+{
+    uint8_t * plane;
+    int i;
+
+    plane = (uint8_t *) malloc (size);
+    for (i = 0; i < size; i++)
+	plane[i] = (src[i] < 16) ? 16 : (src[i] > max) ? max : src[i];
+    return plane;
+}
+
+static int check_convert (const char * name, int frame,
+			  const mpeg2_sequence_t * sequence,
+			  uint8_t * const * yuv)
+{
+    uint8_t * src[3];
+    uint8_t * ref, * buf;
+    int i, j, size, diff, error;
+
+    size = sequence->chroma_width * sequence->chroma_height;
+    src[0] = clamp_plane (yuv[0], sequence->width * sequence->height, 235);
+    src[1] = clamp_plane (yuv[1], size, 240);
+    src[2] = clamp_plane (yuv[2], size, 240);
+    error = 0;
+    for (i = 0; i < CONVERTERS && !error; i++) {
+	if (convert (i, 0, sequence, src, &ref, &size))
+	    continue;
+	for (j = 1; j < nb_levels && !error; j++) {
+	    convert (i, levels[j].accel, sequence, src, &buf, &size);
+	    diff = convert_diff (converters[i].bpp, ref, buf, size);
+	    free (buf);
+	    if (diff > (converters[i].bpp >= 15 ? CONVERT_ERROR : 0)) {
+		printf ("%s: frame %d %s %s off by up to %d\n", name, frame,
+			converters[i].name, levels[j].name, diff);
+		error = 1;
+	    }
+	}
+	free (ref);
+    }
+    for (i = 0; i < 3; i++)
+	free (src[i]);
+    return error;
+}
+
+static int check_stream (const char * name)
+{
+    mpeg2dec_t * decoder[MAX_LEVELS];
+    const mpeg2_info_t * info[MAX_LEVELS];
+    mpeg2_state_t state[MAX_LEVELS];
+    const mpeg2_sequence_t * sequence;
+    uint8_t * buf;
+    long size;
+    FILE * file;
+    int i, j, frames, error;
+
+    file = fopen (name, "rb");
+    if (file == NULL) {
+	printf ("%s: cannot open\n", name);
+	return 1;
+    }
+    fseek (file, 0, SEEK_END);
+    size = ftell (file);
+    fseek (file, 0, SEEK_SET);
+    buf = (uint8_t *) malloc (size);
+    if (buf == NULL || fread (buf, 1, size, file) != (size_t) size) {
+	printf ("%s: cannot read\n", name);
+	return 1;
+    }
+    fclose (file);
+
+    for (i = 0; i < nb_levels; i++) {
+	decoder[i] = mpeg2_init ();
+	if (decoder[i] == NULL)
+	    return 1;
+	info[i] = mpeg2_info (decoder[i]);
+	mpeg2_buffer (decoder[i], buf, buf + size);
+    }
+
+    frames = error = 0;
+    while (!error) {
+	for (i = 0; i < nb_levels; i++) {
+	    use_level (i);
+	    state[i] = mpeg2_parse (decoder[i]);
+	}
+	for (i = 1; i < nb_levels; i++)
+	    if (state[i] != state[0]) {
+		printf ("%s: %s decoder in state %d instead of %d\n",
+			name, levels[i].name, state[i], state[0]);
+		error = 1;
+	    }
+	if (error || state[0] == STATE_BUFFER)
+	    break;
+	if ((state[0] != STATE_SLICE && state[0] != STATE_END &&
+	     state[0] != STATE_INVALID_END) || !info[0]->display_fbuf)
+	    continue;
+
+	sequence = info[0]->sequence;
+	for (i = 1; i < nb_levels && !error; i++)
+	    for (j = 0; j < 3 && !error; j++) {
+		char what[32];
+
+		sprintf (what, "%s plane %d", levels[i].name, j);
+		error = compare (name, frames, what,
+				 info[0]->display_fbuf->buf[j],
+				 info[i]->display_fbuf->buf[j],
+				 j ? sequence->chroma_width : sequence->width,
+				 j ? sequence->chroma_height : sequence->height);
+	    }
+	if (!error)
+	    error = check_convert (name, frames, sequence,
+				   info[0]->display_fbuf->buf);
+	frames++;
+    }
+
+    for (i = 1; i < nb_levels; i++)
+	if (levels[i].idct_errors) {
+	    printf ("%s: %s idct off by up to %d in %u of %u blocks\n",
+		    name, levels[i].name, levels[i].idct_max,
+		    levels[i].idct_errors, levels[i].idct_blocks);
+	    error = 1;
+	}
+    if (nb_levels > 1 && levels[1].idct_skipped) {
+	printf ("%s: %u of %u idct blocks outside the IEEE-1180 range, "
+		"not checked\n",
+		name, levels[1].idct_skipped, levels[1].idct_blocks);
+	if (levels[1].idct_skipped * 4 > levels[1].idct_blocks * 3) {
+	    printf ("%s: too few idct blocks checked\n", name);
+	    error = 1;
+	}
+    }
+    for (i = 0; i < nb_levels; i++)
+	mpeg2_close (decoder[i]);
+    free (buf);
+
+    printf ("%s: %d frames %s\n", name, frames, error ? "FAILED" : "OK");
+    return error;
+}
+
+static void print_usage (char ** argv)
+{
+    fprintf (stderr, "usage: %s [-j <jobs>] <stream> ...\n"
+	     "\t-j\tstreams checked in parallel (default: one per cpu)\n",
+	     argv[0]);
+    exit (1);
+}
+
+int main (int argc, char ** argv)
+{
+    int c, i, jobs, running, status, failed;
+    char * s;
+    pid_t pid;
+
+    jobs = sysconf (_SC_NPROCESSORS_ONLN);
+    while ((c = getopt (argc, argv, "j:")) != -1)
+	switch (c) {
+	case 'j':
+	    jobs = strtol (optarg, &s, 0);
+	    if (jobs < 1 || *s)
+		print_usage (argv);
+	    break;
+	default:
+	    print_usage (argv);
+	}
+    if (optind == argc)
+	print_usage (argv);
+    if (jobs < 1)
+	jobs = 1;
+
+    init_levels ();
+    printf ("accel levels:");
+    for (i = 0; i < nb_levels; i++)
+	printf (" %s", levels[i].name);
+    printf ("\n");
+    fflush (stdout);
+
+    running = failed = 0;
+    for (i = optind; i < argc; i++) {
+	if (running == jobs) {
+	    wait (&status);
+	    failed |= !WIFEXITED (status) || WEXITSTATUS (status);
+	    running--;
+	}
+	pid = fork ();
+	if (pid == 0) {
+	    status = check_stream (argv[i]);
+	    fflush (stdout);
+	    _exit (status);
+	} else if (pid < 0)
+	    failed |= check_stream (argv[i]);
+	else
+	    running++;
+    }
+    while (running--) {
+	wait (&status);
+	failed |= !WIFEXITED (status) || WEXITSTATUS (status);
+    }
+
+    return failed;
+}
@@ -99,6 +99,18 @@ SOURCE=..\src\gettimeofday.c
 
 SOURCE=..\src\mpeg2dec.c
 # End Source File
+# Begin Source File
+
+SOURCE=..\src\perf_counters.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\src\ts_psi.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\src\ts_scan.c
+# End Source File
 # End Group
 # Begin Group "Header Files"
 
@@ -107,6 +119,18 @@ SOURCE=..\src\mpeg2dec.c
 
 SOURCE=..\src\getopt.h
 # End Source File
+# Begin Source File
+
+SOURCE=..\src\perf_counters.h
+# End Source File
+# Begin Source File
+
+SOURCE=..\src\ts_psi.h
+# End Source File
+# Begin Source File
+
+SOURCE=..\src\ts_scan.h
+# End Source File
 # End Group
 # Begin Group "Resource Files"
 